@@ -0,0 +1,689 @@
+/*
+ * Author: Pu-Chen Mao
+ * Date:   2026/10/15
+ * File:   bench.c
+ * Desc:   Synthetic RTP stream generator and depacketizer benchmark
+ */
+
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rtp_depacketizer.h"
+
+#define BENCH_MAX_PACKET   1600
+#define BENCH_SSRC_BASE    0x10000000
+#define BENCH_PAYLOAD_TYPE 96
+
+typedef struct bench_config_t
+{
+    codec_t  codec;
+    prefix_t prefix;
+    size_t   streams;
+    size_t   frames;
+    size_t   fps;
+    size_t   mtu;
+    size_t   frame_size;
+    size_t   idr_size;
+    size_t   gop;
+    size_t   opus_size;
+    double   loss;
+    double   reorder;
+    size_t   reorder_depth;
+    double   duplicate;
+    gint64   jitter_us;
+    gint64   timeout_us;
+    gint64   reap_us;
+    bool     realtime;
+    bool     incremental;
+    guint32  seed;
+
+} bench_config_t;
+
+/* One packet on the wire: which stream sent it, when it arrives relative
+ * to the start of the run, and where its bytes sit in the arena */
+typedef struct bench_packet_t
+{
+    size_t  stream;
+    gint64  arrival_us;
+    size_t  position;   // place among packets arriving at the same time
+    size_t  offset;
+    size_t  length;
+
+} bench_packet_t;
+
+typedef struct bench_stream_t
+{
+    uint32_t ssrc;
+    uint16_t sequence;
+    uint32_t timestamp;
+
+} bench_stream_t;
+
+typedef struct bench_t
+{
+    bench_config_t  config;
+    GRand          *rand;
+    GByteArray     *arena;
+    GArray         *packets;
+    GArray         *latencies;
+    bench_stream_t *streams;
+
+} bench_t;
+
+static const uint8_t bench_sps[] = {0x67, 0x42, 0xC0, 0x1E, 0xD9, 0x00,
+                                    0xA0, 0x47, 0xFE, 0xC8};
+static const uint8_t bench_pps[] = {0x68, 0xCE, 0x3C, 0x80};
+
+static bool bench_parse_options(bench_config_t *config, int argc,
+        char **argv);
+static void bench_generate(bench_t *bench);
+static void bench_generate_h264(bench_t *bench, size_t stream,
+        size_t frame, gint64 send_us);
+static void bench_generate_opus(bench_t *bench, size_t stream,
+        gint64 send_us);
+static void bench_emit(bench_t *bench, size_t stream, gint64 send_us,
+        bool marker, const uint8_t *header, size_t headerlen,
+        const uint8_t *payload, size_t length);
+static void bench_impair(bench_t *bench);
+static gint bench_compare_arrival(gconstpointer lval, gconstpointer rval);
+static gint bench_compare_latency(gconstpointer lval, gconstpointer rval);
+static bool bench_run(bench_t *bench);
+static size_t bench_drain(bench_t *bench, rtp_depacketizer_t *depacketizer,
+        media_t *media, bool ready);
+static void bench_report(bench_t *bench, size_t packets, size_t frames,
+        gint64 elapsed_ns, const rtp_stats_t *stats);
+static gint64 bench_get_percentile(GArray *latencies, double percentile);
+static void bench_add_stats(rtp_stats_t *total, const rtp_stats_t *stats);
+static gint64 bench_now_ns(void);
+static void bench_usage(const char *name);
+
+int
+main(int    argc,
+     char **argv)
+{
+    bench_t bench;
+    int     status = EXIT_FAILURE;
+
+    memset(&bench, 0, sizeof(bench));
+    if (!bench_parse_options(&(bench.config), argc, argv))
+    {
+        bench_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bench.rand = g_rand_new_with_seed(bench.config.seed);
+    bench.arena = g_byte_array_new();
+    bench.packets = g_array_new(FALSE, FALSE, sizeof(bench_packet_t));
+    bench.latencies = g_array_new(FALSE, FALSE, sizeof(gint64));
+    bench.streams = g_new0(bench_stream_t, bench.config.streams);
+
+    bench_generate(&bench);
+    bench_impair(&bench);
+    if (bench_run(&bench))
+        status = EXIT_SUCCESS;
+
+    g_free(bench.streams);
+    g_array_free(bench.latencies, TRUE);
+    g_array_free(bench.packets, TRUE);
+    g_byte_array_free(bench.arena, TRUE);
+    g_rand_free(bench.rand);
+
+    return status;
+}
+
+static bool
+bench_parse_options(bench_config_t *config,
+                    int             argc,
+                    char          **argv)
+{
+    static const struct option options[] =
+    {
+        {"codec",         required_argument, NULL, 'c'},
+        {"prefix",        required_argument, NULL, 'p'},
+        {"streams",       required_argument, NULL, 's'},
+        {"frames",        required_argument, NULL, 'n'},
+        {"fps",           required_argument, NULL, 'f'},
+        {"mtu",           required_argument, NULL, 'm'},
+        {"frame-size",    required_argument, NULL, 'z'},
+        {"idr-size",      required_argument, NULL, 'i'},
+        {"gop",           required_argument, NULL, 'g'},
+        {"opus-size",     required_argument, NULL, 'o'},
+        {"loss",          required_argument, NULL, 'l'},
+        {"reorder",       required_argument, NULL, 'r'},
+        {"reorder-depth", required_argument, NULL, 'd'},
+        {"duplicate",     required_argument, NULL, 'u'},
+        {"jitter-us",     required_argument, NULL, 'j'},
+        {"timeout-us",    required_argument, NULL, 't'},
+        {"reap-us",       required_argument, NULL, 'a'},
+        {"seed",          required_argument, NULL, 'e'},
+        {"realtime",      no_argument,       NULL, 'R'},
+        {"incremental",   no_argument,       NULL, 'I'},
+        {"help",          no_argument,       NULL, 'h'},
+        {NULL,            0,                 NULL, 0},
+    };
+    int option = 0;
+
+    config->codec = CODEC_H264;
+    config->prefix = PREFIX_ANNEXB;
+    config->streams = 1;
+    config->frames = 10000;
+    config->fps = 30;
+    config->mtu = 1200;
+    config->frame_size = 4000;
+    config->idr_size = 30000;
+    config->gop = 60;
+    config->opus_size = 120;
+    config->reorder_depth = 4;
+    config->timeout_us = 1000000;
+    config->reap_us = 100000;
+    config->seed = 1;
+
+    while ((option = getopt_long(argc, argv, "h", options, NULL)) != -1)
+    {
+        switch (option)
+        {
+            case 'c':
+                if (!strcmp(optarg, "h264"))
+                    config->codec = CODEC_H264;
+                else if (!strcmp(optarg, "opus"))
+                    config->codec = CODEC_OPUS;
+                else
+                    return false;
+                break;
+            case 'p':
+                if (!strcmp(optarg, "annexb"))
+                    config->prefix = PREFIX_ANNEXB;
+                else if (!strcmp(optarg, "avcc"))
+                    config->prefix = PREFIX_AVCC;
+                else if (!strcmp(optarg, "none"))
+                    config->prefix = PREFIX_NONE;
+                else
+                    return false;
+                break;
+            case 's': config->streams = strtoul(optarg, NULL, 0); break;
+            case 'n': config->frames = strtoul(optarg, NULL, 0); break;
+            case 'f': config->fps = strtoul(optarg, NULL, 0); break;
+            case 'm': config->mtu = strtoul(optarg, NULL, 0); break;
+            case 'z': config->frame_size = strtoul(optarg, NULL, 0); break;
+            case 'i': config->idr_size = strtoul(optarg, NULL, 0); break;
+            case 'g': config->gop = strtoul(optarg, NULL, 0); break;
+            case 'o': config->opus_size = strtoul(optarg, NULL, 0); break;
+            case 'l': config->loss = strtod(optarg, NULL); break;
+            case 'r': config->reorder = strtod(optarg, NULL); break;
+            case 'd': config->reorder_depth = strtoul(optarg, NULL, 0); break;
+            case 'u': config->duplicate = strtod(optarg, NULL); break;
+            case 'j': config->jitter_us = strtoll(optarg, NULL, 0); break;
+            case 't': config->timeout_us = strtoll(optarg, NULL, 0); break;
+            case 'a': config->reap_us = strtoll(optarg, NULL, 0); break;
+            case 'e': config->seed = strtoul(optarg, NULL, 0); break;
+            case 'R': config->realtime = true; break;
+            case 'I': config->incremental = true; break;
+            default: return false;
+        }
+    }
+
+    return config->streams > 0 && config->fps > 0 && config->gop > 0 &&
+        config->mtu > 16 && config->mtu + 12 <= BENCH_MAX_PACKET &&
+        config->frame_size > 1 && config->idr_size > 1 &&
+        config->opus_size > 1 && config->opus_size + 12 <= BENCH_MAX_PACKET;
+}
+
+/* NOTE: streams start staggered across one frame interval so their packets
+ * interleave the way they would on a shared socket */
+static void
+bench_generate(bench_t *bench)
+{
+    bench_config_t *config   = NULL;
+    gint64          interval = 0;
+    size_t          stream   = 0;
+    size_t          frame    = 0;
+
+    config = &(bench->config);
+    interval = (config->codec == CODEC_OPUS) ? 20000 :
+        (gint64)(1000000 / config->fps);
+    for (stream = 0; stream < config->streams; stream++)
+    {
+        bench->streams[stream].ssrc = BENCH_SSRC_BASE + stream;
+        bench->streams[stream].sequence = g_rand_int(bench->rand);
+        bench->streams[stream].timestamp = g_rand_int(bench->rand);
+    }
+
+    for (frame = 0; frame < config->frames; frame++)
+    {
+        for (stream = 0; stream < config->streams; stream++)
+        {
+            if (config->codec == CODEC_OPUS)
+                bench_generate_opus(bench, stream, frame * interval +
+                        stream * interval / config->streams);
+            else
+                bench_generate_h264(bench, stream, frame, frame * interval +
+                        stream * interval / config->streams);
+        }
+    }
+}
+
+/* NOTE: IDR frames are preceded by a STAP-A carrying SPS and PPS. A frame
+ * is one slice, sent as a single NALU when it fits the MTU and as FU-A
+ * fragments otherwise. Sizes vary by up to 25% around the configured one */
+static void
+bench_generate_h264(bench_t *bench,
+                    size_t   stream,
+                    size_t   frame,
+                    gint64   send_us)
+{
+    bench_config_t *config   = NULL;
+    uint8_t         stap[64];
+    uint8_t         slice[BENCH_MAX_PACKET];
+    uint8_t         fu[2];
+    size_t          size     = 0;
+    size_t          offset   = 0;
+    size_t          chunk    = 0;
+    size_t          idx      = 0;
+    bool            idr      = false;
+
+    config = &(bench->config);
+    idr = (frame % config->gop == 0);
+    size = idr ? config->idr_size : config->frame_size;
+    size = size * 3 / 4 + g_rand_int_range(bench->rand, 0, size / 2 + 1);
+    size = MAX(size, 2);
+
+    if (idr)
+    {
+        stap[idx++] = 0x78;
+        stap[idx++] = 0;
+        stap[idx++] = sizeof(bench_sps);
+        memcpy(stap + idx, bench_sps, sizeof(bench_sps));
+        idx += sizeof(bench_sps);
+        stap[idx++] = 0;
+        stap[idx++] = sizeof(bench_pps);
+        memcpy(stap + idx, bench_pps, sizeof(bench_pps));
+        idx += sizeof(bench_pps);
+        bench_emit(bench, stream, send_us, false, NULL, 0, stap, idx);
+    }
+
+    /* NALU header, then a slice header (first_mb 0, I or P slice). No
+     * zero bytes, so no 00 00 0x Annex B output would reject, wherever
+     * the fragments are cut from */
+    for (idx = 0; idx < sizeof(slice); idx++)
+        slice[idx] = (uint8_t)(g_rand_int_range(bench->rand, 1, 256));
+    slice[0] = idr ? 0x65 : 0x41;
+    slice[1] = idr ? 0x88 : 0xE0;
+
+    if (size <= config->mtu)
+    {
+        bench_emit(bench, stream, send_us, true, NULL, 0, slice, size);
+        bench->streams[stream].timestamp += 90000 / config->fps;
+        return;
+    }
+
+    /* The NALU header byte is carried by the FU indicator and header */
+    fu[0] = (slice[0] & 0xE0) | 28;
+    for (offset = 1; offset < size; offset += chunk)
+    {
+        chunk = MIN(config->mtu - sizeof(fu), size - offset);
+        fu[1] = (slice[0] & 0x1F) | ((offset == 1) ? 0x80 : 0) |
+            ((offset + chunk == size) ? 0x40 : 0);
+        bench_emit(bench, stream, send_us, offset + chunk == size, fu,
+                sizeof(fu), slice + 1 + (offset - 1) % (sizeof(slice) - 1 -
+                    chunk), chunk);
+    }
+    bench->streams[stream].timestamp += 90000 / config->fps;
+}
+
+/* NOTE: one 20ms CELT frame per packet, TOC code 0 */
+static void
+bench_generate_opus(bench_t *bench,
+                    size_t   stream,
+                    gint64   send_us)
+{
+    uint8_t payload[BENCH_MAX_PACKET];
+    size_t  size = 0;
+    size_t  idx  = 0;
+
+    size = bench->config.opus_size;
+    for (idx = 0; idx < size; idx++)
+        payload[idx] = (uint8_t)(g_rand_int(bench->rand));
+    payload[0] = 0xF8;
+
+    bench_emit(bench, stream, send_us, true, NULL, 0, payload, size);
+    bench->streams[stream].timestamp += 960;
+}
+
+static void
+bench_emit(bench_t       *bench,
+           size_t         stream,
+           gint64         send_us,
+           bool           marker,
+           const uint8_t *header,
+           size_t         headerlen,
+           const uint8_t *payload,
+           size_t         length)
+{
+    bench_stream_t *state = NULL;
+    bench_packet_t  packet;
+    rtp_header_t    rtp;
+
+    state = &(bench->streams[stream]);
+    memset(&rtp, 0, sizeof(rtp));
+    rtp.version = 2;
+    rtp.profile = BENCH_PAYLOAD_TYPE;
+    rtp.marker = marker;
+    rtp.sequence = htons(state->sequence++);
+    rtp.timestamp = htonl(state->timestamp);
+    rtp.ssrc = htonl(state->ssrc);
+
+    packet.stream = stream;
+    packet.arrival_us = send_us;
+    packet.position = 0;
+    packet.offset = bench->arena->len;
+    packet.length = sizeof(rtp) + headerlen + length;
+    g_byte_array_append(bench->arena, (const guint8 *)(&rtp), sizeof(rtp));
+    if (headerlen > 0)
+        g_byte_array_append(bench->arena, header, headerlen);
+    g_byte_array_append(bench->arena, payload, length);
+    g_array_append_val(bench->packets, packet);
+}
+
+/* NOTE: loss and duplication act on single packets, reordering swaps a
+ * packet with one up to reorder_depth later, and jitter delays each
+ * packet by up to jitter_us before everything is sorted by arrival.
+ * Swapped packets also swap positions, so they stay swapped when their
+ * arrival times are equal, as they all are without jitter */
+static void
+bench_impair(bench_t *bench)
+{
+    bench_config_t *config  = NULL;
+    bench_packet_t *packets = NULL;
+    bench_packet_t  packet;
+    GArray         *impaired = NULL;
+    size_t          idx      = 0;
+    size_t          other    = 0;
+
+    config = &(bench->config);
+    impaired = g_array_sized_new(FALSE, FALSE, sizeof(bench_packet_t),
+            bench->packets->len);
+    packets = (bench_packet_t *)(bench->packets->data);
+    for (idx = 0; idx < bench->packets->len; idx++)
+    {
+        if (g_rand_double(bench->rand) < config->loss)
+            continue;
+        packet = packets[idx];
+        if (config->jitter_us > 0)
+            packet.arrival_us += g_rand_int_range(bench->rand, 0,
+                    config->jitter_us + 1);
+        g_array_append_val(impaired, packet);
+        if (g_rand_double(bench->rand) < config->duplicate)
+            g_array_append_val(impaired, packet);
+    }
+
+    packets = (bench_packet_t *)(impaired->data);
+    for (idx = 0; config->reorder_depth > 0 && idx < impaired->len; idx++)
+    {
+        if (g_rand_double(bench->rand) >= config->reorder)
+            continue;
+        other = idx + 1 + g_rand_int_range(bench->rand, 0,
+                config->reorder_depth);
+        if (other >= impaired->len)
+            continue;
+        /* Swap the packets but not their arrival times */
+        packet = packets[idx];
+        packets[idx] = packets[other];
+        packets[other] = packet;
+        packets[other].arrival_us = packets[idx].arrival_us;
+        packets[idx].arrival_us = packet.arrival_us;
+    }
+    for (idx = 0; idx < impaired->len; idx++)
+        packets[idx].position = idx;
+
+    g_array_sort(impaired, bench_compare_arrival);
+    g_array_free(bench->packets, TRUE);
+    bench->packets = impaired;
+}
+
+static gint
+bench_compare_arrival(gconstpointer lval,
+                      gconstpointer rval)
+{
+    const bench_packet_t *lpacket = (const bench_packet_t *)(lval);
+    const bench_packet_t *rpacket = (const bench_packet_t *)(rval);
+
+    if (lpacket->arrival_us != rpacket->arrival_us)
+        return (lpacket->arrival_us < rpacket->arrival_us) ? -1 : 1;
+    if (lpacket->position != rpacket->position)
+        return (lpacket->position < rpacket->position) ? -1 : 1;
+
+    return 0;
+}
+
+static gint
+bench_compare_latency(gconstpointer lval,
+                      gconstpointer rval)
+{
+    gint64 llatency = *(const gint64 *)(lval);
+    gint64 rlatency = *(const gint64 *)(rval);
+
+    return (llatency > rlatency) - (llatency < rlatency);
+}
+
+/* NOTE: without --realtime packets are fed back to back, which measures
+ * raw throughput; with it each packet is held until its arrival time, so
+ * latencies include waiting for reordered and lost packets */
+static bool
+bench_run(bench_t *bench)
+{
+    bench_config_t      *config  = NULL;
+    rtp_depacketizer_t **streams = NULL;
+    bench_packet_t      *packet  = NULL;
+    media_t             *media   = NULL;
+    rtp_stats_t          stats;
+    rtp_stats_t          total;
+    gint64               start   = 0;
+    gint64               elapsed = 0;
+    size_t               frames  = 0;
+    size_t               idx     = 0;
+    bool                 ready   = false;
+    bool                 result  = false;
+
+    config = &(bench->config);
+    memset(&total, 0, sizeof(total));
+    streams = g_new0(rtp_depacketizer_t *, config->streams);
+    media = media_create(config->prefix);
+    if (!media)
+        goto RETURN;
+
+    for (idx = 0; idx < config->streams; idx++)
+    {
+        streams[idx] = rtp_depacketizer_create(config->codec,
+                config->timeout_us, config->reap_us);
+        if (!streams[idx])
+            goto RETURN;
+        if (config->incremental &&
+            !rtp_depacketizer_set_incremental(streams[idx], config->prefix))
+            goto RETURN;
+    }
+
+    start = bench_now_ns();
+    for (idx = 0; idx < bench->packets->len; idx++)
+    {
+        packet = &g_array_index(bench->packets, bench_packet_t, idx);
+        while (config->realtime &&
+               bench_now_ns() - start < packet->arrival_us * 1000);
+
+        rtp_depacketizer_add_buffer(streams[packet->stream],
+                config->codec == CODEC_OPUS,
+                bench->arena->data + packet->offset, packet->length, &ready);
+        frames += bench_drain(bench, streams[packet->stream], media, ready);
+    }
+
+    /* Frames still waiting on lost packets would otherwise never count */
+    for (idx = 0; idx < config->streams; idx++)
+    {
+        rtp_depacketizer_flush(streams[idx], &ready);
+        frames += bench_drain(bench, streams[idx], media, ready);
+    }
+    elapsed = bench_now_ns() - start;
+
+    for (idx = 0; idx < config->streams; idx++)
+    {
+        rtp_depacketizer_get_stats(streams[idx], &stats);
+        bench_add_stats(&total, &stats);
+    }
+    bench_report(bench, bench->packets->len, frames, elapsed, &total);
+    result = true;
+
+RETURN:
+
+    for (idx = 0; idx < config->streams; idx++)
+        if (streams[idx])
+            rtp_depacketizer_destroy(streams[idx]);
+    g_free(streams);
+    if (media)
+        media_destroy(media);
+
+    return result;
+}
+
+static size_t
+bench_drain(bench_t            *bench,
+            rtp_depacketizer_t *depacketizer,
+            media_t            *media,
+            bool                ready)
+{
+    gint64 latency = 0;
+    size_t frames  = 0;
+
+    g_return_val_if_fail(NULL != bench, 0);
+    g_return_val_if_fail(NULL != depacketizer, 0);
+    g_return_val_if_fail(NULL != media, 0);
+
+    while (ready)
+    {
+        media->length = media->capacity;
+        if (rtp_depacketizer_get_frame(depacketizer, media))
+        {
+            latency = g_get_monotonic_time() - media->created_us;
+            g_array_append_val(bench->latencies, latency);
+            ++frames;
+        }
+        else if (media->length > media->capacity &&
+                 !media_reserve(media, media->length))
+            break;
+        ready = depacketizer->completed->len > 0;
+    }
+
+    return frames;
+}
+
+static void
+bench_report(bench_t           *bench,
+             size_t             packets,
+             size_t             frames,
+             gint64             elapsed_ns,
+             const rtp_stats_t *stats)
+{
+    double seconds = 0;
+
+    seconds = MAX(elapsed_ns, 1) / 1e9;
+    g_array_sort(bench->latencies, bench_compare_latency);
+
+    printf("codec            %s\n",
+            (bench->config.codec == CODEC_OPUS) ? "opus" : "h264");
+    printf("streams          %zu\n", bench->config.streams);
+    printf("packets in       %zu (%" G_GUINT64_FORMAT " bytes)\n", packets,
+            stats->bytes);
+    printf("frames out       %zu\n", frames);
+    printf("elapsed          %.3f s\n", seconds);
+    printf("packets/s        %.0f\n", packets / seconds);
+    printf("frames/s         %.0f\n", frames / seconds);
+    printf("ns/packet        %.1f\n",
+            (double)(elapsed_ns) / MAX(packets, 1));
+    printf("latency us       p50 %" G_GINT64_FORMAT " p90 %" G_GINT64_FORMAT
+            " p99 %" G_GINT64_FORMAT " p99.9 %" G_GINT64_FORMAT
+            " max %" G_GINT64_FORMAT "\n",
+            bench_get_percentile(bench->latencies, 50),
+            bench_get_percentile(bench->latencies, 90),
+            bench_get_percentile(bench->latencies, 99),
+            bench_get_percentile(bench->latencies, 99.9),
+            bench_get_percentile(bench->latencies, 100));
+    printf("duplicates       %" G_GUINT64_FORMAT "\n", stats->duplicates);
+    printf("reordered        %" G_GUINT64_FORMAT " (max depth %"
+            G_GUINT64_FORMAT ")\n", stats->reordered, stats->max_reorder);
+    printf("lost             %" G_GINT64_FORMAT "\n", stats->lost);
+    printf("frames           %" G_GUINT64_FORMAT " completed, %"
+            G_GUINT64_FORMAT " reaped, %" G_GUINT64_FORMAT " timed out, %"
+            G_GUINT64_FORMAT " rejected\n", stats->frames_completed,
+            stats->frames_reaped, stats->frames_timed_out,
+            stats->frames_rejected);
+}
+
+static gint64
+bench_get_percentile(GArray *latencies,
+                     double  percentile)
+{
+    size_t idx = 0;
+
+    if (latencies->len == 0)
+        return 0;
+
+    idx = (size_t)((latencies->len - 1) * percentile / 100.0);
+
+    return g_array_index(latencies, gint64, idx);
+}
+
+static void
+bench_add_stats(rtp_stats_t       *total,
+                const rtp_stats_t *stats)
+{
+    total->packets += stats->packets;
+    total->bytes += stats->bytes;
+    total->duplicates += stats->duplicates;
+    total->reordered += stats->reordered;
+    total->max_reorder = MAX(total->max_reorder, stats->max_reorder);
+    total->lost += stats->lost;
+    total->frames_completed += stats->frames_completed;
+    total->frames_reaped += stats->frames_reaped;
+    total->frames_timed_out += stats->frames_timed_out;
+    total->frames_rejected += stats->frames_rejected;
+}
+
+static gint64
+bench_now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (gint64)(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+static void
+bench_usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --codec h264|opus       stream codec (h264)\n"
+            "  --prefix annexb|avcc|none  H.264 output prefix (annexb)\n"
+            "  --streams N             concurrent streams (1)\n"
+            "  --frames N              frames per stream (10000)\n"
+            "  --fps N                 H.264 frame rate (30)\n"
+            "  --mtu N                 max RTP payload size (1200)\n"
+            "  --frame-size N          mean P-frame size in bytes (4000)\n"
+            "  --idr-size N            mean IDR frame size in bytes (30000)\n"
+            "  --gop N                 frames between IDRs (60)\n"
+            "  --opus-size N           Opus packet size in bytes (120)\n"
+            "  --loss P                packet loss probability (0)\n"
+            "  --reorder P             packet reorder probability (0)\n"
+            "  --reorder-depth N       max reorder distance (4)\n"
+            "  --duplicate P           packet duplication probability (0)\n"
+            "  --jitter-us N           max arrival jitter (0)\n"
+            "  --timeout-us N          depacketizer drop timeout (1000000)\n"
+            "  --reap-us N             depacketizer reap timeout (100000)\n"
+            "  --seed N                random seed (1)\n"
+            "  --realtime              feed packets at their arrival times\n"
+            "  --incremental           compose frames as packets arrive\n",
+            name);
+}
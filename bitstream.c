@@ -0,0 +1,58 @@
+/*
+ * Author: Pu-Chen Mao
+ * Date:   2026/10/15
+ * File:   bitstream.c
+ * Desc:   MSB-first bitstream reader with Exp-Golomb decoding
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#include "bitstream.h"
+
+bool
+bitstream_init(bitstream_t   *reader,
+               const uint8_t *data,
+               size_t         length)
+{
+    g_return_val_if_fail(NULL != reader, false);
+    g_return_val_if_fail(NULL != data || 0 == length, false);
+
+    memset(reader, 0, sizeof(*reader));
+    reader->data = data;
+    reader->next = data;
+    reader->end = data + length;
+
+    return true;
+}
+
+/* NOTE: fewer than eight bytes are left, take them one at a time */
+void
+bitstream_fill_tail(bitstream_t *reader)
+{
+    g_return_if_fail(NULL != reader);
+
+    for (; reader->bits <= 56 && reader->next < reader->end; reader->bits += 8)
+        reader->cache |= (uint64_t)(*(reader->next)++) << (56 - reader->bits);
+}
+
+/* NOTE: in bits from the start, past the end if the reader overran */
+size_t
+bitstream_get_position(const bitstream_t *reader)
+{
+    g_return_val_if_fail(NULL != reader, 0);
+
+    return (size_t)(reader->next - reader->data) * 8 - reader->bits;
+}
+
+void
+bitstream_skip_bits(bitstream_t *reader,
+                    size_t       count)
+{
+    g_return_if_fail(NULL != reader);
+
+    for (; count > 32; count -= 32)
+        (void)(bitstream_get_bits(reader, 32));
+    if (count > 0)
+        (void)(bitstream_get_bits(reader, count));
+}
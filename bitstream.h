@@ -0,0 +1,133 @@
+/*
+ * Author: Pu-Chen Mao
+ * Date:   2026/10/15
+ * File:   bitstream.h
+ * Desc:   MSB-first bitstream reader with Exp-Golomb decoding
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /* Unread bits sit at the top of cache, bits of them are valid and
+     * everything below is zero. Reads past the end return zeroes and set
+     * error, as do Exp-Golomb codes too long for 32 bits, so decoders can
+     * read a whole header and check once at the end */
+    typedef struct bitstream_t
+    {
+        const uint8_t *data;
+        const uint8_t *next;
+        const uint8_t *end;
+        uint64_t       cache;
+        uint32_t       bits;
+        bool           error;
+
+    } bitstream_t;
+
+    bool bitstream_init(bitstream_t *reader, const uint8_t *data,
+            size_t length);
+    void bitstream_fill_tail(bitstream_t *reader);
+    size_t bitstream_get_position(const bitstream_t *reader);
+    void bitstream_skip_bits(bitstream_t *reader, size_t count);
+
+    /* NOTE: the readers below are in the header so that codec decoders
+     * inline them. A refill loads a whole word, keeping the bytes that
+     * fit and masking off the rest, so the cache holds at least 56 bits
+     * afterwards unless the data runs out */
+    static inline void
+    bitstream_refill(bitstream_t *reader)
+    {
+        uint64_t word  = 0;
+        uint32_t bytes = 0;
+
+        if (reader->end - reader->next < (ptrdiff_t)(sizeof(word)))
+        {
+            bitstream_fill_tail(reader);
+            return;
+        }
+
+        memcpy(&word, reader->next, sizeof(word));
+        bytes = (63 - reader->bits) >> 3;
+        reader->cache |= (GUINT64_FROM_BE(word) >> reader->bits) &
+            ~(G_MAXUINT64 >> (reader->bits + bytes * 8));
+        reader->bits += bytes * 8;
+        reader->next += bytes;
+    }
+
+    /* NOTE: count is 1 to 32 */
+    static inline uint32_t
+    bitstream_get_bits(bitstream_t *reader,
+                       uint32_t     count)
+    {
+        uint32_t value = 0;
+
+        if (reader->bits < count)
+            bitstream_refill(reader);
+        if (reader->bits < count)
+        {
+            reader->error = true;
+            reader->bits = count;
+        }
+
+        value = (uint32_t)(reader->cache >> (64 - count));
+        reader->cache <<= count;
+        reader->bits -= count;
+
+        return value;
+    }
+
+    static inline bool
+    bitstream_get_bit(bitstream_t *reader)
+    {
+        return bitstream_get_bits(reader, 1);
+    }
+
+    /* NOTE: ue(v), 2^zeroes - 1 + the zeroes bits after the marker one.
+     * Codes of up to 31 bits are taken in a single read */
+    static inline uint32_t
+    bitstream_get_ue(bitstream_t *reader)
+    {
+        uint32_t zeroes = 0;
+
+        if (reader->bits < 32)
+            bitstream_refill(reader);
+
+        zeroes = reader->cache ? __builtin_clzll(reader->cache) : 64;
+        if (zeroes > 31)
+        {
+            reader->error = true;
+            return 0;
+        }
+
+        if (zeroes < 16)
+            return bitstream_get_bits(reader, 2 * zeroes + 1) - 1;
+
+        bitstream_skip_bits(reader, zeroes);
+
+        return bitstream_get_bits(reader, zeroes + 1) - 1;
+    }
+
+    /* NOTE: se(v), ue(v) k maps to (-1)^(k+1) * ceil(k / 2) */
+    static inline int32_t
+    bitstream_get_se(bitstream_t *reader)
+    {
+        uint32_t code = 0;
+
+        code = bitstream_get_ue(reader);
+
+        return (code & 0x01) ? (int32_t)((code >> 1) + 1) :
+            -(int32_t)(code >> 1);
+    }
+
+#ifdef __cplusplus
+}
+#endif
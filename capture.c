@@ -0,0 +1,713 @@
+/*
+ * Author: Pu-Chen Mao
+ * Date:   2026/10/15
+ * File:   capture.c
+ * Desc:   pcap/pcapng RTP capture reader and replay
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "capture.h"
+
+#define PCAP_MAGIC_US         0xA1B2C3D4
+#define PCAP_MAGIC_NS         0xA1B23C4D
+#define PCAP_HEADER_SIZE      24
+#define PCAP_RECORD_SIZE      16
+#define PCAPNG_SHB            0x0A0D0D0A
+#define PCAPNG_IDB            0x00000001
+#define PCAPNG_PB             0x00000002
+#define PCAPNG_SPB            0x00000003
+#define PCAPNG_EPB            0x00000006
+#define PCAPNG_BYTE_ORDER     0x1A2B3C4D
+#define PCAPNG_OPT_TSRESOL    9
+
+#define LINKTYPE_NULL         0
+#define LINKTYPE_ETHERNET     1
+#define LINKTYPE_RAW          101
+#define LINKTYPE_LINUX_SLL    113
+#define LINKTYPE_IPV4         228
+#define LINKTYPE_IPV6         229
+#define LINKTYPE_LINUX_SLL2   276
+
+#define ETHERTYPE_IPV4        0x0800
+#define ETHERTYPE_IPV6        0x86DD
+#define ETHERTYPE_VLAN        0x8100
+#define ETHERTYPE_QINQ        0x88A8
+
+#define IPPROTO_UDP_NUMBER    17
+#define CAPTURE_REPLAY_BATCH  64
+
+static bool rtp_capture_open_pcapng(rtp_capture_t *capture);
+static bool rtp_capture_next_record(rtp_capture_t *capture,
+        const uint8_t **frame, size_t *length, guint32 *linktype,
+        gint64 *timestamp_us);
+static bool rtp_capture_next_block(rtp_capture_t *capture,
+        const uint8_t **frame, size_t *length, guint32 *linktype,
+        gint64 *timestamp_us);
+static bool rtp_capture_add_interface(rtp_capture_t *capture,
+        const uint8_t *body, size_t length);
+static bool rtp_capture_get_interface(rtp_capture_t *capture, guint32 index,
+        guint32 *linktype, guint64 *units);
+static bool rtp_capture_parse_link(const uint8_t *frame, size_t length,
+        guint32 linktype, const uint8_t **network, size_t *netlen,
+        uint16_t *ethertype);
+static bool rtp_capture_parse_udp(const uint8_t *network, size_t netlen,
+        uint16_t ethertype, const uint8_t **udp, size_t *udplen);
+static bool rtp_capture_match(const rtp_capture_t *capture,
+        const uint8_t *udp, size_t udplen);
+static inline guint32 rtp_capture_read32(const rtp_capture_t *capture,
+        const uint8_t *data);
+static inline uint16_t rtp_capture_read16(const rtp_capture_t *capture,
+        const uint8_t *data);
+static inline gint64 rtp_capture_to_us(guint64 ticks, guint64 units);
+
+rtp_capture_t *
+rtp_capture_open(const char *path)
+{
+    rtp_capture_t *capture = NULL;
+    GError        *error   = NULL;
+    guint32        magic   = 0;
+    bool           result  = false;
+
+    g_return_val_if_fail(NULL != path, NULL);
+
+    capture = g_try_new0(rtp_capture_t, 1);
+    if (!capture)
+        goto RETURN;
+
+    capture->file = g_mapped_file_new(path, FALSE, &error);
+    if (!capture->file)
+    {
+        fprintf(stderr, "Failed to map capture [%s]: %s\n", path,
+                error ? error->message : "unknown error");
+        goto RETURN;
+    }
+
+    capture->data = (const uint8_t *)(g_mapped_file_get_contents(
+                capture->file));
+    capture->length = g_mapped_file_get_length(capture->file);
+    capture->interfaces = g_array_new(FALSE, FALSE,
+            sizeof(rtp_capture_interface_t));
+    capture->filter.port = RTP_CAPTURE_ANY;
+    capture->filter.ssrc = RTP_CAPTURE_ANY;
+    capture->filter.payload_type = RTP_CAPTURE_ANY;
+    if (capture->length < PCAP_HEADER_SIZE)
+        goto RETURN;
+
+    memcpy(&magic, capture->data, sizeof(magic));
+    if (magic == PCAPNG_SHB)
+        result = rtp_capture_open_pcapng(capture);
+    else
+    {
+        rtp_capture_interface_t iface = {0};
+
+        capture->swapped = (magic == GUINT32_SWAP_LE_BE(PCAP_MAGIC_US) ||
+                magic == GUINT32_SWAP_LE_BE(PCAP_MAGIC_NS));
+        magic = rtp_capture_read32(capture, capture->data);
+        if (magic != PCAP_MAGIC_US && magic != PCAP_MAGIC_NS)
+            goto RETURN;
+
+        iface.linktype = rtp_capture_read32(capture, capture->data + 20) &
+            0x0FFFFFFF;
+        iface.units = (magic == PCAP_MAGIC_NS) ? 1000000000 : 1000000;
+        g_array_append_val(capture->interfaces, iface);
+        capture->offset = PCAP_HEADER_SIZE;
+        result = true;
+    }
+
+RETURN:
+
+    if (error)
+        g_error_free(error);
+    if (!result)
+    {
+        if (capture && capture->file)
+            fprintf(stderr, "Not a pcap or pcapng capture [%s]\n", path);
+        g_clear_pointer(&capture, rtp_capture_close);
+    }
+
+    return capture;
+}
+
+bool
+rtp_capture_set_filter(rtp_capture_t              *capture,
+                       const rtp_capture_filter_t *filter)
+{
+    g_return_val_if_fail(NULL != capture, false);
+    g_return_val_if_fail(NULL != filter, false);
+
+    capture->filter = *filter;
+
+    return true;
+}
+
+/* NOTE: *rtp points into the mapped file and stays valid until the capture
+ * is closed. Records that are not UDP carrying RTP version 2, are IP
+ * fragments, or do not pass the filter are skipped. false at the end */
+bool
+rtp_capture_next(rtp_capture_t  *capture,
+                 const uint8_t **rtp,
+                 size_t         *length,
+                 gint64         *timestamp_us)
+{
+    const uint8_t *frame     = NULL;
+    const uint8_t *network   = NULL;
+    const uint8_t *udp       = NULL;
+    size_t         framelen  = 0;
+    size_t         netlen    = 0;
+    size_t         udplen    = 0;
+    guint32        linktype  = 0;
+    uint16_t       ethertype = 0;
+
+    g_return_val_if_fail(NULL != capture, false);
+    g_return_val_if_fail(NULL != rtp, false);
+    g_return_val_if_fail(NULL != length, false);
+    g_return_val_if_fail(NULL != timestamp_us, false);
+
+    for (;;)
+    {
+        if (capture->pcapng)
+        {
+            if (!rtp_capture_next_block(capture, &frame, &framelen,
+                        &linktype, timestamp_us))
+                return false;
+        }
+        else if (!rtp_capture_next_record(capture, &frame, &framelen,
+                    &linktype, timestamp_us))
+            return false;
+
+        ++(capture->records);
+        if (!rtp_capture_parse_link(frame, framelen, linktype, &network,
+                    &netlen, &ethertype) ||
+            !rtp_capture_parse_udp(network, netlen, ethertype, &udp,
+                    &udplen) ||
+            !rtp_capture_match(capture, udp, udplen))
+            continue;
+
+        ++(capture->matched);
+        capture->timestamp_us = *timestamp_us;
+        *rtp = udp + 8;
+        *length = udplen - 8;
+
+        return true;
+    }
+}
+
+bool
+rtp_capture_rewind(rtp_capture_t *capture)
+{
+    g_return_val_if_fail(NULL != capture, false);
+
+    capture->records = capture->matched = 0;
+    capture->timestamp_us = 0;
+    if (!capture->pcapng)
+    {
+        capture->offset = PCAP_HEADER_SIZE;
+        return true;
+    }
+
+    capture->offset = 0;
+    g_array_set_size(capture->interfaces, 0);
+
+    return rtp_capture_open_pcapng(capture);
+}
+
+/* NOTE: an rtp_clock_t running on capture time, for depacketizers to reap
+ * frames as they would have live however fast the capture is replayed.
+ * Unpaced, a batch is handed over at the time of its last packet */
+gint64
+rtp_capture_clock(gpointer data)
+{
+    g_return_val_if_fail(NULL != data, 0);
+
+    return ((const rtp_capture_t *)(data))->timestamp_us;
+}
+
+/* NOTE: consecutive packets go to the demuxer in batches, unless paced, in
+ * which case each is held until its capture time relative to the first */
+bool
+rtp_capture_replay(rtp_capture_t       *capture,
+                   rtp_demuxer_t       *demuxer,
+                   bool                 paced,
+                   rtp_demuxer_ready_t  ready,
+                   gpointer             userdata)
+{
+    struct iovec   buffers[CAPTURE_REPLAY_BATCH];
+    const uint8_t *rtp       = NULL;
+    size_t         length    = 0;
+    size_t         count     = 0;
+    gint64         timestamp = 0;
+    gint64         first     = 0;
+    gint64         start     = 0;
+    gint64         delay     = 0;
+    bool           result    = true;
+
+    g_return_val_if_fail(NULL != capture, false);
+    g_return_val_if_fail(NULL != demuxer, false);
+
+    start = g_get_monotonic_time();
+    while (rtp_capture_next(capture, &rtp, &length, &timestamp))
+    {
+        if (capture->matched == 1)
+            first = timestamp;
+
+        if (paced)
+        {
+            delay = (timestamp - first) - (g_get_monotonic_time() - start);
+            if (delay > 0)
+                g_usleep(delay);
+        }
+
+        buffers[count].iov_base = (void *)(rtp);
+        buffers[count].iov_len = length;
+        if (++count < (paced ? 1 : CAPTURE_REPLAY_BATCH))
+            continue;
+
+        if (!rtp_demuxer_add_buffers(demuxer, buffers, count, ready,
+                    userdata))
+            result = false;
+        count = 0;
+    }
+
+    if (count > 0 && !rtp_demuxer_add_buffers(demuxer, buffers, count,
+                ready, userdata))
+        result = false;
+
+    return result;
+}
+
+void
+rtp_capture_close(gpointer data)
+{
+    rtp_capture_t *capture = NULL;
+
+    g_return_if_fail(NULL != data);
+
+    capture = (rtp_capture_t *)(data);
+    if (capture->interfaces)
+        g_array_free(capture->interfaces, TRUE);
+    g_clear_pointer(&(capture->file), g_mapped_file_unref);
+    g_clear_pointer(&capture, g_free);
+}
+
+/* NOTE: reads the section header block at the current offset */
+static bool
+rtp_capture_open_pcapng(rtp_capture_t *capture)
+{
+    guint32 magic  = 0;
+    guint32 length = 0;
+
+    g_return_val_if_fail(NULL != capture, false);
+
+    if (capture->offset + 28 > capture->length)
+        return false;
+
+    memcpy(&magic, capture->data + capture->offset + 8, sizeof(magic));
+    if (magic != PCAPNG_BYTE_ORDER &&
+        magic != GUINT32_SWAP_LE_BE(PCAPNG_BYTE_ORDER))
+        return false;
+
+    capture->pcapng = true;
+    capture->swapped = (magic != PCAPNG_BYTE_ORDER);
+    length = rtp_capture_read32(capture, capture->data + capture->offset + 4);
+    if (length < 28 || length % 4 != 0 ||
+        capture->offset + length > capture->length)
+        return false;
+
+    g_array_set_size(capture->interfaces, 0);
+    capture->offset += length;
+
+    return true;
+}
+
+static bool
+rtp_capture_next_record(rtp_capture_t  *capture,
+                        const uint8_t **frame,
+                        size_t         *length,
+                        guint32        *linktype,
+                        gint64         *timestamp_us)
+{
+    const uint8_t *record  = NULL;
+    guint32        caplen  = 0;
+    guint64        seconds = 0;
+    guint64        ticks   = 0;
+    guint64        units   = 0;
+
+    if (capture->offset + PCAP_RECORD_SIZE > capture->length)
+        return false;
+
+    record = capture->data + capture->offset;
+    caplen = rtp_capture_read32(capture, record + 8);
+    if (caplen > capture->length - capture->offset - PCAP_RECORD_SIZE)
+        return false;
+
+    rtp_capture_get_interface(capture, 0, linktype, &units);
+    seconds = rtp_capture_read32(capture, record);
+    ticks = rtp_capture_read32(capture, record + 4);
+    *timestamp_us = (gint64)(seconds) * 1000000 +
+        rtp_capture_to_us(ticks, units);
+    *frame = record + PCAP_RECORD_SIZE;
+    *length = caplen;
+    capture->offset += PCAP_RECORD_SIZE + caplen;
+
+    return true;
+}
+
+/* NOTE: walks blocks until one carries a packet; interface blocks are
+ * recorded on the way and a new section resets them */
+static bool
+rtp_capture_next_block(rtp_capture_t  *capture,
+                       const uint8_t **frame,
+                       size_t         *length,
+                       guint32        *linktype,
+                       gint64         *timestamp_us)
+{
+    const uint8_t *block   = NULL;
+    guint32        type    = 0;
+    guint32        size    = 0;
+    guint32        caplen  = 0;
+    guint32        iface   = 0;
+    guint64        ticks   = 0;
+    guint64        units   = 0;
+
+    while (capture->offset + 12 <= capture->length)
+    {
+        block = capture->data + capture->offset;
+        memcpy(&type, block, sizeof(type));
+        if (type == PCAPNG_SHB)
+        {
+            if (!rtp_capture_open_pcapng(capture))
+                return false;
+            continue;
+        }
+
+        type = rtp_capture_read32(capture, block);
+        size = rtp_capture_read32(capture, block + 4);
+        if (size < 12 || size % 4 != 0 ||
+            size > capture->length - capture->offset)
+            return false;
+        capture->offset += size;
+
+        switch (type)
+        {
+            case PCAPNG_IDB:
+                if (!rtp_capture_add_interface(capture, block + 8, size - 12))
+                    return false;
+                continue;
+            case PCAPNG_EPB:
+                if (size < 32)
+                    return false;
+                iface = rtp_capture_read32(capture, block + 8);
+                ticks = ((guint64)(rtp_capture_read32(capture, block + 12))
+                        << 32) | rtp_capture_read32(capture, block + 16);
+                caplen = rtp_capture_read32(capture, block + 20);
+                if (caplen > size - 32)
+                    return false;
+                *frame = block + 28;
+                break;
+            case PCAPNG_PB:
+                if (size < 32)
+                    return false;
+                iface = rtp_capture_read16(capture, block + 8);
+                ticks = ((guint64)(rtp_capture_read32(capture, block + 12))
+                        << 32) | rtp_capture_read32(capture, block + 16);
+                caplen = rtp_capture_read32(capture, block + 20);
+                if (caplen > size - 32)
+                    return false;
+                *frame = block + 28;
+                break;
+            case PCAPNG_SPB:
+                if (size < 16)
+                    return false;
+                iface = 0;
+                ticks = 0;
+                caplen = MIN(rtp_capture_read32(capture, block + 8),
+                        size - 16);
+                *frame = block + 12;
+                break;
+            default:
+                continue;
+        }
+
+        if (!rtp_capture_get_interface(capture, iface, linktype, &units))
+            continue;
+
+        *length = caplen;
+        *timestamp_us = rtp_capture_to_us(ticks, units);
+
+        return true;
+    }
+
+    return false;
+}
+
+/* NOTE: if_tsresol gives 10^-n seconds, or 2^-n with the top bit set;
+ * microseconds when absent */
+static bool
+rtp_capture_add_interface(rtp_capture_t *capture,
+                          const uint8_t *body,
+                          size_t         length)
+{
+    rtp_capture_interface_t iface  = {0};
+    uint16_t                code   = 0;
+    uint16_t                optlen = 0;
+    uint8_t                 resol  = 0;
+    size_t                  offset = 0;
+
+    if (length < 8)
+        return false;
+
+    iface.linktype = rtp_capture_read16(capture, body);
+    iface.units = 1000000;
+    for (offset = 8; offset + 4 <= length; offset += 4 + ((optlen + 3) & ~3))
+    {
+        code = rtp_capture_read16(capture, body + offset);
+        optlen = rtp_capture_read16(capture, body + offset + 2);
+        if (code == 0 || offset + 4 + optlen > length)
+            break;
+        if (code != PCAPNG_OPT_TSRESOL || optlen < 1)
+            continue;
+
+        resol = body[offset + 4];
+        if (resol & 0x80)
+            iface.units = (resol & 0x7F) < 64 ?
+                (guint64)(1) << (resol & 0x7F) : 1000000;
+        else
+            for (iface.units = 1; resol > 0 && iface.units <=
+                 G_MAXUINT64 / 10; resol--)
+                iface.units *= 10;
+    }
+
+    g_array_append_val(capture->interfaces, iface);
+
+    return true;
+}
+
+static bool
+rtp_capture_get_interface(rtp_capture_t *capture,
+                          guint32        index,
+                          guint32       *linktype,
+                          guint64       *units)
+{
+    rtp_capture_interface_t *iface = NULL;
+
+    if (index >= capture->interfaces->len)
+        return false;
+
+    iface = &g_array_index(capture->interfaces, rtp_capture_interface_t,
+            index);
+    *linktype = iface->linktype;
+    *units = iface->units;
+
+    return true;
+}
+
+static bool
+rtp_capture_parse_link(const uint8_t  *frame,
+                       size_t          length,
+                       guint32         linktype,
+                       const uint8_t **network,
+                       size_t         *netlen,
+                       uint16_t       *ethertype)
+{
+    size_t  offset = 0;
+    guint32 family = 0;
+
+    switch (linktype)
+    {
+        case LINKTYPE_ETHERNET:
+            if (length < 14)
+                return false;
+            *ethertype = (frame[12] << 8) | frame[13];
+            for (offset = 14; (*ethertype == ETHERTYPE_VLAN ||
+                 *ethertype == ETHERTYPE_QINQ) && offset + 4 <= length;
+                 offset += 4)
+                *ethertype = (frame[offset + 2] << 8) | frame[offset + 3];
+            break;
+        case LINKTYPE_LINUX_SLL:
+            if (length < 16)
+                return false;
+            *ethertype = (frame[14] << 8) | frame[15];
+            offset = 16;
+            break;
+        case LINKTYPE_LINUX_SLL2:
+            if (length < 20)
+                return false;
+            *ethertype = (frame[0] << 8) | frame[1];
+            offset = 20;
+            break;
+        case LINKTYPE_NULL:
+            /* The address family is in the capturing host's byte order */
+            if (length < 4)
+                return false;
+            memcpy(&family, frame, sizeof(family));
+            if (family > 0xFFFF)
+                family = GUINT32_SWAP_LE_BE(family);
+            *ethertype = (family == 2) ? ETHERTYPE_IPV4 : ETHERTYPE_IPV6;
+            offset = 4;
+            break;
+        case LINKTYPE_RAW:
+        case LINKTYPE_IPV4:
+        case LINKTYPE_IPV6:
+            if (length < 1)
+                return false;
+            *ethertype = ((frame[0] >> 4) == 6) ? ETHERTYPE_IPV6 :
+                ETHERTYPE_IPV4;
+            break;
+        default:
+            return false;
+    }
+
+    if (offset > length)
+        return false;
+
+    *network = frame + offset;
+    *netlen = length - offset;
+
+    return true;
+}
+
+static bool
+rtp_capture_parse_udp(const uint8_t  *network,
+                      size_t          netlen,
+                      uint16_t        ethertype,
+                      const uint8_t **udp,
+                      size_t         *udplen)
+{
+    size_t  offset  = 0;
+    size_t  total   = 0;
+    size_t  length  = 0;
+    uint8_t next    = 0;
+
+    if (ethertype == ETHERTYPE_IPV4)
+    {
+        if (netlen < 20 || (network[0] >> 4) != 4)
+            return false;
+        offset = (network[0] & 0x0F) * 4;
+        total = (network[2] << 8) | network[3];
+        /* Fragments (MF set or a non-zero offset) cannot be reassembled */
+        if (offset < 20 || total < offset || total > netlen ||
+            network[9] != IPPROTO_UDP_NUMBER ||
+            (((network[6] << 8) | network[7]) & 0x3FFF))
+            return false;
+    }
+    else if (ethertype == ETHERTYPE_IPV6)
+    {
+        if (netlen < 40 || (network[0] >> 4) != 6)
+            return false;
+        total = 40 + ((network[4] << 8) | network[5]);
+        if (total > netlen)
+            return false;
+        /* Hop-by-hop, routing and destination options may precede UDP */
+        for (next = network[6], offset = 40; next == 0 || next == 43 ||
+             next == 60; next = network[offset], offset += length)
+        {
+            if (offset + 8 > total)
+                return false;
+            length = (network[offset + 1] + 1) * 8;
+        }
+        if (next != IPPROTO_UDP_NUMBER)
+            return false;
+    }
+    else
+        return false;
+
+    if (offset + 8 > total)
+        return false;
+
+    length = (network[offset + 4] << 8) | network[offset + 5];
+    if (length < 8 || offset + length > total)
+        return false;
+
+    *udp = network + offset;
+    *udplen = length;
+
+    return true;
+}
+
+/* NOTE: RTCP shares RTP's version bits, its packet types 200-204 land on
+ * payload types 72-76 and are skipped (RFC 5761) */
+static bool
+rtp_capture_match(const rtp_capture_t *capture,
+                  const uint8_t       *udp,
+                  size_t               udplen)
+{
+    const rtp_capture_filter_t *filter       = NULL;
+    const uint8_t              *rtp          = NULL;
+    uint16_t                    source       = 0;
+    uint16_t                    destination  = 0;
+    uint32_t                    ssrc         = 0;
+    uint8_t                     payload_type = 0;
+
+    filter = &(capture->filter);
+    if (udplen < 8 + sizeof(rtp_header_t))
+        return false;
+
+    source = (udp[0] << 8) | udp[1];
+    destination = (udp[2] << 8) | udp[3];
+    if (filter->port != RTP_CAPTURE_ANY && filter->port != source &&
+        filter->port != destination)
+        return false;
+
+    rtp = udp + 8;
+    if ((rtp[0] >> 6) != 2)
+        return false;
+
+    payload_type = rtp[1] & 0x7F;
+    if (payload_type >= 72 && payload_type <= 76)
+        return false;
+    if (filter->payload_type != RTP_CAPTURE_ANY &&
+        filter->payload_type != payload_type)
+        return false;
+
+    ssrc = ((uint32_t)(rtp[8]) << 24) | (rtp[9] << 16) | (rtp[10] << 8) |
+        rtp[11];
+    if (filter->ssrc != RTP_CAPTURE_ANY && filter->ssrc != ssrc)
+        return false;
+
+    return true;
+}
+
+static inline guint32
+rtp_capture_read32(const rtp_capture_t *capture,
+                   const uint8_t       *data)
+{
+    guint32 value = 0;
+
+    memcpy(&value, data, sizeof(value));
+
+    return capture->swapped ? GUINT32_SWAP_LE_BE(value) : value;
+}
+
+static inline uint16_t
+rtp_capture_read16(const rtp_capture_t *capture,
+                   const uint8_t       *data)
+{
+    uint16_t value = 0;
+
+    memcpy(&value, data, sizeof(value));
+
+    return capture->swapped ? GUINT16_SWAP_LE_BE(value) : value;
+}
+
+/* NOTE: split so that ticks * 10^6 cannot overflow. Past 2^64 / 10^6 units
+ * per second even the remainder times 10^6 would, it is then divided down
+ * by the units per microsecond instead, which is off by less than one */
+static inline gint64
+rtp_capture_to_us(guint64 ticks,
+                  guint64 units)
+{
+    guint64 remainder = 0;
+
+    if (units == 0)
+        return 0;
+
+    if (units <= G_MAXUINT64 / 1000000)
+        remainder = (ticks % units) * 1000000 / units;
+    else
+        remainder = MIN((ticks % units) / (units / 1000000), 999999);
+
+    return (gint64)((ticks / units) * 1000000 + remainder);
+}
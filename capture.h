@@ -0,0 +1,74 @@
+/*
+ * Author: Pu-Chen Mao
+ * Date:   2026/10/15
+ * File:   capture.h
+ * Desc:   pcap/pcapng RTP capture reader and replay
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "demuxer.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    #define RTP_CAPTURE_ANY (-1)
+
+    /* Each field is RTP_CAPTURE_ANY or the value to keep, port matches
+     * either UDP port */
+    typedef struct rtp_capture_filter_t
+    {
+        gint32 port;
+        gint64 ssrc;
+        gint32 payload_type;
+
+    } rtp_capture_filter_t;
+
+    typedef struct rtp_capture_interface_t
+    {
+        guint32 linktype;
+        guint64 units;
+
+    } rtp_capture_interface_t;
+
+    /* The file is mapped read-only and packets are handed out in place.
+     * Classic pcap has a single interface, pcapng one per IDB in the
+     * current section; units is the timestamp resolution in ticks/s.
+     * timestamp_us is the capture time of the last RTP packet handed out */
+    typedef struct rtp_capture_t
+    {
+        GMappedFile          *file;
+        const uint8_t        *data;
+        size_t                length;
+        size_t                offset;
+        bool                  pcapng;
+        bool                  swapped;
+        GArray               *interfaces;
+        rtp_capture_filter_t  filter;
+        guint64               records;
+        guint64               matched;
+        gint64                timestamp_us;
+
+    } rtp_capture_t;
+
+    rtp_capture_t *rtp_capture_open(const char *path);
+    bool rtp_capture_set_filter(rtp_capture_t *capture,
+            const rtp_capture_filter_t *filter);
+    bool rtp_capture_next(rtp_capture_t *capture, const uint8_t **rtp,
+            size_t *length, gint64 *timestamp_us);
+    bool rtp_capture_rewind(rtp_capture_t *capture);
+    gint64 rtp_capture_clock(gpointer data);
+    bool rtp_capture_replay(rtp_capture_t *capture, rtp_demuxer_t *demuxer,
+            bool paced, rtp_demuxer_ready_t ready, gpointer userdata);
+    void rtp_capture_close(gpointer data);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,533 @@
+/*
+ * Author: Pu-Chen Mao
+ * Date:   2026/10/15
+ * File:   demuxer.c
+ * Desc:   SSRC demultiplexer over RTP depacketizers
+ */
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "demuxer.h"
+
+static rtp_stream_t *rtp_demuxer_open(rtp_demuxer_t *demuxer,
+        const rtp_header_t *header);
+static bool rtp_demuxer_find(const rtp_demuxer_t *demuxer, uint32_t ssrc,
+        size_t *slot);
+static bool rtp_demuxer_grow(rtp_demuxer_t *demuxer);
+static void rtp_demuxer_erase(rtp_demuxer_t *demuxer, size_t slot);
+static void rtp_demuxer_expire(rtp_demuxer_t *demuxer, gint64 now_us);
+static inline size_t rtp_demuxer_hash(const rtp_demuxer_t *demuxer,
+        uint32_t ssrc);
+
+rtp_demuxer_t *
+rtp_demuxer_create(codec_t codec,
+                   gint64  timeout_us,
+                   gint64  reap_us,
+                   gint64  idle_us)
+{
+    rtp_demuxer_t *demuxer = NULL;
+    bool           result  = false;
+
+    demuxer = g_try_new0(rtp_demuxer_t, 1);
+    if (!demuxer)
+        goto RETURN;
+
+    demuxer->streams = g_try_new0(rtp_stream_t, RTP_DEMUXER_MIN_CAPACITY);
+    if (!demuxer->streams)
+        goto RETURN;
+
+    demuxer->capacity = RTP_DEMUXER_MIN_CAPACITY;
+    demuxer->codec = codec;
+    demuxer->timeout_us = timeout_us;
+    demuxer->reap_us = reap_us;
+    demuxer->idle_us = idle_us;
+    demuxer->expire_us = g_get_monotonic_time();
+    result = true;
+
+RETURN:
+
+    if (!result)
+        g_clear_pointer(&demuxer, rtp_demuxer_destroy);
+
+    return demuxer;
+}
+
+/* NOTE: streams, those open and those to come, keep time with clock, see
+ * rtp_depacketizer_set_clock(); so does stream expiry */
+bool
+rtp_demuxer_set_clock(rtp_demuxer_t *demuxer,
+                      rtp_clock_t    clock,
+                      gpointer       userdata)
+{
+    size_t idx = 0;
+
+    g_return_val_if_fail(NULL != demuxer, false);
+
+    demuxer->clock = clock;
+    demuxer->clock_data = userdata;
+    demuxer->expire_us = clock ? clock(userdata) : g_get_monotonic_time();
+    for (idx = 0; idx < demuxer->capacity; idx++)
+        if (demuxer->streams[idx].depacketizer)
+            rtp_depacketizer_set_clock(demuxer->streams[idx].depacketizer,
+                    clock, userdata);
+
+    return true;
+}
+
+/* NOTE: payload types without a mapping use the demuxer's default codec,
+ * mapping one to CODEC_NONE clears its mapping. Packets are only dropped
+ * when their payload type resolves to CODEC_NONE, i.e. the default codec
+ * is CODEC_NONE and the payload type is not mapped */
+bool
+rtp_demuxer_map_payload_type(rtp_demuxer_t *demuxer,
+                             uint8_t        payload_type,
+                             codec_t        codec)
+{
+    g_return_val_if_fail(NULL != demuxer, false);
+    g_return_val_if_fail(RTP_PAYLOAD_TYPE_COUNT > payload_type, false);
+
+    demuxer->codecs[payload_type] = codec;
+
+    return true;
+}
+
+/* NOTE: *depacketizer belongs to the demuxer and stays valid until the
+ * stream is removed or expires on a later call */
+bool
+rtp_demuxer_add_buffer(rtp_demuxer_t       *demuxer,
+                       uint8_t             *buffer,
+                       size_t               length,
+                       uint32_t            *ssrc,
+                       rtp_depacketizer_t **depacketizer,
+                       bool                *frame_ready)
+{
+    rtp_stream_t *stream = NULL;
+    bool          result = false;
+
+    g_return_val_if_fail(NULL != demuxer, false);
+    g_return_val_if_fail(NULL != buffer, false);
+    g_return_val_if_fail(NULL != ssrc, false);
+    g_return_val_if_fail(NULL != depacketizer, false);
+    g_return_val_if_fail(NULL != frame_ready, false);
+
+    *frame_ready = false;
+    if (length < sizeof(rtp_header_t))
+        return false;
+
+    stream = rtp_demuxer_open(demuxer, (const rtp_header_t *)(buffer));
+    if (!stream)
+        return false;
+
+    *ssrc = stream->ssrc;
+    *depacketizer = stream->depacketizer;
+    result = rtp_depacketizer_add_buffer(stream->depacketizer,
+            stream->depacketizer->codec == CODEC_OPUS, buffer, length,
+            frame_ready);
+    stream->active_us = stream->depacketizer->enqueue_us;
+    if (stream->active_us - demuxer->expire_us > demuxer->idle_us)
+        rtp_demuxer_expire(demuxer, stream->active_us);
+
+    return result;
+}
+
+/* NOTE: each run of consecutive buffers from one SSRC goes through
+ * rtp_depacketizer_add_buffers() at once, ready is called after every run
+ * that leaves its stream with completed frames */
+bool
+rtp_demuxer_add_buffers(rtp_demuxer_t       *demuxer,
+                        const struct iovec  *buffers,
+                        size_t               count,
+                        rtp_demuxer_ready_t  ready,
+                        gpointer             userdata)
+{
+    const rtp_header_t *header      = NULL;
+    rtp_stream_t       *stream      = NULL;
+    size_t              head        = 0;
+    size_t              tail        = 0;
+    gint64              now_us      = 0;
+    bool                frame_ready = false;
+    bool                result      = true;
+
+    g_return_val_if_fail(NULL != demuxer, false);
+    g_return_val_if_fail(NULL != buffers, false);
+
+    for (head = 0; head < count; head = tail)
+    {
+        header = (const rtp_header_t *)(buffers[head].iov_base);
+        if (!header || buffers[head].iov_len < sizeof(rtp_header_t))
+        {
+            result = false;
+            tail = head + 1;
+            continue;
+        }
+
+        for (tail = head + 1; tail < count; tail++)
+            if (!buffers[tail].iov_base ||
+                buffers[tail].iov_len < sizeof(rtp_header_t) ||
+                ((const rtp_header_t *)(buffers[tail].iov_base))->ssrc !=
+                header->ssrc)
+                break;
+
+        stream = rtp_demuxer_open(demuxer, header);
+        if (!stream)
+        {
+            result = false;
+            continue;
+        }
+
+        if (!rtp_depacketizer_add_buffers(stream->depacketizer,
+                    stream->depacketizer->codec == CODEC_OPUS,
+                    buffers + head, tail - head, &frame_ready))
+            result = false;
+        stream->active_us = stream->depacketizer->enqueue_us;
+        now_us = stream->active_us;
+        if (frame_ready && ready)
+            ready(stream->ssrc, stream->depacketizer, userdata);
+    }
+
+    if (now_us - demuxer->expire_us > demuxer->idle_us)
+        rtp_demuxer_expire(demuxer, now_us);
+
+    return result;
+}
+
+/* NOTE: packet ownership is transferred to the demuxer, on error the
+ * packet is freed. ready is called if the packet leaves its stream with
+ * completed frames */
+bool
+rtp_demuxer_add_packet(rtp_demuxer_t       *demuxer,
+                       packet_t            *packet,
+                       rtp_demuxer_ready_t  ready,
+                       gpointer             userdata)
+{
+    rtp_stream_t *stream      = NULL;
+    bool          frame_ready = false;
+    bool          result      = false;
+
+    g_return_val_if_fail(NULL != demuxer, false);
+    g_return_val_if_fail(NULL != packet, false);
+
+    if (!packet->payload)
+        goto RETURN;
+
+    stream = rtp_demuxer_open(demuxer, &(packet->rtp->header));
+    if (!stream)
+        goto RETURN;
+
+    packet->is_audio = (stream->depacketizer->codec == CODEC_OPUS);
+    result = rtp_depacketizer_add_packet(stream->depacketizer,
+            g_steal_pointer(&packet), &frame_ready);
+    stream->active_us = stream->depacketizer->enqueue_us;
+    if (frame_ready && ready)
+        ready(stream->ssrc, stream->depacketizer, userdata);
+    if (stream->active_us - demuxer->expire_us > demuxer->idle_us)
+        rtp_demuxer_expire(demuxer, stream->active_us);
+
+RETURN:
+
+    g_clear_pointer(&packet, packet_destroy);
+
+    return result;
+}
+
+/* NOTE: flushes every stream, see rtp_depacketizer_flush(), ready is
+ * called for each one left with completed frames */
+bool
+rtp_demuxer_flush(rtp_demuxer_t       *demuxer,
+                  rtp_demuxer_ready_t  ready,
+                  gpointer             userdata)
+{
+    rtp_stream_t *stream      = NULL;
+    size_t        idx         = 0;
+    bool          frame_ready = false;
+    bool          result      = true;
+
+    g_return_val_if_fail(NULL != demuxer, false);
+
+    for (idx = 0; idx < demuxer->capacity; idx++)
+    {
+        stream = &(demuxer->streams[idx]);
+        if (!stream->depacketizer)
+            continue;
+
+        if (!rtp_depacketizer_flush(stream->depacketizer, &frame_ready))
+            result = false;
+        if (frame_ready && ready)
+            ready(stream->ssrc, stream->depacketizer, userdata);
+    }
+
+    return result;
+}
+
+/* NOTE: removes a stream without destroying its depacketizer, which is
+ * handed to the caller, e.g. to move it to another demuxer */
+rtp_depacketizer_t *
+rtp_demuxer_steal(rtp_demuxer_t *demuxer,
+                  uint32_t       ssrc)
+{
+    rtp_depacketizer_t *depacketizer = NULL;
+    size_t              slot         = 0;
+
+    g_return_val_if_fail(NULL != demuxer, NULL);
+
+    if (!rtp_demuxer_find(demuxer, ssrc, &slot))
+        return NULL;
+
+    depacketizer = g_steal_pointer(&(demuxer->streams[slot].depacketizer));
+    rtp_demuxer_erase(demuxer, slot);
+
+    return depacketizer;
+}
+
+/* NOTE: takes over a depacketizer for ssrc, false if the SSRC already has
+ * a stream here, in which case the caller keeps it */
+bool
+rtp_demuxer_adopt(rtp_demuxer_t      *demuxer,
+                  uint32_t            ssrc,
+                  rtp_depacketizer_t *depacketizer)
+{
+    size_t slot = 0;
+
+    g_return_val_if_fail(NULL != demuxer, false);
+    g_return_val_if_fail(NULL != depacketizer, false);
+
+    if (rtp_demuxer_find(demuxer, ssrc, &slot))
+        return false;
+
+    if (2 * (demuxer->count + 1) > demuxer->capacity)
+    {
+        if (!rtp_demuxer_grow(demuxer))
+            return false;
+        rtp_demuxer_find(demuxer, ssrc, &slot);
+    }
+
+    rtp_depacketizer_set_clock(depacketizer, demuxer->clock,
+            demuxer->clock_data);
+    demuxer->streams[slot].ssrc = ssrc;
+    demuxer->streams[slot].depacketizer = depacketizer;
+    demuxer->streams[slot].active_us = demuxer->clock ?
+        demuxer->clock(demuxer->clock_data) : g_get_monotonic_time();
+    ++(demuxer->count);
+
+    return true;
+}
+
+rtp_depacketizer_t *
+rtp_demuxer_lookup(rtp_demuxer_t *demuxer,
+                   uint32_t       ssrc)
+{
+    size_t slot = 0;
+
+    g_return_val_if_fail(NULL != demuxer, NULL);
+
+    if (!rtp_demuxer_find(demuxer, ssrc, &slot))
+        return NULL;
+
+    return demuxer->streams[slot].depacketizer;
+}
+
+bool
+rtp_demuxer_remove(rtp_demuxer_t *demuxer,
+                   uint32_t       ssrc)
+{
+    size_t slot = 0;
+
+    g_return_val_if_fail(NULL != demuxer, false);
+
+    if (!rtp_demuxer_find(demuxer, ssrc, &slot))
+        return false;
+
+    rtp_demuxer_erase(demuxer, slot);
+
+    return true;
+}
+
+void
+rtp_demuxer_destroy(gpointer data)
+{
+    rtp_demuxer_t *demuxer = NULL;
+    size_t         slot    = 0;
+
+    g_return_if_fail(NULL != data);
+
+    demuxer = (rtp_demuxer_t *)(data);
+    for (slot = 0; demuxer->streams && slot < demuxer->capacity; slot++)
+        g_clear_pointer(&(demuxer->streams[slot].depacketizer),
+                rtp_depacketizer_destroy);
+    g_clear_pointer(&(demuxer->streams), g_free);
+    g_clear_pointer(&demuxer, g_free);
+}
+
+static rtp_stream_t *
+rtp_demuxer_open(rtp_demuxer_t      *demuxer,
+                 const rtp_header_t *header)
+{
+    rtp_stream_t *stream = NULL;
+    codec_t       codec  = CODEC_NONE;
+    uint32_t      ssrc   = 0;
+    size_t        slot   = 0;
+
+    g_return_val_if_fail(NULL != demuxer, NULL);
+    g_return_val_if_fail(NULL != header, NULL);
+
+    /* Don't let garbage open streams, packets are validated later */
+    if (header->version != 2)
+        return NULL;
+
+    ssrc = ntohl(header->ssrc);
+    if (rtp_demuxer_find(demuxer, ssrc, &slot))
+        return &(demuxer->streams[slot]);
+
+    codec = demuxer->codecs[header->profile];
+    if (codec == CODEC_NONE)
+        codec = demuxer->codec;
+    if (codec == CODEC_NONE)
+        return NULL;
+
+    /* Keep the load factor at or below one half */
+    if (2 * (demuxer->count + 1) > demuxer->capacity)
+    {
+        if (!rtp_demuxer_grow(demuxer))
+            return NULL;
+        rtp_demuxer_find(demuxer, ssrc, &slot);
+    }
+
+    stream = &(demuxer->streams[slot]);
+    stream->depacketizer = rtp_depacketizer_create(codec,
+            demuxer->timeout_us, demuxer->reap_us);
+    if (!stream->depacketizer)
+        return NULL;
+    rtp_depacketizer_set_clock(stream->depacketizer, demuxer->clock,
+            demuxer->clock_data);
+
+    stream->ssrc = ssrc;
+    stream->active_us = demuxer->clock ?
+        demuxer->clock(demuxer->clock_data) : g_get_monotonic_time();
+    ++(demuxer->count);
+
+    return stream;
+}
+
+/* NOTE: on a miss, *slot is the empty slot where ssrc would be inserted */
+static bool
+rtp_demuxer_find(const rtp_demuxer_t *demuxer,
+                 uint32_t             ssrc,
+                 size_t              *slot)
+{
+    size_t mask = 0;
+    size_t idx  = 0;
+
+    g_return_val_if_fail(NULL != demuxer, false);
+    g_return_val_if_fail(NULL != slot, false);
+
+    mask = demuxer->capacity - 1;
+    for (idx = rtp_demuxer_hash(demuxer, ssrc);
+         demuxer->streams[idx].depacketizer; idx = (idx + 1) & mask)
+    {
+        if (demuxer->streams[idx].ssrc == ssrc)
+        {
+            *slot = idx;
+            return true;
+        }
+    }
+
+    *slot = idx;
+
+    return false;
+}
+
+static bool
+rtp_demuxer_grow(rtp_demuxer_t *demuxer)
+{
+    rtp_stream_t *streams  = NULL;
+    size_t        capacity = 0;
+    size_t        idx      = 0;
+    size_t        slot     = 0;
+
+    g_return_val_if_fail(NULL != demuxer, false);
+
+    streams = demuxer->streams;
+    capacity = demuxer->capacity;
+    demuxer->streams = g_try_new0(rtp_stream_t, 2 * capacity);
+    if (!demuxer->streams)
+    {
+        demuxer->streams = streams;
+        return false;
+    }
+
+    demuxer->capacity = 2 * capacity;
+    for (idx = 0; idx < capacity; idx++)
+    {
+        if (!streams[idx].depacketizer)
+            continue;
+        rtp_demuxer_find(demuxer, streams[idx].ssrc, &slot);
+        demuxer->streams[slot] = streams[idx];
+    }
+    g_clear_pointer(&streams, g_free);
+
+    return true;
+}
+
+/* NOTE: entries after the hole are shifted back into it when their home
+ * slot allows, so lookups never need tombstones */
+static void
+rtp_demuxer_erase(rtp_demuxer_t *demuxer,
+                  size_t         slot)
+{
+    rtp_stream_t *streams = NULL;
+    size_t        mask    = 0;
+    size_t        next    = 0;
+    size_t        home    = 0;
+
+    g_return_if_fail(NULL != demuxer);
+    g_return_if_fail(slot < demuxer->capacity);
+
+    streams = demuxer->streams;
+    mask = demuxer->capacity - 1;
+    g_clear_pointer(&(streams[slot].depacketizer), rtp_depacketizer_destroy);
+    --(demuxer->count);
+
+    for (next = (slot + 1) & mask; streams[next].depacketizer;
+         next = (next + 1) & mask)
+    {
+        home = rtp_demuxer_hash(demuxer, streams[next].ssrc);
+        if (((next - home) & mask) < ((next - slot) & mask))
+            continue;
+        streams[slot] = streams[next];
+        slot = next;
+    }
+
+    memset(&(streams[slot]), 0, sizeof(streams[slot]));
+}
+
+static void
+rtp_demuxer_expire(rtp_demuxer_t *demuxer,
+                   gint64         now_us)
+{
+    size_t slot = 0;
+
+    g_return_if_fail(NULL != demuxer);
+
+    /* Erasing shifts a later entry into the current slot, so recheck it */
+    for (slot = 0; slot < demuxer->capacity;)
+    {
+        if (demuxer->streams[slot].depacketizer &&
+            now_us - demuxer->streams[slot].active_us > demuxer->idle_us)
+            rtp_demuxer_erase(demuxer, slot);
+        else
+            slot++;
+    }
+
+    demuxer->expire_us = now_us;
+}
+
+static inline size_t
+rtp_demuxer_hash(const rtp_demuxer_t *demuxer,
+                 uint32_t             ssrc)
+{
+    uint32_t hash = ssrc * 0x9E3779B1U;
+
+    return (hash ^ (hash >> 16)) & (demuxer->capacity - 1);
+}
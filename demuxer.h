@@ -0,0 +1,87 @@
+/*
+ * Author: Pu-Chen Mao
+ * Date:   2026/10/15
+ * File:   demuxer.h
+ * Desc:   SSRC demultiplexer over RTP depacketizers
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/uio.h>
+
+#include "rtp_depacketizer.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    #define RTP_DEMUXER_MIN_CAPACITY 16
+    #define RTP_PAYLOAD_TYPE_COUNT   128
+
+    typedef struct rtp_stream_t
+    {
+        uint32_t            ssrc;
+        rtp_depacketizer_t *depacketizer;
+        gint64              active_us;
+
+    } rtp_stream_t;
+
+    /* Streams live in a flat open-addressing table keyed by SSRC (linear
+     * probing, backward-shift deletion); a slot without a depacketizer is
+     * empty. Streams are created on their first packet and destroyed once
+     * idle for idle_us */
+    typedef struct rtp_demuxer_t
+    {
+        rtp_stream_t *streams;
+        size_t        capacity;
+        size_t        count;
+        codec_t       codec;
+        codec_t       codecs[RTP_PAYLOAD_TYPE_COUNT];
+        gint64        timeout_us;
+        gint64        reap_us;
+        gint64        idle_us;
+        gint64        expire_us;
+        rtp_clock_t   clock;
+        gpointer      clock_data;
+
+    } rtp_demuxer_t;
+
+    /* Called after each run of consecutive packets from one SSRC that
+     * leaves its stream with completed frames, so a stream whose packets
+     * are interleaved with others' within a batch may see several calls */
+    typedef void (*rtp_demuxer_ready_t)(uint32_t ssrc,
+            rtp_depacketizer_t *depacketizer, gpointer userdata);
+
+    rtp_demuxer_t *rtp_demuxer_create(codec_t codec, gint64 timeout_us,
+            gint64 reap_us, gint64 idle_us);
+    bool rtp_demuxer_set_clock(rtp_demuxer_t *demuxer, rtp_clock_t clock,
+            gpointer userdata);
+    bool rtp_demuxer_map_payload_type(rtp_demuxer_t *demuxer,
+            uint8_t payload_type, codec_t codec);
+    bool rtp_demuxer_add_buffer(rtp_demuxer_t *demuxer, uint8_t *buffer,
+            size_t length, uint32_t *ssrc, rtp_depacketizer_t **depacketizer,
+            bool *frame_ready);
+    bool rtp_demuxer_add_buffers(rtp_demuxer_t *demuxer,
+            const struct iovec *buffers, size_t count,
+            rtp_demuxer_ready_t ready, gpointer userdata);
+    bool rtp_demuxer_add_packet(rtp_demuxer_t *demuxer, packet_t *packet,
+            rtp_demuxer_ready_t ready, gpointer userdata);
+    bool rtp_demuxer_flush(rtp_demuxer_t *demuxer, rtp_demuxer_ready_t ready,
+            gpointer userdata);
+    rtp_depacketizer_t *rtp_demuxer_steal(rtp_demuxer_t *demuxer,
+            uint32_t ssrc);
+    bool rtp_demuxer_adopt(rtp_demuxer_t *demuxer, uint32_t ssrc,
+            rtp_depacketizer_t *depacketizer);
+    rtp_depacketizer_t *rtp_demuxer_lookup(rtp_demuxer_t *demuxer,
+            uint32_t ssrc);
+    bool rtp_demuxer_remove(rtp_demuxer_t *demuxer, uint32_t ssrc);
+    void rtp_demuxer_destroy(gpointer data);
+
+#ifdef __cplusplus
+}
+#endif
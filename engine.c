@@ -0,0 +1,681 @@
+/*
+ * Author: Pu-Chen Mao
+ * Date:   2026/10/15
+ * File:   engine.c
+ * Desc:   Sharded multi-threaded RTP depacketization engine
+ */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "engine.h"
+
+#define RTP_ENGINE_IMBALANCE_NUM 5
+#define RTP_ENGINE_IMBALANCE_DEN 4
+
+static void *rtp_engine_run(gpointer data);
+static size_t rtp_engine_drain(rtp_worker_t *worker);
+static void rtp_engine_take(rtp_worker_t *worker, packet_t *packet,
+        size_t bucket);
+static void rtp_engine_handle(rtp_worker_t *worker,
+        rtp_engine_message_t *message);
+static void rtp_engine_release(rtp_worker_t *worker, size_t bucket);
+static void rtp_engine_settle(rtp_worker_t *worker, size_t bucket);
+static void rtp_engine_ready(uint32_t ssrc, rtp_depacketizer_t *depacketizer,
+        gpointer userdata);
+static bool rtp_engine_post(rtp_engine_t *engine, size_t worker,
+        rtp_engine_message_type_t type, size_t bucket, uint32_t ssrc,
+        rtp_depacketizer_t *depacketizer);
+static size_t rtp_engine_packet_bucket(const rtp_engine_t *engine,
+        const packet_t *packet);
+
+/* NOTE: workers are set up here but only started by rtp_engine_start(),
+ * worker i is pinned to CPU i modulo the online CPUs unless told otherwise */
+rtp_engine_t *
+rtp_engine_create(size_t   workers,
+                  codec_t  codec,
+                  prefix_t prefix,
+                  gint64   timeout_us,
+                  gint64   reap_us,
+                  gint64   idle_us)
+{
+    rtp_engine_t *engine = NULL;
+    rtp_worker_t *worker = NULL;
+    long          cpus   = 0;
+    size_t        idx    = 0;
+    bool          result = false;
+
+    g_return_val_if_fail(0 < workers, NULL);
+
+    engine = g_try_new0(rtp_engine_t, 1);
+    if (!engine)
+        goto RETURN;
+
+    engine->workers = g_try_new0(rtp_worker_t, workers);
+    if (!engine->workers)
+        goto RETURN;
+
+    engine->count = workers;
+    cpus = MAX(sysconf(_SC_NPROCESSORS_ONLN), 1);
+    for (idx = 0; idx < workers; idx++)
+    {
+        worker = &(engine->workers[idx]);
+        worker->engine = engine;
+        worker->index = idx;
+        worker->cpu = (int)(idx % (size_t)(cpus));
+
+        worker->ring = packet_ring_create(RTP_ENGINE_RING_SIZE);
+        if (!worker->ring)
+            goto RETURN;
+
+        worker->pool = packet_pool_create_shared(PACKET_POOL_MTU,
+                PACKET_POOL_SLOTS_PER_SLAB);
+        if (!worker->pool)
+            goto RETURN;
+
+        worker->control = g_async_queue_new_full(g_free);
+        if (!worker->control)
+            goto RETURN;
+
+        worker->demuxer = rtp_demuxer_create(codec, timeout_us, reap_us,
+                idle_us);
+        if (!worker->demuxer)
+            goto RETURN;
+
+        worker->media = media_create_sized(prefix, FRAME_MIN_OUTPUT);
+        if (!worker->media)
+            goto RETURN;
+
+        worker->parked = g_queue_new();
+        if (!worker->parked)
+            goto RETURN;
+
+        worker->load = g_try_new0(atomic_size_t, RTP_ENGINE_BUCKETS);
+        if (!worker->load)
+            goto RETURN;
+    }
+
+    for (idx = 0; idx < RTP_ENGINE_BUCKETS; idx++)
+    {
+        atomic_init(&(engine->owners[idx]), idx % workers);
+        atomic_init(&(engine->migrating[idx]), false);
+    }
+    atomic_init(&(engine->stopping), false);
+    result = true;
+
+RETURN:
+
+    if (!result)
+        g_clear_pointer(&engine, rtp_engine_destroy);
+
+    return engine;
+}
+
+/* NOTE: configuration calls are only allowed before rtp_engine_start() */
+bool
+rtp_engine_map_payload_type(rtp_engine_t *engine,
+                            uint8_t       payload_type,
+                            codec_t       codec)
+{
+    size_t idx = 0;
+
+    g_return_val_if_fail(NULL != engine, false);
+    g_return_val_if_fail(!engine->running, false);
+
+    for (idx = 0; idx < engine->count; idx++)
+        if (!rtp_demuxer_map_payload_type(engine->workers[idx].demuxer,
+                    payload_type, codec))
+            return false;
+
+    return true;
+}
+
+bool
+rtp_engine_set_key(rtp_engine_t     *engine,
+                   rtp_engine_key_t  key,
+                   gpointer          keydata)
+{
+    g_return_val_if_fail(NULL != engine, false);
+    g_return_val_if_fail(!engine->running, false);
+
+    engine->key = key;
+    engine->keydata = keydata;
+
+    return true;
+}
+
+/* NOTE: worker i is pinned to cpus[i % count], a negative CPU leaves the
+ * worker unpinned */
+bool
+rtp_engine_set_affinity(rtp_engine_t *engine,
+                        const int    *cpus,
+                        size_t        count)
+{
+    size_t idx = 0;
+
+    g_return_val_if_fail(NULL != engine, false);
+    g_return_val_if_fail(NULL != cpus, false);
+    g_return_val_if_fail(0 < count, false);
+    g_return_val_if_fail(!engine->running, false);
+
+    for (idx = 0; idx < engine->count; idx++)
+        engine->workers[idx].cpu = cpus[idx % count];
+
+    return true;
+}
+
+bool
+rtp_engine_start(rtp_engine_t         *engine,
+                 rtp_engine_deliver_t  deliver,
+                 gpointer              userdata)
+{
+    rtp_worker_t *worker = NULL;
+    size_t        idx    = 0;
+    bool          result = false;
+
+    g_return_val_if_fail(NULL != engine, false);
+    g_return_val_if_fail(NULL != deliver, false);
+    g_return_val_if_fail(!engine->running, false);
+
+    engine->deliver = deliver;
+    engine->userdata = userdata;
+    engine->running = true;
+    for (idx = 0; idx < engine->count; idx++)
+    {
+        worker = &(engine->workers[idx]);
+        if (pthread_create(&(worker->thread), NULL, rtp_engine_run,
+                    worker) != 0)
+            goto RETURN;
+        worker->started = true;
+    }
+    result = true;
+
+RETURN:
+
+    /* NOTE: workers already started are stopped, leaving the engine as it
+     * was before the call */
+    if (!result)
+    {
+        atomic_store_explicit(&(engine->stopping), true,
+                memory_order_release);
+        for (idx = 0; idx < engine->count; idx++)
+        {
+            worker = &(engine->workers[idx]);
+            if (!worker->started)
+                continue;
+            packet_ring_kick(worker->ring);
+            pthread_join(worker->thread, NULL);
+            worker->started = false;
+        }
+        atomic_store_explicit(&(engine->stopping), false,
+                memory_order_release);
+        engine->running = false;
+    }
+
+    return result;
+}
+
+/* NOTE: safe from any thread. Packet ownership is transferred to the
+ * engine, a packet that cannot be queued (its worker is full) is freed */
+bool
+rtp_engine_add_packet(rtp_engine_t *engine,
+                      packet_t     *packet)
+{
+    size_t owner = 0;
+
+    g_return_val_if_fail(NULL != engine, false);
+    g_return_val_if_fail(NULL != packet, false);
+
+    if (!packet->payload)
+    {
+        g_clear_pointer(&packet, packet_destroy);
+        return false;
+    }
+
+    owner = atomic_load_explicit(&(engine->owners[
+                rtp_engine_packet_bucket(engine, packet)]),
+            memory_order_acquire);
+    if (!packet_ring_push(engine->workers[owner].ring, packet))
+    {
+        g_clear_pointer(&packet, packet_destroy);
+        return false;
+    }
+
+    return true;
+}
+
+/* NOTE: safe from any thread, the buffer is copied into the pool of the
+ * worker currently owning its stream */
+bool
+rtp_engine_add_buffer(rtp_engine_t  *engine,
+                      const uint8_t *buffer,
+                      size_t         length)
+{
+    packet_t *packet = NULL;
+    size_t    owner  = 0;
+
+    g_return_val_if_fail(NULL != engine, false);
+    g_return_val_if_fail(NULL != buffer, false);
+
+    if (length < sizeof(rtp_header_t))
+        return false;
+
+    owner = atomic_load_explicit(&(engine->owners[rtp_engine_get_bucket(
+                    engine, ntohl(((const rtp_header_t *)(buffer))->ssrc))]),
+            memory_order_relaxed);
+    packet = packet_pool_acquire(engine->workers[owner].pool, buffer, length,
+            false, g_get_monotonic_time());
+    if (!packet)
+        return false;
+
+    return rtp_engine_add_packet(engine, packet);
+}
+
+size_t
+rtp_engine_get_bucket(const rtp_engine_t *engine,
+                      uint32_t            ssrc)
+{
+    uint32_t hash = 0;
+
+    g_return_val_if_fail(NULL != engine, 0);
+
+    hash = (engine->key ? engine->key(ssrc, engine->keydata) : ssrc) *
+        0x9E3779B1U;
+
+    return (hash ^ (hash >> 16)) & (RTP_ENGINE_BUCKETS - 1);
+}
+
+/* NOTE: hands a bucket and its streams over to another worker. Only one
+ * thread may move buckets, and a bucket still migrating cannot be moved.
+ * New packets go to the new owner at once and are parked there until the
+ * old owner has handed the streams over; stragglers still reaching the old
+ * owner are forwarded */
+bool
+rtp_engine_move(rtp_engine_t *engine,
+                size_t        bucket,
+                size_t        worker)
+{
+    size_t owner = 0;
+
+    g_return_val_if_fail(NULL != engine, false);
+    g_return_val_if_fail(RTP_ENGINE_BUCKETS > bucket, false);
+    g_return_val_if_fail(engine->count > worker, false);
+
+    owner = atomic_load_explicit(&(engine->owners[bucket]),
+            memory_order_relaxed);
+    if (owner == worker ||
+        atomic_load_explicit(&(engine->migrating[bucket]),
+            memory_order_acquire))
+        return false;
+
+    atomic_store_explicit(&(engine->migrating[bucket]), true,
+            memory_order_release);
+    atomic_store_explicit(&(engine->owners[bucket]), worker,
+            memory_order_release);
+
+    return rtp_engine_post(engine, owner, RTP_ENGINE_MOVE, bucket, 0, NULL);
+}
+
+/* NOTE: compares the packets each worker took since the last call and
+ * moves one bucket from the busiest worker to the idlest when they are
+ * more than 25% apart, picking the busiest bucket that still narrows the
+ * gap. Meant to be called periodically from a single thread */
+bool
+rtp_engine_rebalance(rtp_engine_t *engine)
+{
+    size_t *loads   = NULL;
+    size_t  deltas[RTP_ENGINE_BUCKETS];
+    size_t  total   = 0;
+    size_t  owner   = 0;
+    size_t  hottest = 0;
+    size_t  coldest = 0;
+    size_t  bucket  = RTP_ENGINE_BUCKETS;
+    size_t  idx     = 0;
+    size_t  jdx     = 0;
+    bool    result  = false;
+
+    g_return_val_if_fail(NULL != engine, false);
+
+    loads = g_try_new0(size_t, engine->count);
+    if (!loads)
+        return false;
+
+    for (idx = 0; idx < RTP_ENGINE_BUCKETS; idx++)
+    {
+        for (total = 0, jdx = 0; jdx < engine->count; jdx++)
+            total += atomic_load_explicit(&(engine->workers[jdx].load[idx]),
+                    memory_order_relaxed);
+        deltas[idx] = total - engine->snapshot[idx];
+        engine->snapshot[idx] = total;
+        owner = atomic_load_explicit(&(engine->owners[idx]),
+                memory_order_relaxed);
+        loads[owner] += deltas[idx];
+    }
+
+    for (idx = 1; idx < engine->count; idx++)
+    {
+        if (loads[idx] > loads[hottest])
+            hottest = idx;
+        if (loads[idx] < loads[coldest])
+            coldest = idx;
+    }
+
+    if (loads[hottest] * RTP_ENGINE_IMBALANCE_DEN <=
+        loads[coldest] * RTP_ENGINE_IMBALANCE_NUM)
+        goto RETURN;
+
+    for (idx = 0; idx < RTP_ENGINE_BUCKETS; idx++)
+    {
+        if (atomic_load_explicit(&(engine->owners[idx]),
+                    memory_order_relaxed) != hottest || deltas[idx] == 0 ||
+            2 * deltas[idx] >= loads[hottest] - loads[coldest])
+            continue;
+        if (bucket == RTP_ENGINE_BUCKETS || deltas[idx] > deltas[bucket])
+            bucket = idx;
+    }
+
+    if (bucket < RTP_ENGINE_BUCKETS)
+        result = rtp_engine_move(engine, bucket, coldest);
+
+RETURN:
+
+    g_clear_pointer(&loads, g_free);
+
+    return result;
+}
+
+/* NOTE: stops and joins the workers, packets still queued are dropped */
+void
+rtp_engine_destroy(gpointer data)
+{
+    rtp_engine_t         *engine  = NULL;
+    rtp_worker_t         *worker  = NULL;
+    rtp_engine_message_t *message = NULL;
+    size_t                idx     = 0;
+
+    g_return_if_fail(NULL != data);
+
+    engine = (rtp_engine_t *)(data);
+    atomic_store_explicit(&(engine->stopping), true, memory_order_release);
+    for (idx = 0; engine->workers && idx < engine->count; idx++)
+    {
+        worker = &(engine->workers[idx]);
+        if (!worker->started)
+            continue;
+        packet_ring_kick(worker->ring);
+        pthread_join(worker->thread, NULL);
+    }
+
+    for (idx = 0; engine->workers && idx < engine->count; idx++)
+    {
+        worker = &(engine->workers[idx]);
+        /* Streams in flight between workers are owned by the message */
+        while (worker->control &&
+               (message = g_async_queue_try_pop(worker->control)))
+        {
+            g_clear_pointer(&(message->depacketizer),
+                    rtp_depacketizer_destroy);
+            g_clear_pointer(&message, g_free);
+        }
+        if (worker->parked)
+            g_queue_free_full(worker->parked, packet_destroy);
+        g_clear_pointer(&(worker->control), g_async_queue_unref);
+        g_clear_pointer(&(worker->ring), packet_ring_destroy);
+        g_clear_pointer(&(worker->demuxer), rtp_demuxer_destroy);
+        g_clear_pointer(&(worker->pool), packet_pool_destroy);
+        g_clear_pointer(&(worker->media), media_destroy);
+        g_clear_pointer(&(worker->load), g_free);
+    }
+    g_clear_pointer(&(engine->workers), g_free);
+    g_clear_pointer(&engine, g_free);
+}
+
+static void *
+rtp_engine_run(gpointer data)
+{
+    rtp_worker_t         *worker  = NULL;
+    rtp_engine_t         *engine  = NULL;
+    rtp_engine_message_t *message = NULL;
+    cpu_set_t             cpuset;
+
+    g_return_val_if_fail(NULL != data, NULL);
+
+    worker = (rtp_worker_t *)(data);
+    engine = worker->engine;
+    if (worker->cpu >= 0)
+    {
+        CPU_ZERO(&cpuset);
+        CPU_SET(worker->cpu, &cpuset);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpuset),
+                    &cpuset) != 0)
+            fprintf(stderr, "Failed to pin worker [%zu] to CPU [%d]\n",
+                    worker->index, worker->cpu);
+    }
+
+    while (!atomic_load_explicit(&(engine->stopping), memory_order_acquire))
+    {
+        while ((message = g_async_queue_try_pop(worker->control)))
+        {
+            rtp_engine_handle(worker, message);
+            g_clear_pointer(&message, g_free);
+        }
+
+        if (rtp_engine_drain(worker) == 0)
+            packet_ring_wait(worker->ring, RTP_ENGINE_TICK_US);
+    }
+
+    return NULL;
+}
+
+static size_t
+rtp_engine_drain(rtp_worker_t *worker)
+{
+    rtp_engine_t *engine = NULL;
+    packet_t     *packet = NULL;
+    size_t        bucket = 0;
+    size_t        owner  = 0;
+    size_t        count  = 0;
+
+    g_return_val_if_fail(NULL != worker, 0);
+
+    engine = worker->engine;
+    for (count = 0; count < RTP_ENGINE_BATCH; count++)
+    {
+        packet = packet_ring_pop(worker->ring);
+        if (!packet)
+            break;
+
+        /* Routed here before its bucket moved away, a full ring loses it
+         * like the network would */
+        bucket = rtp_engine_packet_bucket(engine, packet);
+        owner = atomic_load_explicit(&(engine->owners[bucket]),
+                memory_order_acquire);
+        if (owner != worker->index)
+        {
+            if (!packet_ring_push(engine->workers[owner].ring, packet))
+                g_clear_pointer(&packet, packet_destroy);
+            continue;
+        }
+
+        if (atomic_load_explicit(&(engine->migrating[bucket]),
+                    memory_order_acquire))
+        {
+            g_queue_push_tail(worker->parked, packet);
+            continue;
+        }
+
+        rtp_engine_take(worker, packet, bucket);
+    }
+
+    return count;
+}
+
+static void
+rtp_engine_take(rtp_worker_t *worker,
+                packet_t     *packet,
+                size_t        bucket)
+{
+    atomic_store_explicit(&(worker->load[bucket]),
+            atomic_load_explicit(&(worker->load[bucket]),
+                memory_order_relaxed) + 1, memory_order_relaxed);
+    rtp_demuxer_add_packet(worker->demuxer, packet, rtp_engine_ready,
+            worker);
+}
+
+static void
+rtp_engine_handle(rtp_worker_t         *worker,
+                  rtp_engine_message_t *message)
+{
+    g_return_if_fail(NULL != worker);
+    g_return_if_fail(NULL != message);
+
+    switch (message->type)
+    {
+        case RTP_ENGINE_MOVE:
+            rtp_engine_release(worker, message->bucket); break;
+        case RTP_ENGINE_ADOPT:
+            if (!rtp_demuxer_adopt(worker->demuxer, message->ssrc,
+                        message->depacketizer))
+                rtp_depacketizer_destroy(message->depacketizer);
+            message->depacketizer = NULL;
+            break;
+        case RTP_ENGINE_SETTLE:
+            rtp_engine_settle(worker, message->bucket); break;
+        default: break;
+    }
+}
+
+/* NOTE: runs on the old owner, sends each stream of the bucket to the new
+ * owner followed by a settle message once they are all on their way */
+static void
+rtp_engine_release(rtp_worker_t *worker,
+                   size_t        bucket)
+{
+    rtp_engine_t       *engine       = NULL;
+    rtp_demuxer_t      *demuxer      = NULL;
+    rtp_depacketizer_t *depacketizer = NULL;
+    GArray             *ssrcs        = NULL;
+    uint32_t            ssrc         = 0;
+    size_t              owner        = 0;
+    size_t              idx          = 0;
+
+    g_return_if_fail(NULL != worker);
+
+    engine = worker->engine;
+    demuxer = worker->demuxer;
+    owner = atomic_load_explicit(&(engine->owners[bucket]),
+            memory_order_acquire);
+
+    /* Stealing shifts the table, so collect the SSRCs first */
+    ssrcs = g_array_new(FALSE, FALSE, sizeof(uint32_t));
+    for (idx = 0; idx < demuxer->capacity; idx++)
+        if (demuxer->streams[idx].depacketizer &&
+            rtp_engine_get_bucket(engine, demuxer->streams[idx].ssrc) ==
+            bucket)
+            g_array_append_val(ssrcs, demuxer->streams[idx].ssrc);
+
+    for (idx = 0; idx < ssrcs->len; idx++)
+    {
+        ssrc = g_array_index(ssrcs, uint32_t, idx);
+        depacketizer = rtp_demuxer_steal(demuxer, ssrc);
+        if (depacketizer && !rtp_engine_post(engine, owner,
+                    RTP_ENGINE_ADOPT, bucket, ssrc, depacketizer))
+            rtp_depacketizer_destroy(depacketizer);
+    }
+    g_array_free(ssrcs, TRUE);
+
+    if (!rtp_engine_post(engine, owner, RTP_ENGINE_SETTLE, bucket, 0, NULL))
+        atomic_store_explicit(&(engine->migrating[bucket]), false,
+                memory_order_release);
+}
+
+/* NOTE: runs on the new owner once the bucket's streams are in, packets
+ * parked meanwhile are replayed in arrival order */
+static void
+rtp_engine_settle(rtp_worker_t *worker,
+                  size_t        bucket)
+{
+    rtp_engine_t *engine = NULL;
+    packet_t     *packet = NULL;
+    GList        *link   = NULL;
+    GList        *next   = NULL;
+
+    g_return_if_fail(NULL != worker);
+
+    engine = worker->engine;
+    atomic_store_explicit(&(engine->migrating[bucket]), false,
+            memory_order_release);
+
+    for (link = worker->parked->head; link; link = next)
+    {
+        next = link->next;
+        packet = (packet_t *)(link->data);
+        if (rtp_engine_packet_bucket(engine, packet) != bucket)
+            continue;
+        g_queue_delete_link(worker->parked, link);
+        rtp_engine_take(worker, packet, bucket);
+    }
+}
+
+static void
+rtp_engine_ready(uint32_t            ssrc,
+                 rtp_depacketizer_t *depacketizer,
+                 gpointer            userdata)
+{
+    rtp_worker_t *worker = NULL;
+    rtp_engine_t *engine = NULL;
+    media_t      *media  = NULL;
+
+    g_return_if_fail(NULL != depacketizer);
+    g_return_if_fail(NULL != userdata);
+
+    worker = (rtp_worker_t *)(userdata);
+    engine = worker->engine;
+    media = worker->media;
+    while (depacketizer->completed->len > 0)
+    {
+        media->length = media->capacity;
+        if (rtp_depacketizer_get_frame(depacketizer, media))
+            engine->deliver(worker->index, ssrc, media, engine->userdata);
+        else if (media->length > media->capacity &&
+                 !media_reserve(media, media->length))
+            break;
+    }
+}
+
+static bool
+rtp_engine_post(rtp_engine_t              *engine,
+                size_t                     worker,
+                rtp_engine_message_type_t  type,
+                size_t                     bucket,
+                uint32_t                   ssrc,
+                rtp_depacketizer_t        *depacketizer)
+{
+    rtp_engine_message_t *message = NULL;
+
+    message = g_try_new0(rtp_engine_message_t, 1);
+    if (!message)
+        return false;
+
+    message->type = type;
+    message->bucket = bucket;
+    message->worker = worker;
+    message->ssrc = ssrc;
+    message->depacketizer = depacketizer;
+    g_async_queue_push(engine->workers[worker].control, message);
+    packet_ring_kick(engine->workers[worker].ring);
+
+    return true;
+}
+
+static size_t
+rtp_engine_packet_bucket(const rtp_engine_t *engine,
+                         const packet_t     *packet)
+{
+    return rtp_engine_get_bucket(engine, packet->ssrc);
+}
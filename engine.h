@@ -0,0 +1,123 @@
+/*
+ * Author: Pu-Chen Mao
+ * Date:   2026/10/15
+ * File:   engine.h
+ * Desc:   Sharded multi-threaded RTP depacketization engine
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "demuxer.h"
+#include "ring.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    #define RTP_ENGINE_BUCKETS   1024
+    #define RTP_ENGINE_RING_SIZE 4096
+    #define RTP_ENGINE_BATCH     256
+    #define RTP_ENGINE_TICK_US   10000
+
+    struct rtp_engine_t;
+
+    /* Maps an SSRC to the key streams are sharded by, streams sharing a key
+     * (e.g. the audio and video of one call) always share a worker */
+    typedef uint32_t (*rtp_engine_key_t)(uint32_t ssrc, gpointer userdata);
+
+    /* Called on the worker thread owning the stream, media is only valid
+     * during the call */
+    typedef void (*rtp_engine_deliver_t)(size_t worker, uint32_t ssrc,
+            media_t *media, gpointer userdata);
+
+    typedef enum rtp_engine_message_type_t
+    {
+        RTP_ENGINE_MOVE = 0,
+        RTP_ENGINE_ADOPT,
+        RTP_ENGINE_SETTLE,
+
+    } rtp_engine_message_type_t;
+
+    typedef struct rtp_engine_message_t
+    {
+        rtp_engine_message_type_t  type;
+        size_t                     bucket;
+        size_t                     worker;
+        uint32_t                   ssrc;
+        rtp_depacketizer_t        *depacketizer;
+
+    } rtp_engine_message_t;
+
+    /* Everything but the ring, the control queue, the pool and load is
+     * only touched by the worker's own thread once the engine is started.
+     * Producers copy the packets bound for the worker into its pool, which
+     * is shared as streams carry their packets along when they move. load
+     * counts the packets the worker took per bucket, other threads only
+     * read it */
+    typedef struct rtp_worker_t
+    {
+        struct rtp_engine_t *engine;
+        size_t               index;
+        int                  cpu;
+        pthread_t            thread;
+        bool                 started;
+        packet_ring_t       *ring;
+        packet_pool_t       *pool;
+        GAsyncQueue         *control;
+        rtp_demuxer_t       *demuxer;
+        media_t             *media;
+        GQueue              *parked;
+        atomic_size_t       *load;
+
+    } rtp_worker_t;
+
+    /* Keys hash into a fixed set of buckets, each owned by one worker at a
+     * time. Producers route packets by reading the owner, so moving a
+     * bucket is a store plus a handoff of its streams between workers;
+     * while a bucket is migrating its new owner parks its packets */
+    typedef struct rtp_engine_t
+    {
+        rtp_worker_t         *workers;
+        size_t                count;
+        atomic_size_t         owners[RTP_ENGINE_BUCKETS];
+        atomic_bool           migrating[RTP_ENGINE_BUCKETS];
+        size_t                snapshot[RTP_ENGINE_BUCKETS];
+        rtp_engine_key_t      key;
+        gpointer              keydata;
+        rtp_engine_deliver_t  deliver;
+        gpointer              userdata;
+        atomic_bool           stopping;
+        bool                  running;
+
+    } rtp_engine_t;
+
+    rtp_engine_t *rtp_engine_create(size_t workers, codec_t codec,
+            prefix_t prefix, gint64 timeout_us, gint64 reap_us,
+            gint64 idle_us);
+    bool rtp_engine_map_payload_type(rtp_engine_t *engine,
+            uint8_t payload_type, codec_t codec);
+    bool rtp_engine_set_key(rtp_engine_t *engine, rtp_engine_key_t key,
+            gpointer keydata);
+    bool rtp_engine_set_affinity(rtp_engine_t *engine, const int *cpus,
+            size_t count);
+    bool rtp_engine_start(rtp_engine_t *engine, rtp_engine_deliver_t deliver,
+            gpointer userdata);
+    bool rtp_engine_add_packet(rtp_engine_t *engine, packet_t *packet);
+    bool rtp_engine_add_buffer(rtp_engine_t *engine, const uint8_t *buffer,
+            size_t length);
+    size_t rtp_engine_get_bucket(const rtp_engine_t *engine, uint32_t ssrc);
+    bool rtp_engine_move(rtp_engine_t *engine, size_t bucket, size_t worker);
+    bool rtp_engine_rebalance(rtp_engine_t *engine);
+    void rtp_engine_destroy(gpointer data);
+
+#ifdef __cplusplus
+}
+#endif
@@ -19,6 +19,23 @@ static format_t h264_format =
     .frame_type = h264_get_frame_type,
     .first_unit = h264_is_first_nalu,
     .last_unit  = h264_is_last_nalu,
+    .measure    = h264_measure_nalu,
+    .scatter    = h264_scatter_frame,
+    .conceal    = h264_conceal_nalu,
+    .merge      = h264_merge_context,
+};
+
+static format_t hevc_format =
+{
+    .reassemble = hevc_reassemble_frame,
+    .fragmented = hevc_is_fragmented,
+    .frame_type = hevc_get_frame_type,
+    .first_unit = hevc_is_first_nalu,
+    .last_unit  = hevc_is_last_nalu,
+    .measure    = hevc_measure_nalu,
+    .scatter    = hevc_scatter_frame,
+    .conceal    = hevc_conceal_nalu,
+    .merge      = hevc_merge_context,
 };
 
 static format_t opus_format =
@@ -28,6 +45,36 @@ static format_t opus_format =
     .frame_type = opus_get_frame_type,
     .first_unit = opus_is_first_frame,
     .last_unit  = opus_is_last_frame,
+    .measure    = opus_measure_frame,
+    .scatter    = opus_scatter_frame,
+    .conceal    = opus_conceal_frame,
+    .merge      = opus_merge_context,
+};
+
+static format_t vp8_format =
+{
+    .reassemble = vp8_reassemble_frame,
+    .fragmented = vp8_is_fragmented,
+    .frame_type = vp8_get_frame_type,
+    .first_unit = vp8_is_first_packet,
+    .last_unit  = vp8_is_last_packet,
+    .measure    = vp8_measure_packet,
+    .scatter    = vp8_scatter_frame,
+    .conceal    = vp8_conceal_frame,
+    .merge      = vp8_merge_context,
+};
+
+static format_t vp9_format =
+{
+    .reassemble = vp9_reassemble_frame,
+    .fragmented = vp9_is_fragmented,
+    .frame_type = vp9_get_frame_type,
+    .first_unit = vp9_is_first_packet,
+    .last_unit  = vp9_is_last_packet,
+    .measure    = vp9_measure_packet,
+    .scatter    = vp9_scatter_frame,
+    .conceal    = vp9_conceal_frame,
+    .merge      = vp9_merge_context,
 };
 
 const format_t *
@@ -37,8 +84,14 @@ format_get_reassembly_context(codec_t codec)
     {
         case CODEC_H264:
             return &h264_format;
+        case CODEC_H265:
+            return &hevc_format;
         case CODEC_OPUS:
             return &opus_format;
+        case CODEC_VP8:
+            return &vp8_format;
+        case CODEC_VP9:
+            return &vp9_format;
         default:
             return NULL;
     }
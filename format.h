@@ -11,7 +11,10 @@
 #include <stdint.h>
 
 #include "h264.h"
+#include "hevc.h"
 #include "opus.h"
+#include "vp8.h"
+#include "vp9.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -22,7 +25,10 @@ extern "C"
     {
         CODEC_NONE,
         CODEC_H264,
-        CODEC_OPUS
+        CODEC_OPUS,
+        CODEC_H265,
+        CODEC_VP8,
+        CODEC_VP9
 
     } codec_t;
 
@@ -41,6 +47,13 @@ extern "C"
     typedef uint8_t (*frame_type_functor_t)(const uint8_t *payload, size_t length);
     typedef bool (*first_unit_functor_t)(const uint8_t *payuload, size_t length);
     typedef bool (*last_unit_functor_t)(const uint8_t *payuload, size_t length);
+    typedef size_t (*measure_functor_t)(const uint8_t *payload, size_t length,
+            prefix_t prefix);
+    typedef void (*conceal_functor_t)(uint8_t *output, size_t length,
+            bool closing, void *data);
+    typedef bool (*scatter_functor_t)(media_vector_t *vector, prefix_t prefix,
+            const uint8_t *payload, size_t size, bool completed, void *data);
+    typedef void (*merge_functor_t)(void *data, const void *frame);
 
     typedef struct format_t
     {
@@ -49,13 +62,20 @@ extern "C"
         frame_type_functor_t frame_type;
         first_unit_functor_t first_unit;
         last_unit_functor_t  last_unit;
+        measure_functor_t    measure;
+        scatter_functor_t    scatter;
+        conceal_functor_t    conceal;
+        merge_functor_t      merge;
 
     } format_t;
 
     typedef union context_t
     {
         h264_context_t h264;
+        hevc_context_t hevc;
         opus_context_t opus;
+        vp8_context_t  vp8;
+        vp9_context_t  vp9;
 
     } context_t;
 
@@ -5,19 +5,29 @@
  * Desc:   Media frame composed of RTP packets
  */
 
-#include <arpa/inet.h>
 #include <stdio.h>
 #include <string.h>
 
 #include "frame.h"
 
-static void frame_order_packets(GQueue *packets);
+static bool frame_store_packet(frame_t *frame, const format_t *format,
+        packet_t *packet, bool *duplicate);
+static bool frame_resize_slots(frame_t *frame, size_t span);
 static bool frame_check_completeness(frame_t *frame);
-static void frame_foreach_packet(gpointer data, gpointer userdata);
+static void frame_compose_packets(frame_t *frame, const format_t *format);
+static bool frame_compose_packet(frame_t *frame, const format_t *format,
+        packet_t *packet, bool completed);
+static bool frame_finish_output(frame_t *frame, const format_t *format);
+static bool frame_take_output(frame_t *frame, const format_t *format,
+        media_t *media, void *data);
+static bool frame_reserve_output(frame_t *frame, size_t size);
+static inline packet_t *frame_peek_packet(const frame_t *frame,
+        uint16_t sequence);
 
 frame_t *
 frame_create(uint32_t timestamp,
-             codec_t  codec)
+             codec_t  codec,
+             gint64   created_us)
 {
     frame_t *frame  = NULL;
     bool     result = false;
@@ -26,11 +36,12 @@ frame_create(uint32_t timestamp,
     if (!frame)
         goto RETURN;
 
-    frame->packets = g_queue_new();
-    if (!frame->packets)
+    frame->slots = g_try_new0(packet_t *, FRAME_MIN_SLOTS);
+    if (!frame->slots)
         goto RETURN;
 
-    frame->created_us = g_get_monotonic_time();
+    frame->mask = FRAME_MIN_SLOTS - 1;
+    frame->created_us = created_us;
     frame->codec = codec;
     frame->timestamp = timestamp;
     frame->marker = false;
@@ -46,39 +57,77 @@ RETURN:
     return frame;
 }
 
+/* NOTE: switches the frame to incremental reassembly into buffer, which it
+ * takes over (NULL to allocate on demand). Must precede the first packet;
+ * the codec context is copied so the frame can parse on its own, and is
+ * merged back into the live one when the frame is taken, see the merge
+ * functor of format_t */
+bool
+frame_set_output(frame_t         *frame,
+                 prefix_t         prefix,
+                 const context_t *context,
+                 uint8_t         *buffer,
+                 size_t           capacity)
+{
+    g_return_val_if_fail(NULL != frame, false);
+    g_return_val_if_fail(NULL != context, false);
+    g_return_val_if_fail(0 == frame->count, false);
+    g_return_val_if_fail(NULL == frame->output, false);
+
+    frame->incremental = true;
+    frame->prefix = prefix;
+    frame->context = *context;
+    frame->output = buffer;
+    frame->outcap = buffer ? capacity : 0;
+    frame->outlen = 0;
+
+    return true;
+}
+
+/* NOTE: a packet whose sequence number is already held is a duplicate,
+ * it is dropped and reported as successfully added */
 bool
 frame_add_packet(frame_t  *frame,
                  packet_t *packet,
-                 bool     *completed)
+                 bool     *completed,
+                 bool     *duplicate)
 {
-    const format_t *format    = NULL;
-    uint32_t        timestamp = 0;
-    bool            result    = false;
+    const format_t *format = NULL;
+    bool            result = false;
 
     g_return_val_if_fail(frame != NULL, false);
-    g_return_val_if_fail(frame->packets != NULL, false);
+    g_return_val_if_fail(frame->slots != NULL, false);
     g_return_val_if_fail(packet != NULL, false);
-    g_return_val_if_fail(packet->rtp != NULL, false);
+    g_return_val_if_fail(packet->payload != NULL, false);
     g_return_val_if_fail(completed != NULL, false);
+    g_return_val_if_fail(duplicate != NULL, false);
 
-    timestamp = ntohl((packet->rtp->header).timestamp);
-    if (timestamp != frame->timestamp)
+    *duplicate = false;
+    if (packet->timestamp != frame->timestamp)
         goto RETURN;
 
     format = format_get_reassembly_context(frame->codec);
     if (!format)
         goto RETURN;
 
-    g_queue_push_tail(frame->packets, packet);
-    if ((packet->rtp->header).marker ||
-        format->last_unit(packet->rtp->payload, packet->length))
+    if (!frame_store_packet(frame, format, packet, duplicate))
+        goto RETURN;
+    if (*duplicate)
     {
-        frame->marker = true;
-        if (g_queue_get_length(frame->packets) > 1)
-            frame_order_packets(frame->packets);
-        frame->completed = frame_check_completeness(frame);
+        g_clear_pointer(&packet, packet_destroy);
+        *completed = frame->completed;
+        return true;
     }
 
+    if (packet->marker ||
+        format->last_unit(packet->payload, packet->payloadlen))
+        frame->marker = true;
+
+    /* Cheap enough to do for every packet, so a frame is complete as soon
+     * as its last missing packet lands, whatever order they came in */
+    frame->completed = frame_check_completeness(frame);
+    if (frame->incremental)
+        frame_compose_packets(frame, format);
     *completed = frame->completed;
     result = true;
 
@@ -87,47 +136,117 @@ RETURN:
     return result;
 }
 
+/* NOTE: the packet at the tail ends the frame after all, packets past it
+ * having been dropped before reaching it, the one with the marker bit
+ * among them. Returns whether that completes the frame */
+bool
+frame_end_at_tail(frame_t *frame)
+{
+    g_return_val_if_fail(NULL != frame, false);
+    g_return_val_if_fail(0 < frame->count + frame->composed, false);
+
+    frame->marker = true;
+    frame->last_unit = true;
+    frame->completed = frame_check_completeness(frame);
+
+    return frame->completed;
+}
+
+/* NOTE: the exact number of bytes frame_reassemble() will write, since each
+ * codec's measure functor mirrors its reassemble functor */
+bool
+frame_measure(const frame_t *frame,
+              prefix_t       prefix,
+              size_t        *size)
+{
+    packet_t       *packet   = NULL;
+    const format_t *format   = NULL;
+    const uint8_t  *payload  = NULL;
+    size_t          length   = 0;
+    size_t          count    = 0;
+    size_t          unitsize = 0;
+    uint16_t        sequence = 0;
+
+    g_return_val_if_fail(NULL != frame, false);
+    g_return_val_if_fail(NULL != frame->slots, false);
+    g_return_val_if_fail(NULL != size, false);
+
+    format = format_get_reassembly_context(frame->codec);
+    if (!format)
+        return false;
+    if (frame->incremental && prefix != frame->prefix)
+        return false;
+
+    *size = frame->outlen;
+    for (sequence = frame->head; count < frame->count; ++sequence)
+    {
+        packet = frame_peek_packet(frame, sequence);
+        if (!packet)
+            continue;
+        ++count;
+
+        if (!packet_get_payload(packet, &payload, &length) || !payload ||
+            length <= 0)
+            return false;
+
+        unitsize = format->measure(payload, length, prefix);
+        if (unitsize == 0)
+            return false;
+        *size += unitsize;
+    }
+
+    return true;
+}
+
 bool
 frame_reassemble(frame_t *frame,
                  media_t *media,
                  bool     completed,
                  void    *data)
 {
-    packet_t       *packet  = NULL;
-    const format_t *format  = NULL;
-    const uint8_t  *payload = NULL;
-    const uint8_t  *limit   = NULL;
-    uint8_t        *index   = NULL;
-    size_t          size    = 0;
-    bool            result  = false;
+    packet_t       *packet   = NULL;
+    const format_t *format   = NULL;
+    const uint8_t  *payload  = NULL;
+    const uint8_t  *limit    = NULL;
+    uint8_t        *index    = NULL;
+    size_t          size     = 0;
+    uint16_t        sequence = 0;
+    bool            result   = false;
 
     g_return_val_if_fail(NULL != frame, false);
-    g_return_val_if_fail(NULL != frame->packets, false);
+    g_return_val_if_fail(NULL != frame->slots, false);
     g_return_val_if_fail(NULL != media, false);
     g_return_val_if_fail(NULL != media->buffer, false);
     g_return_val_if_fail(NULL != data, false);
     g_return_val_if_fail(0 < media->length, false);
 
-    index = media->buffer;
-    limit = media->buffer + media->length;
-    media->length = 0;
-
     format = format_get_reassembly_context(frame->codec);
     if (!format)
         goto RETURN;
 
-    while (!g_queue_is_empty(frame->packets))
+    if (frame->incremental)
+        return frame_take_output(frame, format, media, data);
+
+    index = media->buffer;
+    limit = media->buffer + media->length;
+    media->length = 0;
+
+    /* Slots are indexed by sequence number, so walking from head to tail
+     * yields the packets in order; missing ones are simply skipped */
+    for (sequence = frame->head; frame->count > 0; ++sequence)
     {
-        packet = (packet_t *)(g_queue_pop_head(frame->packets));
+        packet = frame->slots[sequence & frame->mask];
         if (!packet)
-            goto RETURN;
+            continue;
+        frame->slots[sequence & frame->mask] = NULL;
+        --(frame->count);
 
         result = packet_get_payload(packet, &payload, &size);
         if (!result || !payload || size <= 0)
             goto RETURN;
 
         if (frame->unitcount == 0)
-            media->head_seq = ntohs((packet->rtp->header).sequence);
+            media->head_seq = sequence;
 
         /* NOTE: we MUST use payload returned from packet_get_payload() here,
          * since packet->rtp->payload does not skip RTP padding at the end */
@@ -137,7 +256,7 @@ frame_reassemble(frame_t *frame,
             goto RETURN;
 
         ++(frame->unitcount);
-        media->tail_seq = ntohs((packet->rtp->header).sequence);
+        media->tail_seq = sequence;
         g_clear_pointer(&packet, packet_destroy);
     }
 
@@ -155,14 +274,95 @@ RETURN:
     return result;
 }
 
+/* NOTE: packets stay in the frame, the vector references their payloads
+ * and must take ownership of the frame on success */
+bool
+frame_scatter(frame_t        *frame,
+              media_vector_t *vector,
+              bool            completed,
+              void           *data)
+{
+    packet_t       *packet   = NULL;
+    const format_t *format   = NULL;
+    const uint8_t  *payload  = NULL;
+    uint8_t         leading[sizeof(uint32_t) + 1];
+    size_t          size     = 0;
+    size_t          count    = 0;
+    uint16_t        sequence = 0;
+
+    g_return_val_if_fail(NULL != frame, false);
+    g_return_val_if_fail(NULL != frame->slots, false);
+    g_return_val_if_fail(NULL != vector, false);
+    g_return_val_if_fail(NULL != data, false);
+
+    format = format_get_reassembly_context(frame->codec);
+    if (!format || !format->scatter)
+        return false;
+
+    /* Already composed, the vector just points at the output buffer */
+    if (frame->incremental)
+    {
+        g_return_val_if_fail(vector->prefix == frame->prefix, false);
+        if (!frame_finish_output(frame, format) ||
+            !media_vector_append(vector, frame->output, frame->outlen))
+            return false;
+        format->merge(data, &(frame->context));
+        vector->head_seq = frame->head;
+        vector->tail_seq = frame->tail;
+    }
+
+    for (sequence = frame->head; count < frame->count; ++sequence)
+    {
+        packet = frame_peek_packet(frame, sequence);
+        if (!packet)
+            continue;
+
+        if (!packet_get_payload(packet, &payload, &size) || !payload ||
+            size <= 0)
+            return false;
+
+        if (count++ == 0)
+            vector->head_seq = sequence;
+
+        if (!format->scatter(vector, vector->prefix, payload, size,
+                    completed, data))
+            return false;
+
+        vector->tail_seq = sequence;
+    }
+
+    media_vector_finish(vector);
+
+    /* frame_type functors look at the head of a flat frame */
+    memset(leading, 0, sizeof(leading));
+    size = media_vector_peek(vector, leading, sizeof(leading));
+    vector->is_audio = (frame->codec == CODEC_OPUS);
+    vector->type = format->frame_type(leading, size);
+    vector->created_us = frame->created_us;
+    vector->rtptime = frame->timestamp;
+
+    return true;
+}
+
 #ifdef DEBUG
 void
 frame_print_packets(frame_t *frame)
 {
+    packet_t *packet   = NULL;
+    size_t    count    = 0;
+    uint16_t  sequence = 0;
+
     g_return_if_fail(NULL != frame);
 
     printf("[ ");
-    g_queue_foreach(frame->packets, packet_print_info, NULL);
+    for (sequence = frame->head; count < frame->count; ++sequence)
+    {
+        packet = frame_peek_packet(frame, sequence);
+        if (!packet)
+            continue;
+        packet_print_info(packet, NULL);
+        ++count;
+    }
     printf("]\n");
 }
 #endif
@@ -171,73 +371,369 @@ void
 frame_destroy(gpointer data)
 {
     frame_t *frame = NULL;
+    size_t   idx   = 0;
 
     g_return_if_fail(NULL != data);
 
     frame = (frame_t *)(data);
-    if (frame->packets)
-        g_queue_free_full(frame->packets, packet_destroy);
+    for (idx = 0; frame->slots && idx <= frame->mask; idx++)
+        g_clear_pointer(&(frame->slots[idx]), packet_destroy);
 
+    g_clear_pointer(&(frame->slots), g_free);
+    g_clear_pointer(&(frame->output), g_free);
     g_clear_pointer(&frame, g_free);
 }
 
-static void
-frame_order_packets(GQueue *packets)
+/* NOTE: head and tail are compared modulo 2^16, so a frame may straddle
+ * the sequence number wrap-around. The first/last unit flags always
+ * describe the packets currently at head and tail */
+static bool
+frame_store_packet(frame_t        *frame,
+                   const format_t *format,
+                   packet_t       *packet,
+                   bool           *duplicate)
 {
-    g_return_if_fail(NULL != packets);
+    uint16_t sequence = 0;
+    uint16_t head     = 0;
+    uint16_t tail     = 0;
 
-    g_queue_sort(packets, packet_compare_sequence, NULL);
+    g_return_val_if_fail(NULL != frame, false);
+    g_return_val_if_fail(NULL != format, false);
+    g_return_val_if_fail(NULL != packet, false);
+    g_return_val_if_fail(NULL != duplicate, false);
+
+    sequence = packet->sequence;
+    head = frame->head;
+    tail = frame->tail;
+
+    /* Composed packets are gone from the ring */
+    *duplicate = frame->composing &&
+        (int16_t)(sequence - frame->first) >= 0 &&
+        (int16_t)(sequence - frame->next) < 0;
+    if (*duplicate)
+        return true;
+
+    if (frame->count + frame->composed == 0)
+        head = tail = sequence;
+    else if ((int16_t)(sequence - head) < 0)
+        head = sequence;
+    else if ((int16_t)(sequence - tail) > 0)
+        tail = sequence;
+
+    if ((size_t)((uint16_t)(tail - head)) + 1 > frame->mask + 1 &&
+        !frame_resize_slots(frame, (uint16_t)(tail - head) + 1))
+        return false;
+
+    *duplicate = (NULL != frame->slots[sequence & frame->mask]);
+    if (*duplicate)
+        return true;
+
+    frame->slots[sequence & frame->mask] = packet;
+    if (frame->count + frame->composed == 0 || head != frame->head)
+        frame->first_unit = format->first_unit(packet->payload,
+                packet->payloadlen);
+    /* The marker bit ends a frame too, it is all VP8 has to tell */
+    if (frame->count + frame->composed == 0 || tail != frame->tail)
+        frame->last_unit = packet->marker || format->last_unit(
+                packet->payload, packet->payloadlen);
+    frame->head = head;
+    frame->tail = tail;
+    ++(frame->count);
+
+    return true;
 }
 
+static bool
+frame_resize_slots(frame_t *frame,
+                   size_t   span)
+{
+    packet_t **slots    = NULL;
+    packet_t  *packet   = NULL;
+    size_t     capacity = 0;
+    size_t     mask     = 0;
+    size_t     count    = 0;
+    uint16_t   sequence = 0;
+
+    g_return_val_if_fail(NULL != frame, false);
+    g_return_val_if_fail(FRAME_MAX_SLOTS >= span, false);
+
+    for (capacity = frame->mask + 1; capacity < span; capacity <<= 1);
+    slots = g_try_new0(packet_t *, capacity);
+    if (!slots)
+        return false;
+
+    mask = capacity - 1;
+    for (sequence = frame->head; count < frame->count; ++sequence)
+    {
+        packet = frame->slots[sequence & frame->mask];
+        if (!packet)
+            continue;
+        slots[sequence & mask] = packet;
+        ++count;
+    }
+
+    g_clear_pointer(&(frame->slots), g_free);
+    frame->slots = slots;
+    frame->mask = mask;
+
+    return true;
+}
+
+/* NOTE: duplicates never reach the slots, so the frame has no holes exactly
+ * when it holds as many packets as [head, tail] spans */
 static bool
 frame_check_completeness(frame_t *frame)
 {
-    packet_t       *head     = NULL;
-    packet_t       *tail     = NULL;
-    const format_t *format   = NULL;
-    uint32_t        sequence = 0;
-    bool            result   = false;
+    const format_t *format = NULL;
+    packet_t       *head   = NULL;
 
     g_return_val_if_fail(NULL != frame, false);
-    g_return_val_if_fail(NULL != frame->packets, false);
+    g_return_val_if_fail(NULL != frame->slots, false);
+
+    if (!frame->first_unit || !frame->last_unit)
+        return false;
+    if (frame->count + frame->composed !=
+        (size_t)((uint16_t)(frame->tail - frame->head)) + 1)
+        return false;
+    if (frame->count + frame->composed > 1)
+        return true;
 
     format = format_get_reassembly_context(frame->codec);
     g_return_val_if_fail(NULL != format, false);
-
-    head = (packet_t *)(g_queue_peek_head(frame->packets));
+    head = frame_peek_packet(frame, frame->head);
     g_return_val_if_fail(NULL != head, false);
-    g_return_val_if_fail(NULL != head->rtp, false);
-    tail = (packet_t *)(g_queue_peek_tail(frame->packets));
-    g_return_val_if_fail(NULL != tail, false);
-    g_return_val_if_fail(NULL != tail->rtp, false);
 
-    if (!format->first_unit(head->rtp->payload, head->length))
+    return !format->fragmented(head->payload, head->payloadlen);
+}
+
+/* NOTE: extends the composed run while the next packet is held. A run
+ * starts at a head packet that begins a unit; packets that later turn out
+ * to precede it are held and spliced in front when the frame is taken */
+static void
+frame_compose_packets(frame_t        *frame,
+                      const format_t *format)
+{
+    packet_t *packet = NULL;
+
+    g_return_if_fail(NULL != frame);
+    g_return_if_fail(NULL != format);
+
+    if (!frame->composing)
+    {
+        if (!frame->first_unit)
+            return;
+        frame->composing = true;
+        frame->first = frame->next = frame->head;
+    }
+
+    /* Slots are only meaningful within [head, tail], past it they alias */
+    while ((int16_t)(frame->tail - frame->next) >= 0 &&
+           (packet = frame_peek_packet(frame, frame->next)))
+    {
+        frame->slots[frame->next & frame->mask] = NULL;
+        --(frame->count);
+        ++(frame->next);
+
+        /* A packet that fails to compose is lost like a dropped one */
+        if (frame_compose_packet(frame, format, packet, true))
+            ++(frame->composed);
+        else
+        {
+            frame->completed = false;
+            frame->rejected = true;
+        }
+        g_clear_pointer(&packet, packet_destroy);
+    }
+}
+
+static bool
+frame_compose_packet(frame_t        *frame,
+                     const format_t *format,
+                     packet_t       *packet,
+                     bool            completed)
+{
+    const uint8_t *payload = NULL;
+    uint8_t       *index   = NULL;
+    size_t         length  = 0;
+    size_t         size    = 0;
+
+    g_return_val_if_fail(NULL != frame, false);
+    g_return_val_if_fail(NULL != format, false);
+    g_return_val_if_fail(NULL != packet, false);
+
+    if (!packet_get_payload(packet, &payload, &length) || !payload ||
+        length <= 0)
         return false;
-    if (!format->last_unit(tail->rtp->payload, tail->length))
+
+    size = format->measure(payload, length, frame->prefix);
+    if (size == 0 || !frame_reserve_output(frame, frame->outlen + size))
         return false;
-    if (head == tail)
-        return !format->fragmented(head->rtp->payload, head->length);
-    g_queue_foreach(frame->packets, frame_foreach_packet, &sequence);
-    result = ntohs((tail->rtp->header).sequence) == sequence;
 
-    return result;
+    index = frame->output + frame->outlen;
+    if (!format->reassemble(&index, &(frame->outlen),
+                frame->output + frame->outcap, frame->prefix, payload,
+                length, completed, &(frame->context)))
+        return false;
+
+    return true;
 }
 
-static void
-frame_foreach_packet(gpointer data,
-                     gpointer userdata)
+/* NOTE: composes what is still held as frame_reassemble() would: packets
+ * past gaps are appended, packets before the run are composed apart and
+ * spliced in front. Units left open at a gap are concealed */
+static bool
+frame_finish_output(frame_t        *frame,
+                    const format_t *format)
 {
     packet_t *packet   = NULL;
-    uint16_t *prevseq  = 0;
+    uint8_t  *output   = NULL;
+    size_t    outlen   = 0;
     uint16_t  sequence = 0;
 
-    g_return_if_fail(NULL != data);
-    g_return_if_fail(NULL != userdata);
+    g_return_val_if_fail(NULL != frame, false);
+    g_return_val_if_fail(NULL != format, false);
+
+    if (!frame->composing)
+    {
+        frame->composing = true;
+        frame->first = frame->next = frame->head;
+    }
+
+    if (!frame->completed && frame->outlen > 0)
+        format->conceal(frame->output, frame->outlen, false,
+                &(frame->context));
+    for (sequence = frame->next; (int16_t)(frame->tail - sequence) >= 0 &&
+         frame->count > 0; ++sequence)
+    {
+        packet = frame_peek_packet(frame, sequence);
+        if (!packet)
+            continue;
+        frame->slots[sequence & frame->mask] = NULL;
+        --(frame->count);
+        frame->next = sequence + 1;
+
+        if (frame_compose_packet(frame, format, packet, frame->completed))
+            ++(frame->composed);
+        else
+            frame->rejected = true;
+        g_clear_pointer(&packet, packet_destroy);
+    }
+    if (!frame->completed && frame->outlen > 0)
+        format->conceal(frame->output, frame->outlen, true,
+                &(frame->context));
+
+    if (frame->count == 0)
+        return frame->outlen > 0;
+
+    /* Whatever is left precedes the run */
+    output = frame->output;
+    outlen = frame->outlen;
+    frame->output = NULL;
+    frame->outlen = frame->outcap = 0;
+    for (sequence = frame->head; frame->count > 0; ++sequence)
+    {
+        packet = frame_peek_packet(frame, sequence);
+        if (!packet)
+            continue;
+        frame->slots[sequence & frame->mask] = NULL;
+        --(frame->count);
+
+        if (frame_compose_packet(frame, format, packet, frame->completed))
+            ++(frame->composed);
+        else
+            frame->rejected = true;
+        g_clear_pointer(&packet, packet_destroy);
+    }
+    if (!frame->completed && frame->outlen > 0)
+        format->conceal(frame->output, frame->outlen, true,
+                &(frame->context));
+
+    if (outlen > 0 && frame_reserve_output(frame, frame->outlen + outlen))
+    {
+        memcpy(frame->output + frame->outlen, output, outlen);
+        frame->outlen += outlen;
+    }
+    g_clear_pointer(&output, g_free);
+
+    return frame->outlen > 0;
+}
+
+/* NOTE: hands the output over by swapping buffers with a media_t that owns
+ * its buffer (capacity set), and copies into caller-provided ones */
+static bool
+frame_take_output(frame_t        *frame,
+                  const format_t *format,
+                  media_t        *media,
+                  void           *data)
+{
+    uint8_t *buffer   = NULL;
+    size_t   capacity = 0;
+
+    g_return_val_if_fail(NULL != frame, false);
+    g_return_val_if_fail(NULL != format, false);
+    g_return_val_if_fail(NULL != media, false);
+    g_return_val_if_fail(NULL != data, false);
+    g_return_val_if_fail(media->prefix == frame->prefix, false);
+
+    if (!frame_finish_output(frame, format))
+        return false;
 
-    packet = (packet_t *)(data);
-    prevseq = (uint16_t *)(userdata);
-    sequence = ntohs((packet->rtp->header).sequence);
-    if (*prevseq == sequence - 1 || *prevseq == 0)
-        *prevseq = sequence;
+    if (media->capacity > 0)
+    {
+        buffer = media->buffer;
+        capacity = media->capacity;
+        media->buffer = frame->output;
+        media->capacity = frame->outcap;
+        media->length = frame->outlen;
+        frame->output = buffer;
+        frame->outcap = capacity;
+        frame->outlen = 0;
+    }
+    else
+    {
+        g_return_val_if_fail(frame->outlen <= media->length, false);
+        memcpy(media->buffer, frame->output, frame->outlen);
+        media->length = frame->outlen;
+    }
+
+    format->merge(data, &(frame->context));
+    media->head_seq = frame->head;
+    media->tail_seq = frame->tail;
+    media->is_audio = (frame->codec == CODEC_OPUS);
+    media->type = format->frame_type(media->buffer, media->length);
+    media->created_us = frame->created_us;
+    media->rtptime = frame->timestamp;
+
+    return true;
 }
 
+static bool
+frame_reserve_output(frame_t *frame,
+                     size_t   size)
+{
+    uint8_t *output   = NULL;
+    size_t   capacity = 0;
+
+    g_return_val_if_fail(NULL != frame, false);
+
+    if (size <= frame->outcap)
+        return true;
+
+    for (capacity = MAX(frame->outcap, FRAME_MIN_OUTPUT); capacity < size;
+         capacity <<= 1);
+    output = g_try_realloc(frame->output, capacity);
+    if (!output)
+        return false;
+
+    frame->output = output;
+    frame->outcap = capacity;
+
+    return true;
+}
+
+static inline packet_t *
+frame_peek_packet(const frame_t *frame,
+                  uint16_t       sequence)
+{
+    return frame->slots[sequence & frame->mask];
+}
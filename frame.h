@@ -21,22 +21,64 @@ extern "C"
 {
 #endif
 
+    #define FRAME_MIN_SLOTS 8
+    #define FRAME_MAX_SLOTS 32768
+    #define FRAME_MIN_OUTPUT 4096
+
+    /* Packets are held in a ring indexed by (sequence & mask) which grows to
+     * cover [head, tail], so insertion is O(1) and a walk from head to tail
+     * visits them in sequence order. first_unit and last_unit tell whether
+     * the packets at head and tail start and end the frame, which together
+     * with count keeps completeness up to date as packets arrive.
+     *
+     * With an output buffer set, packets are composed into it as soon as
+     * they continue the run [first, next) and are freed right away, composed
+     * counts them. Packets past a gap stay in the ring until it fills */
     typedef struct frame_t
     {
-        GQueue   *packets;
-        codec_t   codec;
-        gint64    created_us;
-        uint32_t  timestamp;
-        bool      marker;
-        bool      completed;
-        size_t    unitcount;
+        packet_t **slots;
+        size_t     mask;
+        size_t     count;
+        uint16_t   head;
+        uint16_t   tail;
+        bool       first_unit;
+        bool       last_unit;
+        codec_t    codec;
+        gint64     created_us;
+        gint64     expire_us;
+        GList      link;
+        uint32_t   timestamp;
+        gint64     extended;
+        guint64    order;
+        bool       marker;
+        bool       completed;
+        size_t     unitcount;
+        bool       incremental;
+        prefix_t   prefix;
+        uint8_t   *output;
+        size_t     outlen;
+        size_t     outcap;
+        bool       composing;
+        uint16_t   first;
+        uint16_t   next;
+        size_t     composed;
+        bool       rejected;
+        context_t  context;
 
     } frame_t;
 
-    frame_t *frame_create(uint32_t timestamp, codec_t codec);
-    bool frame_add_packet(frame_t *frame, packet_t *packet, bool *completed);
+    frame_t *frame_create(uint32_t timestamp, codec_t codec,
+            gint64 created_us);
+    bool frame_set_output(frame_t *frame, prefix_t prefix,
+            const context_t *context, uint8_t *buffer, size_t capacity);
+    bool frame_add_packet(frame_t *frame, packet_t *packet, bool *completed,
+            bool *duplicate);
+    bool frame_end_at_tail(frame_t *frame);
+    bool frame_measure(const frame_t *frame, prefix_t prefix, size_t *size);
     bool frame_reassemble(frame_t *frame, media_t *media, bool completed,
             void *data);
+    bool frame_scatter(frame_t *frame, media_vector_t *vector,
+            bool completed, void *data);
     void frame_destroy(gpointer data);
 
 #ifdef DEBUG
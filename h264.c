@@ -7,12 +7,14 @@
 
 #include <arpa/inet.h>
 #include <glib.h>
-#include <math.h>
 #include <stdio.h>
 #include <string.h>
 
+#include "bitstream.h"
 #include "format.h"
 #include "h264.h"
+#include "media.h"
+#include "scan.h"
 
 // #define DEBUG
 #define INLINE inline
@@ -23,10 +25,11 @@ static INLINE bool h264_compose_single_nalu(uint8_t **index, size_t *length,
         size_t nalulen);
 static INLINE bool h264_compose_aggregation_unit(uint8_t **index,
         size_t *length, const uint8_t *limit, prefix_t prefix,
-        const uint8_t *naluptr, size_t nalulen);
+        const uint8_t *naluptr, size_t nalulen, h264_context_t *context);
 static INLINE bool h264_compose_fragmentation_unit(uint8_t **index,
         size_t *length, const uint8_t *limit, prefix_t prefix,
-        const uint8_t *naluptr, size_t nalulen, bool completed);
+        const uint8_t *naluptr, size_t nalulen, bool completed,
+        h264_context_t *context);
 static INLINE bool h264_compose_timestamp_sei_nalu(uint8_t **index,
         size_t *length, const uint8_t *limit, prefix_t prefix);
 static INLINE bool h264_compose_prefix(uint8_t **index, size_t *length,
@@ -35,21 +38,44 @@ static INLINE bool h264_compose_start_code(uint8_t **index,
         size_t *length, const uint8_t *limit);
 static INLINE bool h264_compose_avcc_prefix(uint8_t **index,
         size_t *length, const uint8_t *limit, size_t nalulen);
+static INLINE bool h264_scatter_single_nalu(media_vector_t *vector,
+        prefix_t prefix, const uint8_t *naluptr, size_t nalulen,
+        h264_context_t *context);
+static INLINE bool h264_scatter_aggregation_unit(media_vector_t *vector,
+        prefix_t prefix, const uint8_t *naluptr, size_t nalulen,
+        h264_context_t *context);
+static INLINE bool h264_scatter_fragmentation_unit(media_vector_t *vector,
+        prefix_t prefix, const uint8_t *naluptr, size_t nalulen,
+        bool completed, h264_context_t *context);
+static INLINE bool h264_scatter_prefix(media_vector_t *vector,
+        prefix_t prefix, size_t nalulen);
 static INLINE uint8_t h264_get_nal_ref_idc(uint8_t nal_unit_type);
+static INLINE bool h264_decode_context(uint8_t *nalu, size_t nalulen,
+        h264_context_t *context);
 static INLINE bool h264_decode_slice_header(const uint8_t *nalu,
         size_t length, h264_context_t *context);
 static INLINE void h264_print_slice_header(const h264_context_t *context);
-static INLINE bool h264_decode_sps(uint8_t *nalu, size_t length,
+static INLINE bool h264_update_sps(uint8_t *nalu, size_t length,
         h264_context_t *context);
+static INLINE bool h264_decode_sps(const uint8_t *rbsp, size_t length,
+        h264_context_t *context, size_t *gaps_offset);
+static INLINE bool h264_decode_vui(bitstream_t *reader,
+        h264_context_t *context);
+static INLINE void h264_skip_hrd_parameters(bitstream_t *reader);
+static INLINE bool h264_derive_sps(h264_context_t *context);
+static INLINE uint32_t h264_get_max_dpb_mbs(const h264_context_t *context);
+static INLINE size_t h264_map_rbsp_offset(const uint8_t *nalu,
+        size_t length, size_t offset);
+static INLINE void h264_restore_sps(h264_context_t *context,
+        const h264_context_t *sps);
+static INLINE void h264_skip_scaling_list(bitstream_t *reader, size_t size);
+static INLINE bool h264_is_high_profile(uint8_t profile_idc);
 static INLINE void h264_print_sps(const h264_context_t *context);
-static INLINE uint32_t h264_decode_uexpgolomb(const uint8_t *bitstream,
-        size_t *offset);
-static INLINE uint32_t h264_decode_sexpgolomb(const uint8_t *bitstream,
-        size_t *offset);
-static INLINE uint32_t h264_get_bits(const uint8_t *bitstream, size_t *offset,
-        size_t count);
-static INLINE uint32_t h264_get_bit(const uint8_t *bitstream, size_t offset);
-static INLINE void h264_set_bit(uint8_t *bitstream, size_t offset);
+static INLINE bool h264_update_pps(const uint8_t *nalu, size_t length,
+        h264_context_t *context);
+static bool h264_build_parameter_sets(h264_parameter_sets_t *sets);
+static INLINE void h264_set_bit(uint8_t *bitstream, size_t length,
+        size_t offset);
 static INLINE void h264_print_octets(const uint8_t *base, size_t length);
 
  /* 7627DFE0-4924-4084-B98D-F2C9444B8E98 */
@@ -82,11 +108,17 @@ h264_reassemble_frame(uint8_t       **index,
     g_return_val_if_fail(NULL != data, NULL);
     g_return_val_if_fail(1 < size,  NULL);
 
-    start = *index + sizeof(uint32_t);
+    start = *index + ((prefix == PREFIX_NONE) ? 0 : sizeof(uint32_t));
     context = (h264_context_t *)(data);
 
-    /* Reassemble frame here */
+    /* Reassemble frame here. Any unit but an FU closes the FU still open,
+     * its end was lost, so its length is not patched into what follows */
     naluptr = (h264_nalu_header_t *)(payload);
+    if (naluptr->nal_unit_type != 28 && naluptr->nal_unit_type != 29)
+    {
+        context->fu_length = 0;
+        context->fu_zeros = 0;
+    }
     switch (naluptr->nal_unit_type)
     {
         case 1:  /* Single unit inter-frame (P-frame) */
@@ -95,44 +127,26 @@ h264_reassemble_frame(uint8_t       **index,
         case 7:  /* Single unit SPS */
         case 8:  /* Single unit PPS */
             result = h264_compose_single_nalu(index, length, limit, prefix,
-                    (const uint8_t *)(naluptr), nalulen); break;
+                    (const uint8_t *)(naluptr), nalulen) &&
+                h264_decode_context(start, nalulen, context);
+            break;
         case 24: /* Single time aggregation packet A (SPS + PPS) */
         case 25: /* Single time aggregation packet B (DON + SPS + PPS) */
         case 26: /* Multi-time aggregation packet A */
         case 27: /* Multi-time aggregation packet B */
             result = h264_compose_aggregation_unit(index, length, limit,
-                    prefix, (const uint8_t *)(naluptr), nalulen); break;
+                    prefix, (const uint8_t *)(naluptr), nalulen, context);
+            break;
         case 28: /* Fragmentation unit A */
         case 29: /* Fragmentation unit B */
             result = h264_compose_fragmentation_unit(index, length, limit,
                     prefix, (const uint8_t *)(naluptr), nalulen,
-                    completed); break;
+                    completed, context); break;
         default:
-            fprintf(stderr, "Unsupported NAL type [%u]\n",
-                    naluptr->nal_unit_type);
+            /* Counted as frames_rejected by the depacketizer */
             result = false;
     }
 
-    g_return_val_if_fail(result, false);
-
-    /* Parse H.264 context here */
-    naluptr = (h264_nalu_header_t *)(start);
-    if (h264_is_first_nalu(payload, *length))
-    {
-        switch (naluptr->nal_unit_type)
-        {
-            /* Get slice header information */
-            case 1:  /* Single unit inter-frame (P-frame) */
-            case 5:  /* Single unit intra-frame (I-frame) */
-                result = h264_decode_slice_header(start, *length,
-                        context); break;
-            /* Get SPS information */
-            case 7:  /* Single unit SPS */
-                result = h264_decode_sps(start, *length, context); break;
-            default: break;
-        }
-    }
-
     return result;
 }
 
@@ -272,6 +286,264 @@ h264_is_last_nalu(const uint8_t *naluptr,
     return last;
 }
 
+/* NOTE: returns the bytes the reassembled form of this RTP payload takes,
+ * prefixes and timestamp SEI included, or 0 for payloads that cannot be
+ * reassembled; mirrors the h264_compose_*() functions below */
+size_t
+h264_measure_nalu(const uint8_t *naluptr,
+                  size_t         nalulen,
+                  prefix_t       prefix)
+{
+    h264_nalu_header_t *naluhdr  = NULL;
+    h264_fu_header_t   *fuhdr    = NULL;
+    const uint8_t      *aulenptr = NULL;
+    const uint8_t      *auptr    = NULL;
+    uint16_t            aulen    = 0;
+    size_t              hdrlen   = 0;
+    size_t              size     = 0;
+
+    g_return_val_if_fail(NULL != naluptr, 0);
+    g_return_val_if_fail(1 < nalulen, 0);
+
+    hdrlen = (prefix == PREFIX_NONE) ? 0 : sizeof(uint32_t);
+    naluhdr = (h264_nalu_header_t *)(naluptr);
+    switch (naluhdr->nal_unit_type)
+    {
+        case 1:  /* Single unit inter-frame (P-frame) */
+        case 5:  /* Single unit intra-frame (I-frame) */
+        case 6:  /* Supplemental enhancement information */
+        case 7:  /* Single unit SPS */
+        case 8:  /* Single unit PPS */
+            size = hdrlen + nalulen; break;
+        case 24: /* Single time aggregation packet A (SPS + PPS) */
+        case 25: /* Single time aggregation packet B (DON + SPS + PPS) */
+        case 26: /* Multi-time aggregation packet A */
+        case 27: /* Multi-time aggregation packet B */
+            for (aulenptr = naluptr + sizeof(uint8_t),
+                 auptr = aulenptr + sizeof(uint16_t);
+                 aulenptr < naluptr + nalulen && auptr < naluptr + nalulen;
+                 aulenptr += sizeof(uint16_t) + aulen,
+                 auptr = aulenptr + sizeof(uint16_t))
+            {
+                aulen = (aulenptr[0] << 8) | aulenptr[1];
+                if (auptr + aulen > naluptr + nalulen)
+                    return 0;
+                size += hdrlen + aulen;
+#ifdef ADD_TIMESTAMP_USERDATA_SEI
+                if (((h264_nalu_header_t *)(auptr))->nal_unit_type == 0x08)
+                    size += hdrlen + 1 + 1 + 1 + sizeof(time_sync_uuid) +
+                        sizeof(uint64_t) + 1;
+#endif
+            }
+            break;
+        case 28: /* Fragmentation unit A */
+        case 29: /* Fragmentation unit B */
+            fuhdr = (h264_fu_header_t *)(naluptr + sizeof(*naluhdr));
+            size = nalulen - sizeof(*naluhdr) - sizeof(*fuhdr);
+            if (fuhdr->start)
+                size += hdrlen + sizeof(*naluhdr);
+            break;
+        default:
+            size = 0;
+    }
+
+    return size;
+}
+
+/* NOTE: flags the NALU still being defragmented at the end of output as
+ * damaged, for frames with fragments missing. Later fragments still extend
+ * it unless closing, which also forgets it */
+void
+h264_conceal_nalu(uint8_t *output,
+                  size_t   length,
+                  bool     closing,
+                  void    *data)
+{
+    h264_context_t     *context = NULL;
+    h264_nalu_header_t *naluhdr = NULL;
+
+    g_return_if_fail(NULL != output);
+    g_return_if_fail(NULL != data);
+
+    context = (h264_context_t *)(data);
+    if (context->fu_length > 0 && context->fu_length <= length)
+    {
+        naluhdr = (h264_nalu_header_t *)(output + length -
+                context->fu_length);
+        naluhdr->forbidden = 1;
+    }
+    if (closing)
+    {
+        context->fu_length = 0;
+        context->fu_zeros = 0;
+    }
+}
+
+/* NOTE: same output as h264_reassemble_frame(), but payload bytes are only
+ * referenced by the vector; SPS are still copied, decoding patches them */
+bool
+h264_scatter_frame(media_vector_t *vector,
+                   prefix_t        prefix,
+                   const uint8_t  *payload,
+                   size_t          size,
+                   bool            completed,
+                   void           *data)
+{
+    h264_nalu_header_t *naluhdr = NULL;
+    h264_context_t     *context = NULL;
+    bool                result  = false;
+
+    g_return_val_if_fail(NULL != vector, false);
+    g_return_val_if_fail(NULL != payload, false);
+    g_return_val_if_fail(NULL != data, false);
+    g_return_val_if_fail(1 < size, false);
+
+    context = (h264_context_t *)(data);
+    naluhdr = (h264_nalu_header_t *)(payload);
+    if (naluhdr->nal_unit_type != 28 && naluhdr->nal_unit_type != 29)
+    {
+        context->fu_length = 0;
+        context->fu_zeros = 0;
+    }
+    switch (naluhdr->nal_unit_type)
+    {
+        case 1:  /* Single unit inter-frame (P-frame) */
+        case 5:  /* Single unit intra-frame (I-frame) */
+        case 6:  /* Supplemental enhancement information */
+        case 7:  /* Single unit SPS */
+        case 8:  /* Single unit PPS */
+            result = h264_scatter_single_nalu(vector, prefix, payload, size,
+                    context); break;
+        case 24: /* Single time aggregation packet A (SPS + PPS) */
+        case 25: /* Single time aggregation packet B (DON + SPS + PPS) */
+        case 26: /* Multi-time aggregation packet A */
+        case 27: /* Multi-time aggregation packet B */
+            result = h264_scatter_aggregation_unit(vector, prefix, payload,
+                    size, context); break;
+        case 28: /* Fragmentation unit A */
+        case 29: /* Fragmentation unit B */
+            result = h264_scatter_fragmentation_unit(vector, prefix, payload,
+                    size, completed, context); break;
+        default:
+            result = false;
+    }
+
+    return result;
+}
+
+/* NOTE: folds the context of an incrementally composed frame, decoded
+ * from a copy of data taken when the frame was created, back into data.
+ * The NALU and slice headers are the frame's. SPS fields are taken again
+ * from the cache through the slice's PPS, so a set another frame decoded
+ * in the meantime is not rolled back, and data keeps its reassembly state */
+void
+h264_merge_context(void       *data,
+                   const void *frame)
+{
+    h264_context_t        *context = NULL;
+    const h264_context_t  *decoded = NULL;
+    h264_parameter_sets_t *sets    = NULL;
+    h264_context_t         merged;
+    uint8_t                pps_id  = 0;
+    uint8_t                sps_id  = 0;
+
+    g_return_if_fail(NULL != data);
+    g_return_if_fail(NULL != frame);
+
+    context = (h264_context_t *)(data);
+    decoded = (const h264_context_t *)(frame);
+    sets = context->parameter_sets;
+    pps_id = decoded->pic_parameter_set_id;
+    sps_id = sets ? sets->pps_sps_id[pps_id] : 0;
+
+    merged = *decoded;
+    if (sets && sets->pps[pps_id] && sets->sps[sps_id].received)
+        h264_restore_sps(&merged, &(sets->sps[sps_id].decoded));
+    else if ((gint32)(decoded->generation - context->generation) < 0)
+        h264_restore_sps(&merged, context);
+    merged.forbidden_zero_bit = decoded->forbidden_zero_bit;
+    merged.nal_ref_idc = decoded->nal_ref_idc;
+    merged.nal_unit_type = decoded->nal_unit_type;
+    merged.fu_offset = context->fu_offset;
+    merged.fu_length = context->fu_length;
+    merged.fu_zeros = context->fu_zeros;
+    merged.parameter_sets = sets;
+    if (sets)
+        merged.generation = sets->generation;
+    *context = merged;
+}
+
+h264_parameter_sets_t *
+h264_parameter_sets_create(void)
+{
+    return g_try_new0(h264_parameter_sets_t, 1);
+}
+
+/* NOTE: the record covers every SPS and PPS seen, with 4-byte NALU lengths.
+ * It stays valid until the next call after generation has moved */
+bool
+h264_parameter_sets_get_avcc(h264_parameter_sets_t  *sets,
+                             const uint8_t         **data,
+                             size_t                 *length)
+{
+    g_return_val_if_fail(NULL != sets, false);
+    g_return_val_if_fail(NULL != data, false);
+    g_return_val_if_fail(NULL != length, false);
+
+    if (!h264_build_parameter_sets(sets))
+        return false;
+
+    *data = sets->avcc->data;
+    *length = sets->avcc->len;
+
+    return true;
+}
+
+/* NOTE: every SPS then every PPS, each behind a 4-byte start code */
+bool
+h264_parameter_sets_get_annexb(h264_parameter_sets_t  *sets,
+                               const uint8_t         **data,
+                               size_t                 *length)
+{
+    g_return_val_if_fail(NULL != sets, false);
+    g_return_val_if_fail(NULL != data, false);
+    g_return_val_if_fail(NULL != length, false);
+
+    if (!h264_build_parameter_sets(sets))
+        return false;
+
+    *data = sets->annexb->data;
+    *length = sets->annexb->len;
+
+    return true;
+}
+
+void
+h264_parameter_sets_destroy(gpointer data)
+{
+    h264_parameter_sets_t *sets = NULL;
+    size_t                 id   = 0;
+
+    g_return_if_fail(NULL != data);
+
+    sets = (h264_parameter_sets_t *)(data);
+    for (id = 0; id < H264_MAX_SPS_COUNT; id++)
+    {
+        if (sets->sps[id].received)
+            g_byte_array_free(sets->sps[id].received, TRUE);
+        if (sets->sps[id].emitted)
+            g_byte_array_free(sets->sps[id].emitted, TRUE);
+    }
+    for (id = 0; id < H264_MAX_PPS_COUNT; id++)
+        if (sets->pps[id])
+            g_byte_array_free(sets->pps[id], TRUE);
+    if (sets->avcc)
+        g_byte_array_free(sets->avcc, TRUE);
+    if (sets->annexb)
+        g_byte_array_free(sets->annexb, TRUE);
+    g_clear_pointer(&sets, g_free);
+}
+
 static INLINE bool
 h264_compose_single_nalu(uint8_t       **index,
                          size_t         *length,
@@ -280,7 +552,8 @@ h264_compose_single_nalu(uint8_t       **index,
                          const uint8_t  *naluptr,
                          size_t          nalulen)
 {
-    bool result = false;
+    uint8_t zeros  = 0;
+    bool    result = false;
 
     g_return_val_if_fail(NULL != index, NULL);
     g_return_val_if_fail(NULL != *index, NULL);
@@ -288,9 +561,12 @@ h264_compose_single_nalu(uint8_t       **index,
     g_return_val_if_fail(NULL != limit, NULL);
     g_return_val_if_fail(NULL != naluptr, NULL);
 
+    if (prefix == PREFIX_ANNEXB && !scan_validate_payload(naluptr, nalulen,
+                &zeros))
+        return false;
     result = h264_compose_prefix(index, length, limit, prefix, nalulen);
     g_return_val_if_fail(result, false);
-    g_return_val_if_fail(*index + nalulen < limit, false);
+    g_return_val_if_fail(*index + nalulen <= limit, false);
     memcpy(*index, naluptr, nalulen);
     *index += nalulen;
     *length += nalulen;
@@ -304,12 +580,14 @@ h264_compose_aggregation_unit(uint8_t       **index,
                               const uint8_t  *limit,
                               prefix_t        prefix,
                               const uint8_t  *naluptr,
-                              size_t          nalulen)
+                              size_t          nalulen,
+                              h264_context_t *context)
 {
     h264_nalu_header_t *naluhdr  = NULL;
     const uint8_t      *auptr    = NULL;
     uint16_t            aulen    = 0;
     const uint8_t      *aulenptr = NULL;
+    uint8_t             zeros    = 0;
     bool                result   = false;
 
     g_return_val_if_fail(NULL != index, NULL);
@@ -317,6 +595,7 @@ h264_compose_aggregation_unit(uint8_t       **index,
     g_return_val_if_fail(NULL != length, NULL);
     g_return_val_if_fail(NULL != limit, NULL);
     g_return_val_if_fail(NULL != naluptr, NULL);
+    g_return_val_if_fail(NULL != context, NULL);
 
     for (aulenptr = naluptr + sizeof(uint8_t),
          auptr = aulenptr + sizeof(uint16_t);
@@ -325,13 +604,20 @@ h264_compose_aggregation_unit(uint8_t       **index,
          auptr = aulenptr + sizeof(uint16_t))
     {
         naluhdr = (h264_nalu_header_t *)(auptr);
-        aulen = ntohs(*(uint16_t *)(aulenptr));
+        aulen = (aulenptr[0] << 8) | aulenptr[1];
+        g_return_val_if_fail(auptr + aulen <= naluptr + nalulen, false);
+        zeros = 0;
+        if (prefix == PREFIX_ANNEXB &&
+            !scan_validate_payload(auptr, aulen, &zeros))
+            return false;
         result = h264_compose_prefix(index, length, limit, prefix, aulen);
         g_return_val_if_fail(result, false);
-        g_return_val_if_fail(*index + aulen < limit, false);
+        g_return_val_if_fail(*index + aulen <= limit, false);
         memcpy(*index, auptr, aulen);
         *index += aulen;
         *length += aulen;
+        if (aulen > 0)
+            h264_decode_context(*index - aulen, aulen, context);
 #ifdef ADD_TIMESTAMP_USERDATA_SEI
         /* Add an user unregistered SEI messsage containing
          * the system timestamp if we encounter end of PPS */
@@ -354,11 +640,14 @@ h264_compose_fragmentation_unit(uint8_t       **index,
                                 prefix_t        prefix,
                                 const uint8_t  *naluptr,
                                 size_t          nalulen,
-                                bool            completed)
+                                bool            completed,
+                                h264_context_t *context)
 {
     h264_fu_header_t   *fuhdr   = NULL;
     h264_nalu_header_t *naluhdr = NULL;
     size_t              hdrlen  = 0;
+    uint32_t            avcclen = 0;
+    uint8_t             zeros   = 0;
     bool                result  = false;
 
     g_return_val_if_fail(NULL != index, NULL);
@@ -366,13 +655,26 @@ h264_compose_fragmentation_unit(uint8_t       **index,
     g_return_val_if_fail(NULL != length, NULL);
     g_return_val_if_fail(NULL != limit, NULL);
     g_return_val_if_fail(NULL != naluptr, NULL);
+    g_return_val_if_fail(NULL != context, NULL);
 
+    hdrlen = sizeof(h264_nalu_header_t) + sizeof(h264_fu_header_t);
+    g_return_val_if_fail(hdrlen <= nalulen, false);
+
+    /* NOTE: the AVCC length of a fragmented NALU is only known once all of
+     * it is in, fu_length counts the bytes written since its rebuilt header
+     * so the prefix is found relative to *index even if the buffer moved */
     fuhdr = (h264_fu_header_t *)(naluptr + sizeof(h264_nalu_header_t));
+    zeros = fuhdr->start ? 0 : context->fu_zeros;
+    if (prefix == PREFIX_ANNEXB && !scan_validate_payload(naluptr + hdrlen,
+                nalulen - hdrlen, &zeros))
+        return false;
+    context->fu_zeros = zeros;
     if (fuhdr->start)
     {
         result = h264_compose_prefix(index, length, limit, prefix, nalulen);
         g_return_val_if_fail(result, false);
-        g_return_val_if_fail(*index + 1 < limit, false);
+        context->fu_length = sizeof(h264_nalu_header_t);
+        g_return_val_if_fail(*index + 1 <= limit, false);
         naluhdr = (h264_nalu_header_t *)(*index);
         naluhdr->forbidden = !completed;
         naluhdr->nal_unit_type = fuhdr->type;
@@ -381,11 +683,27 @@ h264_compose_fragmentation_unit(uint8_t       **index,
         *length += sizeof(h264_nalu_header_t);
     }
 
-    hdrlen = sizeof(h264_nalu_header_t) + sizeof(h264_fu_header_t);
-    g_return_val_if_fail(*index + (nalulen - hdrlen) < limit, false);
+    g_return_val_if_fail(*index + (nalulen - hdrlen) <= limit, false);
     memcpy(*index, naluptr + hdrlen, nalulen - hdrlen);
     *index += nalulen - hdrlen;
     *length += nalulen - hdrlen;
+    /* The slice header sits right after the rebuilt NALU header */
+    if (naluhdr && (fuhdr->type == 1 || fuhdr->type == 5))
+        h264_decode_context((uint8_t *)(naluhdr),
+                *index - (uint8_t *)(naluhdr), context);
+    if (context->fu_length > 0)
+        context->fu_length += nalulen - hdrlen;
+    if (context->fu_length > 0 && prefix == PREFIX_AVCC)
+    {
+        avcclen = htonl(context->fu_length);
+        memcpy(*index - context->fu_length - sizeof(avcclen), &avcclen,
+                sizeof(avcclen));
+    }
+    if (fuhdr->end)
+    {
+        context->fu_length = 0;
+        context->fu_zeros = 0;
+    }
 
     return true;
 }
@@ -411,32 +729,32 @@ h264_compose_timestamp_sei_nalu(uint8_t       **index,
     g_return_val_if_fail(result, false);
 
     /* SEI NALU header, user unregistered type, and payload size */
-    g_return_val_if_fail(*index + 1 < limit, false);
+    g_return_val_if_fail(*index + 1 <= limit, false);
     **index = 0x06;
     ++(*index);
-    g_return_val_if_fail(*index + 1 < limit, false);
+    g_return_val_if_fail(*index + 1 <= limit, false);
     **index = 0x05;
     ++(*index);
-    g_return_val_if_fail(*index + 1 < limit, false);
+    g_return_val_if_fail(*index + 1 <= limit, false);
     **index = sizeof(time_sync_uuid) + sizeof(timestamp);
     ++(*index);
     *length += 3;
 
     /* UUID */
-    g_return_val_if_fail(*index + sizeof(time_sync_uuid) < limit, false);
+    g_return_val_if_fail(*index + sizeof(time_sync_uuid) <= limit, false);
     memcpy(*index, time_sync_uuid, sizeof(time_sync_uuid));
     *index += sizeof(time_sync_uuid);
     *length += sizeof(time_sync_uuid);
 
     /* 64-bit timestamp, microseconds since 01/01/1970 */
     timestamp = GUINT64_TO_BE((uint64_t)(g_get_real_time()));
-    g_return_val_if_fail(*index + sizeof(timestamp) < limit, false);
+    g_return_val_if_fail(*index + sizeof(timestamp) <= limit, false);
     memcpy(*index, &timestamp, sizeof(timestamp));
     *index += sizeof(timestamp);
     *length += sizeof(timestamp);
 
     /* Padding */
-    g_return_val_if_fail(*index + 1 < limit, false);
+    g_return_val_if_fail(*index + 1 <= limit, false);
     **index = 0xFF;
     ++(*index);
     ++(*length);
@@ -479,13 +797,15 @@ h264_compose_start_code(uint8_t       **index,
                         size_t         *length,
                         const uint8_t  *limit)
 {
+    static const uint8_t start_code[] = {0x00, 0x00, 0x00, 0x01};
+
     g_return_val_if_fail(NULL != index, false);
     g_return_val_if_fail(NULL != *index, false);
     g_return_val_if_fail(NULL != length, false);
     g_return_val_if_fail(NULL != limit, NULL);
 
-    g_return_val_if_fail(*index + 4 < limit, false);
-    *(uint32_t *)(*index) = htonl(0x00000001);
+    g_return_val_if_fail(*index + 4 <= limit, false);
+    memcpy(*index, start_code, sizeof(start_code));
     *index += sizeof(uint32_t);
     *length += sizeof(uint32_t);
 
@@ -498,22 +818,213 @@ h264_compose_avcc_prefix(uint8_t       **index,
                          const uint8_t  *limit,
                          size_t          nalulen)
 {
-    uint32_t *prefix = NULL;
+    uint32_t prefix = 0;
 
     g_return_val_if_fail(NULL != index, false);
     g_return_val_if_fail(NULL != *index, false);
     g_return_val_if_fail(NULL != length, false);
     g_return_val_if_fail(NULL != limit, NULL);
 
-    g_return_val_if_fail(*index + 4 < limit, false);
-    prefix = (uint32_t *)(*index);
-    *prefix = htonl((uint32_t)(nalulen));
-    *index += sizeof(*prefix);
-    *length += sizeof(*prefix);
+    g_return_val_if_fail(*index + 4 <= limit, false);
+    prefix = htonl((uint32_t)(nalulen));
+    memcpy(*index, &prefix, sizeof(prefix));
+    *index += sizeof(prefix);
+    *length += sizeof(prefix);
+
+    return true;
+}
+
+static INLINE bool
+h264_scatter_single_nalu(media_vector_t *vector,
+                         prefix_t        prefix,
+                         const uint8_t  *naluptr,
+                         size_t          nalulen,
+                         h264_context_t *context)
+{
+    h264_nalu_header_t *naluhdr = NULL;
+    uint8_t            *copy    = NULL;
+    uint8_t             zeros   = 0;
+
+    g_return_val_if_fail(NULL != vector, false);
+    g_return_val_if_fail(NULL != naluptr, false);
+    g_return_val_if_fail(NULL != context, false);
+
+    if (prefix == PREFIX_ANNEXB && !scan_validate_payload(naluptr, nalulen,
+                &zeros))
+        return false;
+    if (!h264_scatter_prefix(vector, prefix, nalulen))
+        return false;
+
+    naluhdr = (h264_nalu_header_t *)(naluptr);
+    switch (naluhdr->nal_unit_type)
+    {
+        case 1:  /* Single unit inter-frame (P-frame) */
+        case 5:  /* Single unit intra-frame (I-frame) */
+            h264_decode_context((uint8_t *)(naluptr), nalulen, context);
+            return media_vector_append(vector, naluptr, nalulen);
+        case 7:  /* Single unit SPS */
+            copy = media_vector_claim(vector, nalulen);
+            g_return_val_if_fail(NULL != copy, false);
+            memcpy(copy, naluptr, nalulen);
+            h264_decode_context(copy, nalulen, context);
+            return media_vector_commit(vector, nalulen);
+        case 8:  /* Single unit PPS */
+            h264_decode_context((uint8_t *)(naluptr), nalulen, context);
+            return media_vector_append(vector, naluptr, nalulen);
+        default:
+            return media_vector_append(vector, naluptr, nalulen);
+    }
+}
+
+static INLINE bool
+h264_scatter_aggregation_unit(media_vector_t *vector,
+                              prefix_t        prefix,
+                              const uint8_t  *naluptr,
+                              size_t          nalulen,
+                              h264_context_t *context)
+{
+    h264_nalu_header_t *naluhdr  = NULL;
+    const uint8_t      *auptr    = NULL;
+    uint16_t            aulen    = 0;
+    const uint8_t      *aulenptr = NULL;
+#ifdef ADD_TIMESTAMP_USERDATA_SEI
+    uint8_t            *index    = NULL;
+    size_t              length   = 0;
+    size_t              seilen   = 0;
+#endif
+
+    g_return_val_if_fail(NULL != vector, false);
+    g_return_val_if_fail(NULL != naluptr, false);
+    g_return_val_if_fail(NULL != context, false);
+
+    for (aulenptr = naluptr + sizeof(uint8_t),
+         auptr = aulenptr + sizeof(uint16_t);
+         aulenptr < naluptr + nalulen && auptr < naluptr + nalulen;
+         aulenptr += sizeof(uint16_t) + aulen,
+         auptr = aulenptr + sizeof(uint16_t))
+    {
+        naluhdr = (h264_nalu_header_t *)(auptr);
+        aulen = (aulenptr[0] << 8) | aulenptr[1];
+        g_return_val_if_fail(auptr + aulen <= naluptr + nalulen, false);
+        if (!h264_scatter_single_nalu(vector, prefix, auptr, aulen, context))
+            return false;
+#ifdef ADD_TIMESTAMP_USERDATA_SEI
+        /* Add an user unregistered SEI messsage containing
+         * the system timestamp if we encounter end of PPS */
+        if (naluhdr->nal_unit_type == 0x08)
+        {
+            seilen = sizeof(uint32_t) + 1 + 1 + 1 + sizeof(time_sync_uuid) +
+                sizeof(uint64_t) + 1;
+            index = media_vector_claim(vector, seilen);
+            g_return_val_if_fail(NULL != index, false);
+            length = 0;
+            if (!h264_compose_timestamp_sei_nalu(&index, &length,
+                        index + seilen, prefix))
+                return false;
+            if (!media_vector_commit(vector, length))
+                return false;
+        }
+#endif
+    }
 
     return true;
 }
 
+static INLINE bool
+h264_scatter_fragmentation_unit(media_vector_t *vector,
+                                prefix_t        prefix,
+                                const uint8_t  *naluptr,
+                                size_t          nalulen,
+                                bool            completed,
+                                h264_context_t *context)
+{
+    h264_fu_header_t   *fuhdr   = NULL;
+    h264_nalu_header_t *naluhdr = NULL;
+    uint8_t            *header  = NULL;
+    uint8_t             slice[64];
+    size_t              hdrlen  = 0;
+    size_t              length  = 0;
+    uint32_t            avcclen = 0;
+    uint8_t             zeros   = 0;
+
+    g_return_val_if_fail(NULL != vector, false);
+    g_return_val_if_fail(NULL != naluptr, false);
+    g_return_val_if_fail(NULL != context, false);
+
+    hdrlen = sizeof(h264_nalu_header_t) + sizeof(h264_fu_header_t);
+    g_return_val_if_fail(hdrlen <= nalulen, false);
+
+    fuhdr = (h264_fu_header_t *)(naluptr + sizeof(h264_nalu_header_t));
+    zeros = fuhdr->start ? 0 : context->fu_zeros;
+    if (prefix == PREFIX_ANNEXB && !scan_validate_payload(naluptr + hdrlen,
+                nalulen - hdrlen, &zeros))
+        return false;
+    context->fu_zeros = zeros;
+    if (fuhdr->start)
+    {
+        context->fu_offset = vector->headerlen;
+        context->fu_length = sizeof(h264_nalu_header_t);
+        if (!h264_scatter_prefix(vector, prefix, nalulen))
+            return false;
+
+        header = media_vector_claim(vector, sizeof(h264_nalu_header_t));
+        g_return_val_if_fail(NULL != header, false);
+        naluhdr = (h264_nalu_header_t *)(header);
+        naluhdr->forbidden = !completed;
+        naluhdr->nal_unit_type = fuhdr->type;
+        naluhdr->nal_ref_idc = h264_get_nal_ref_idc(fuhdr->type);
+
+        /* The slice header sits right after the rebuilt NALU header */
+        length = MIN(sizeof(slice) - 1, nalulen - hdrlen);
+        slice[0] = *header;
+        memcpy(slice + 1, naluptr + hdrlen, length);
+        if (fuhdr->type == 1 || fuhdr->type == 5)
+            h264_decode_context(slice, length + 1, context);
+
+        if (!media_vector_commit(vector, sizeof(h264_nalu_header_t)))
+            return false;
+    }
+
+    if (nalulen > hdrlen &&
+        !media_vector_append(vector, naluptr + hdrlen, nalulen - hdrlen))
+        return false;
+
+    if (context->fu_length > 0)
+        context->fu_length += nalulen - hdrlen;
+    if (context->fu_length > 0 && prefix == PREFIX_AVCC)
+    {
+        avcclen = htonl(context->fu_length);
+        memcpy(vector->header + context->fu_offset, &avcclen,
+                sizeof(avcclen));
+    }
+    if (fuhdr->end)
+    {
+        context->fu_length = 0;
+        context->fu_zeros = 0;
+    }
+
+    return true;
+}
+
+static INLINE bool
+h264_scatter_prefix(media_vector_t *vector,
+                    prefix_t        prefix,
+                    size_t          nalulen)
+{
+    uint8_t *index  = NULL;
+    size_t   length = 0;
+
+    g_return_val_if_fail(NULL != vector, false);
+
+    index = media_vector_claim(vector, sizeof(uint32_t));
+    g_return_val_if_fail(NULL != index, false);
+    if (!h264_compose_prefix(&index, &length, index + sizeof(uint32_t),
+                prefix, nalulen))
+        return false;
+
+    return media_vector_commit(vector, length);
+}
+
 static INLINE uint8_t
 h264_get_nal_ref_idc(uint8_t nal_unit_type)
 {
@@ -539,31 +1050,96 @@ h264_get_nal_ref_idc(uint8_t nal_unit_type)
     }
 }
 
+/* NOTE: the context only takes what decodes in full, a truncated or
+ * corrupt NALU leaves it as it was and does not fail reassembly. The SPS
+ * decoder patches its NALU in place, slice types only read the NALU,
+ * which may then be const */
+static INLINE bool
+h264_decode_context(uint8_t        *nalu,
+                    size_t          nalulen,
+                    h264_context_t *context)
+{
+    h264_context_t decoded;
+    bool           result = false;
+
+    g_return_val_if_fail(NULL != nalu, false);
+    g_return_val_if_fail(NULL != context, false);
+
+    if (nalulen < 1)
+        return true;
+
+    decoded = *context;
+    switch (((h264_nalu_header_t *)(nalu))->nal_unit_type)
+    {
+        /* Get slice header information */
+        case 1:  /* Single unit inter-frame (P-frame) */
+        case 5:  /* Single unit intra-frame (I-frame) */
+            result = h264_decode_slice_header(nalu, nalulen, &decoded);
+            break;
+        /* Get SPS information */
+        case 7:  /* Single unit SPS */
+            result = h264_update_sps(nalu, nalulen, &decoded);
+            break;
+        /* Get PPS information */
+        case 8:  /* Single unit PPS */
+            result = h264_update_pps(nalu, nalulen, &decoded);
+            break;
+        default: break;
+    }
+
+    if (result && decoded.parameter_sets)
+        decoded.generation = decoded.parameter_sets->generation;
+    if (result)
+        *context = decoded;
+
+    return true;
+}
+
+/* NOTE: frame_num is as wide as the SPS the slice's PPS refers to says,
+ * or the last SPS decoded if that one has not been seen. The fields read
+ * here take at most 11 bytes of the RBSP */
 static INLINE bool
 h264_decode_slice_header(const uint8_t  *nalu,
                          size_t          length,
                          h264_context_t *context)
 {
-    size_t offset = 0; // nth bit, not byte, 0-based
+    bitstream_t            reader;
+    h264_parameter_sets_t *sets    = NULL;
+    const h264_context_t  *sps     = NULL;
+    uint8_t                rbsp[16];
+    size_t                 rbsplen = 0;
+    uint32_t               pps_id  = 0;
 
     g_return_val_if_fail(NULL != nalu, false);
     g_return_val_if_fail(NULL != context, false);
     g_return_val_if_fail(0 < length, false);
 
-    context->forbidden_zero_bit = h264_get_bits(nalu, &offset, 1);
-    context->nal_ref_idc = h264_get_bits(nalu, &offset, 2);
-    context->nal_unit_type = h264_get_bits(nalu, &offset, 5);
-    context->first_mb_in_slice = h264_decode_uexpgolomb(nalu, &offset);
-    context->slice_type = h264_decode_uexpgolomb(nalu, &offset);
-    context->pic_parameter_set_id = h264_decode_uexpgolomb(nalu, &offset);
-    context->frame_num = h264_get_bits(nalu, &offset,
-            context->log2_max_frame_num_minus4 + 4);
+    rbsplen = scan_extract_rbsp(nalu, length, rbsp, sizeof(rbsp));
+    bitstream_init(&reader, rbsp, rbsplen);
+    context->forbidden_zero_bit = bitstream_get_bits(&reader, 1);
+    context->nal_ref_idc = bitstream_get_bits(&reader, 2);
+    context->nal_unit_type = bitstream_get_bits(&reader, 5);
+    context->first_mb_in_slice = bitstream_get_ue(&reader);
+    context->slice_type = bitstream_get_ue(&reader);
+    pps_id = bitstream_get_ue(&reader);
+    context->pic_parameter_set_id = pps_id;
+
+    sets = context->parameter_sets;
+    sps = context;
+    if (sets && pps_id < H264_MAX_PPS_COUNT && sets->pps[pps_id] &&
+        sets->sps[sets->pps_sps_id[pps_id]].received)
+        sps = &(sets->sps[sets->pps_sps_id[pps_id]].decoded);
+    context->colour_plane_id = 0;
+    if (sps->separate_colour_plane_flag)
+        context->colour_plane_id = bitstream_get_bits(&reader, 2);
+    context->frame_num = bitstream_get_bits(&reader,
+            sps->log2_max_frame_num_minus4 + 4);
 #ifdef DEBUG
     h264_print_slice_header(context);
-    h264_print_octets(nalu, 16);
+    h264_print_octets(nalu, MIN(length, 16));
 #endif
 
-    return true;
+    return !reader.error;
 }
 
 static INLINE void
@@ -581,75 +1157,580 @@ h264_print_slice_header(const h264_context_t *context)
     printf("   frame_num: %u\n", context->frame_num);
 }
 
-/* NOTE: we modify the gaps_in_frame_num_value_allowed_flag
- * in the bitstream within this function */
+/* NOTE: an SPS whose bytes match the one cached under its id is not
+ * parsed again, the decoded fields and the patch are taken from the cache.
+ * We set the gaps_in_frame_num_value_allowed_flag in the bitstream. The
+ * SPS is parsed from its RBSP, the offset of the flag is mapped back onto
+ * the NALU, emulation prevention bytes and all */
 static INLINE bool
-h264_decode_sps(uint8_t        *nalu,
+h264_update_sps(uint8_t        *nalu,
                 size_t          length,
                 h264_context_t *context)
 {
-    size_t  offset = 0; // nth bit, not byte, 0-based
-    int32_t count  = 0;
+    h264_parameter_sets_t *sets    = NULL;
+    h264_sps_entry_t      *entry   = NULL;
+    bitstream_t            reader;
+    uint8_t                rbsp[H264_MAX_SPS_SIZE];
+    size_t                 rbsplen = 0;
+    size_t                 offset  = 0;
+    uint32_t               id      = 0;
 
     g_return_val_if_fail(NULL != nalu, false);
     g_return_val_if_fail(NULL != context, false);
+
+    rbsplen = scan_extract_rbsp(nalu, length, rbsp, sizeof(rbsp));
+    sets = context->parameter_sets;
+    if (!sets)
+    {
+        if (!h264_decode_sps(rbsp, rbsplen, context, &offset))
+            return false;
+        h264_set_bit(nalu, length, h264_map_rbsp_offset(nalu, length,
+                offset));
+        return true;
+    }
+
+    /* seq_parameter_set_id follows the header, profile and level bytes */
+    bitstream_init(&reader, rbsp, rbsplen);
+    bitstream_skip_bits(&reader, 32);
+    id = bitstream_get_ue(&reader);
+    if (reader.error || id >= H264_MAX_SPS_COUNT)
+        return false;
+
+    entry = &(sets->sps[id]);
+    if (entry->received && entry->received->len == length &&
+        !memcmp(entry->received->data, nalu, length))
+    {
+        h264_set_bit(nalu, length, entry->gaps_offset);
+        h264_restore_sps(context, &(entry->decoded));
+        return true;
+    }
+
+    if (!h264_decode_sps(rbsp, rbsplen, context, &offset))
+        return false;
+    offset = h264_map_rbsp_offset(nalu, length, offset);
+
+    if (!entry->received)
+        entry->received = g_byte_array_sized_new(length);
+    if (!entry->emitted)
+        entry->emitted = g_byte_array_sized_new(length);
+    g_byte_array_set_size(entry->received, 0);
+    g_byte_array_append(entry->received, nalu, length);
+    h264_set_bit(nalu, length, offset);
+    g_byte_array_set_size(entry->emitted, 0);
+    g_byte_array_append(entry->emitted, nalu, length);
+    entry->gaps_offset = offset;
+    entry->decoded = *context;
+    ++(sets->generation);
+
+    return true;
+}
+
+/* NOTE: seq_parameter_set_data() of 7.3.2.1.1 and the VUI of E.1.1 read
+ * from the RBSP, *gaps_offset is the bit the
+ * gaps_in_frame_num_value_allowed_flag is at, for the caller to patch */
+static INLINE bool
+h264_decode_sps(const uint8_t  *rbsp,
+                size_t          length,
+                h264_context_t *context,
+                size_t         *gaps_offset)
+{
+    bitstream_t reader;
+    int32_t     count  = 0;
+    uint32_t    value  = 0;
+
+    g_return_val_if_fail(NULL != rbsp, false);
+    g_return_val_if_fail(NULL != context, false);
+    g_return_val_if_fail(NULL != gaps_offset, false);
     g_return_val_if_fail(0 < length, false);
 
-    context->forbidden_zero_bit = h264_get_bits(nalu, &offset, 1);
-    context->nal_ref_idc = h264_get_bits(nalu, &offset, 2);
-    context->nal_unit_type = h264_get_bits(nalu, &offset, 5);
-    context->profile_idc = h264_get_bits(nalu, &offset, 8);
-    context->constraint_set0_flag = h264_get_bits(nalu, &offset, 1);
-    context->constraint_set1_flag = h264_get_bits(nalu, &offset, 1);
-    context->constraint_set2_flag = h264_get_bits(nalu, &offset, 1);
-    context->constraint_set3_flag = h264_get_bits(nalu, &offset, 1);
-    context->reserved_zero_4bits = h264_get_bits(nalu, &offset, 4);
-    context->level_idc = h264_get_bits(nalu, &offset, 8);
-    if (context->profile_idc != 100 && context->profile_idc != 110 &&
-        context->profile_idc != 122 && context->profile_idc != 122 &&
-        context->profile_idc != 244 && context->profile_idc != 44  &&
-        context->profile_idc != 83  && context->profile_idc != 86  &&
-        context->profile_idc != 118 && context->profile_idc != 128 &&
-        context->profile_idc != 138 && context->profile_idc != 144)
-        context->seq_parameter_set_id = h264_decode_uexpgolomb(nalu, &offset);
-    context->log2_max_frame_num_minus4 = h264_decode_uexpgolomb(nalu, &offset);
-    context->pic_order_cnt_type = h264_decode_uexpgolomb(nalu, &offset);
+    bitstream_init(&reader, rbsp, length);
+    context->forbidden_zero_bit = bitstream_get_bits(&reader, 1);
+    context->nal_ref_idc = bitstream_get_bits(&reader, 2);
+    context->nal_unit_type = bitstream_get_bits(&reader, 5);
+    context->profile_idc = bitstream_get_bits(&reader, 8);
+    context->constraint_set0_flag = bitstream_get_bits(&reader, 1);
+    context->constraint_set1_flag = bitstream_get_bits(&reader, 1);
+    context->constraint_set2_flag = bitstream_get_bits(&reader, 1);
+    context->constraint_set3_flag = bitstream_get_bits(&reader, 1);
+    context->reserved_zero_4bits = bitstream_get_bits(&reader, 4);
+    context->level_idc = bitstream_get_bits(&reader, 8);
+    context->seq_parameter_set_id = bitstream_get_ue(&reader);
+    context->chroma_format_idc = 1;
+    context->separate_colour_plane_flag = false;
+    context->bit_depth_luma_minus8 = 0;
+    context->bit_depth_chroma_minus8 = 0;
+    context->qpprime_y_zero_transform_bypass_flag = false;
+    context->seq_scaling_matrix_present_flag = false;
+    if (h264_is_high_profile(context->profile_idc))
+    {
+        context->chroma_format_idc = bitstream_get_ue(&reader);
+        if (context->chroma_format_idc > 3)
+            return false;
+        if (context->chroma_format_idc == 3)
+            context->separate_colour_plane_flag =
+                bitstream_get_bits(&reader, 1);
+        context->bit_depth_luma_minus8 = bitstream_get_ue(&reader);
+        context->bit_depth_chroma_minus8 = bitstream_get_ue(&reader);
+        if (context->bit_depth_luma_minus8 > 6 ||
+            context->bit_depth_chroma_minus8 > 6)
+            return false;
+        context->qpprime_y_zero_transform_bypass_flag =
+            bitstream_get_bits(&reader, 1);
+        context->seq_scaling_matrix_present_flag =
+            bitstream_get_bits(&reader, 1);
+        for (count = 0; context->seq_scaling_matrix_present_flag &&
+             count < ((context->chroma_format_idc != 3) ? 8 : 12); count++)
+            if (bitstream_get_bit(&reader))
+                h264_skip_scaling_list(&reader, (count < 6) ? 16 : 64);
+    }
+    context->log2_max_frame_num_minus4 = bitstream_get_ue(&reader);
+    if (context->log2_max_frame_num_minus4 > 12)
+        return false;
+    context->pic_order_cnt_type = bitstream_get_ue(&reader);
+    context->log2_max_pic_order_cnt_lsb_minus4 = 0;
+    context->delta_pic_order_always_zero_flag = false;
+    context->offset_for_non_ref_pic = 0;
+    context->offset_for_top_to_bottom_field = 0;
+    context->num_ref_frames_in_pic_order_cnt_cycle = 0;
     if (context->pic_order_cnt_type == 0)
+    {
         context->log2_max_pic_order_cnt_lsb_minus4 =
-            h264_decode_uexpgolomb(nalu, &offset);
-    else
+            bitstream_get_ue(&reader);
+        if (context->log2_max_pic_order_cnt_lsb_minus4 > 12)
+            return false;
+    }
+    else if (context->pic_order_cnt_type == 1)
     {
         context->delta_pic_order_always_zero_flag =
-            h264_get_bits(nalu, &offset, 1);
-        context->offset_for_non_ref_pic = h264_decode_sexpgolomb(nalu, &offset);
+            bitstream_get_bits(&reader, 1);
+        context->offset_for_non_ref_pic = bitstream_get_se(&reader);
         context->offset_for_top_to_bottom_field =
-            h264_decode_sexpgolomb(nalu, &offset);
-        context->num_ref_frames_in_pic_order_cnt_cycle =
-            h264_decode_uexpgolomb(nalu, &offset);
-        for (count = 0; count < context->num_ref_frames_in_pic_order_cnt_cycle;
-             count++, (void)(h264_decode_sexpgolomb(nalu, &offset)));
-    }
-    context->num_ref_frames = h264_decode_uexpgolomb(nalu, &offset);
-    /* Set the gaps_in_frame_num_value_allowed_flag bit */
-    h264_set_bit(nalu, offset);
-    context->gaps_in_frame_num_value_allowed_flag =
-        h264_get_bits(nalu, &offset, 1);
-    context->pic_width_in_mbs_minus_1 = h264_decode_uexpgolomb(nalu, &offset);
+            bitstream_get_se(&reader);
+        value = bitstream_get_ue(&reader);
+        if (value > 255)
+            return false;
+        context->num_ref_frames_in_pic_order_cnt_cycle = value;
+        for (value = 0; value < context->num_ref_frames_in_pic_order_cnt_cycle
+             && !reader.error; value++, (void)(bitstream_get_se(&reader)));
+    }
+    else if (context->pic_order_cnt_type != 2)
+        return false;
+    value = bitstream_get_ue(&reader);
+    if (value > 16)
+        return false;
+    context->num_ref_frames = value;
+    /* The caller sets the gaps_in_frame_num_value_allowed_flag bit */
+    *gaps_offset = bitstream_get_position(&reader);
+    (void)(bitstream_get_bit(&reader));
+    context->gaps_in_frame_num_value_allowed_flag = true;
+    context->pic_width_in_mbs_minus_1 = bitstream_get_ue(&reader);
     context->pic_height_in_map_units_minus_1 =
-        h264_decode_uexpgolomb(nalu, &offset);
-    context->frame_mbs_only_flag = h264_get_bits(nalu, &offset, 1);
-    context->direct_8x8_inference_flag = h264_get_bits(nalu, &offset, 1);
-    context->frame_cropping_flag = h264_get_bits(nalu, &offset, 1);
-    context->vui_prameters_present_flag = h264_get_bits(nalu, &offset, 1);
-    context->rbsp_stop_one_bit = h264_get_bits(nalu, &offset, 1);
+        bitstream_get_ue(&reader);
+    context->frame_mbs_only_flag = bitstream_get_bits(&reader, 1);
+    context->mb_adaptive_frame_field_flag = false;
+    if (!context->frame_mbs_only_flag)
+        context->mb_adaptive_frame_field_flag =
+            bitstream_get_bits(&reader, 1);
+    context->direct_8x8_inference_flag = bitstream_get_bits(&reader, 1);
+    context->frame_cropping_flag = bitstream_get_bits(&reader, 1);
+    context->frame_crop_left_offset = 0;
+    context->frame_crop_right_offset = 0;
+    context->frame_crop_top_offset = 0;
+    context->frame_crop_bottom_offset = 0;
+    if (context->frame_cropping_flag)
+    {
+        context->frame_crop_left_offset = bitstream_get_ue(&reader);
+        context->frame_crop_right_offset = bitstream_get_ue(&reader);
+        context->frame_crop_top_offset = bitstream_get_ue(&reader);
+        context->frame_crop_bottom_offset = bitstream_get_ue(&reader);
+    }
+    context->vui_prameters_present_flag = bitstream_get_bits(&reader, 1);
+    if (!h264_decode_vui(&reader, context))
+        return false;
+    context->rbsp_stop_one_bit = bitstream_get_bits(&reader, 1);
+    if (reader.error || !h264_derive_sps(context))
+        return false;
 #ifdef DEBUG
     h264_print_sps(context);
-    h264_print_octets(nalu, 16);
+    h264_print_octets(rbsp, MIN(length, 16));
 #endif
 
     return true;
 }
 
+/* NOTE: vui_parameters() of E.1.1, fields absent from the VUI, or the
+ * whole VUI, take the values E.2.1 infers. The reorder and DPB depths
+ * inferred depend on the frame size, so h264_derive_sps fills them in */
+static INLINE bool
+h264_decode_vui(bitstream_t    *reader,
+                h264_context_t *context)
+{
+    uint32_t value = 0;
+
+    g_return_val_if_fail(NULL != reader, false);
+    g_return_val_if_fail(NULL != context, false);
+
+    context->aspect_ratio_info_present_flag = false;
+    context->aspect_ratio_idc = 0;
+    context->sar_width = 0;
+    context->sar_height = 0;
+    context->overscan_info_present_flag = false;
+    context->overscan_appropriate_flag = false;
+    context->video_signal_type_present_flag = false;
+    context->video_format = 5;
+    context->video_full_range_flag = false;
+    context->colour_description_present_flag = false;
+    context->colour_primaries = 2;
+    context->transfer_characteristics = 2;
+    context->matrix_coefficients = 2;
+    context->chroma_loc_info_present_flag = false;
+    context->chroma_sample_loc_type_top_field = 0;
+    context->chroma_sample_loc_type_bottom_field = 0;
+    context->timing_info_present_flag = false;
+    context->num_units_in_tick = 0;
+    context->time_scale = 0;
+    context->fixed_frame_rate_flag = false;
+    context->nal_hrd_parameters_present_flag = false;
+    context->vcl_hrd_parameters_present_flag = false;
+    context->low_delay_hrd_flag = false;
+    context->pic_struct_present_flag = false;
+    context->bitstream_restriction_flag = false;
+    context->motion_vectors_over_pic_boundaries_flag = true;
+    context->max_bytes_per_pic_denom = 2;
+    context->max_bits_per_mb_denom = 1;
+    context->log2_max_mv_length_horizontal = 15;
+    context->log2_max_mv_length_vertical = 15;
+    context->max_num_reorder_frames = 0;
+    context->max_dec_frame_buffering = 0;
+
+    if (!context->vui_prameters_present_flag)
+        return true;
+
+    context->aspect_ratio_info_present_flag = bitstream_get_bits(reader, 1);
+    if (context->aspect_ratio_info_present_flag)
+    {
+        context->aspect_ratio_idc = bitstream_get_bits(reader, 8);
+        /* Extended_SAR */
+        if (context->aspect_ratio_idc == 255)
+        {
+            context->sar_width = bitstream_get_bits(reader, 16);
+            context->sar_height = bitstream_get_bits(reader, 16);
+        }
+    }
+    context->overscan_info_present_flag = bitstream_get_bits(reader, 1);
+    if (context->overscan_info_present_flag)
+        context->overscan_appropriate_flag = bitstream_get_bits(reader, 1);
+    context->video_signal_type_present_flag = bitstream_get_bits(reader, 1);
+    if (context->video_signal_type_present_flag)
+    {
+        context->video_format = bitstream_get_bits(reader, 3);
+        context->video_full_range_flag = bitstream_get_bits(reader, 1);
+        context->colour_description_present_flag =
+            bitstream_get_bits(reader, 1);
+        if (context->colour_description_present_flag)
+        {
+            context->colour_primaries = bitstream_get_bits(reader, 8);
+            context->transfer_characteristics = bitstream_get_bits(reader, 8);
+            context->matrix_coefficients = bitstream_get_bits(reader, 8);
+        }
+    }
+    context->chroma_loc_info_present_flag = bitstream_get_bits(reader, 1);
+    if (context->chroma_loc_info_present_flag)
+    {
+        context->chroma_sample_loc_type_top_field = bitstream_get_ue(reader);
+        context->chroma_sample_loc_type_bottom_field =
+            bitstream_get_ue(reader);
+    }
+    context->timing_info_present_flag = bitstream_get_bits(reader, 1);
+    if (context->timing_info_present_flag)
+    {
+        context->num_units_in_tick = bitstream_get_bits(reader, 32);
+        context->time_scale = bitstream_get_bits(reader, 32);
+        context->fixed_frame_rate_flag = bitstream_get_bits(reader, 1);
+    }
+    context->nal_hrd_parameters_present_flag = bitstream_get_bits(reader, 1);
+    if (context->nal_hrd_parameters_present_flag)
+        h264_skip_hrd_parameters(reader);
+    context->vcl_hrd_parameters_present_flag = bitstream_get_bits(reader, 1);
+    if (context->vcl_hrd_parameters_present_flag)
+        h264_skip_hrd_parameters(reader);
+    if (context->nal_hrd_parameters_present_flag ||
+        context->vcl_hrd_parameters_present_flag)
+        context->low_delay_hrd_flag = bitstream_get_bits(reader, 1);
+    context->pic_struct_present_flag = bitstream_get_bits(reader, 1);
+    context->bitstream_restriction_flag = bitstream_get_bits(reader, 1);
+    if (context->bitstream_restriction_flag)
+    {
+        context->motion_vectors_over_pic_boundaries_flag =
+            bitstream_get_bits(reader, 1);
+        context->max_bytes_per_pic_denom = bitstream_get_ue(reader);
+        context->max_bits_per_mb_denom = bitstream_get_ue(reader);
+        context->log2_max_mv_length_horizontal = bitstream_get_ue(reader);
+        context->log2_max_mv_length_vertical = bitstream_get_ue(reader);
+        value = bitstream_get_ue(reader);
+        if (value > 16)
+            return false;
+        context->max_num_reorder_frames = value;
+        value = bitstream_get_ue(reader);
+        if (value > 16)
+            return false;
+        context->max_dec_frame_buffering = value;
+    }
+
+    return !reader->error;
+}
+
+/* NOTE: hrd_parameters() of E.1.2, nothing in it is kept */
+static INLINE void
+h264_skip_hrd_parameters(bitstream_t *reader)
+{
+    uint32_t count = 0;
+    uint32_t index = 0;
+
+    g_return_if_fail(NULL != reader);
+
+    /* cpb_cnt_minus1, bit_rate_scale and cpb_size_scale */
+    count = bitstream_get_ue(reader) + 1;
+    (void)(bitstream_get_bits(reader, 8));
+    for (index = 0; index < count && index < 32 && !reader->error; index++)
+    {
+        /* bit_rate_value_minus1, cpb_size_value_minus1 and cbr_flag */
+        (void)(bitstream_get_ue(reader));
+        (void)(bitstream_get_ue(reader));
+        (void)(bitstream_get_bit(reader));
+    }
+    if (count > 32)
+        reader->error = true;
+    /* The four delay and offset lengths */
+    (void)(bitstream_get_bits(reader, 20));
+}
+
+/* NOTE: the cropped output size of 7.4.2.1.1, the frame rate of a stream
+ * with one frame every two ticks, and the reorder and DPB depths E.2.1
+ * infers when the VUI does not carry them: none for the intra profiles,
+ * MaxDpbFrames otherwise */
+static INLINE bool
+h264_derive_sps(h264_context_t *context)
+{
+    guint64 width     = 0;
+    guint64 height    = 0;
+    guint64 crop_x    = 1;
+    guint64 crop_y    = 1;
+    guint64 num       = 0;
+    guint64 den       = 0;
+    guint64 divisor   = 0;
+    guint64 remainder = 0;
+    guint64 mbs       = 0;
+    guint64 dpb       = 0;
+
+    g_return_val_if_fail(NULL != context, false);
+
+    /* CropUnitX and CropUnitY, by ChromaArrayType */
+    if (!context->separate_colour_plane_flag &&
+        context->chroma_format_idc != 0)
+    {
+        crop_x = (context->chroma_format_idc == 3) ? 1 : 2;
+        crop_y = (context->chroma_format_idc == 1) ? 2 : 1;
+    }
+    crop_y *= 2 - context->frame_mbs_only_flag;
+
+    width = ((guint64)(context->pic_width_in_mbs_minus_1) + 1) * 16;
+    height = ((guint64)(context->pic_height_in_map_units_minus_1) + 1) *
+        16 * (2 - context->frame_mbs_only_flag);
+    mbs = (width / 16) * (height / 16);
+    crop_x *= (guint64)(context->frame_crop_left_offset) +
+        context->frame_crop_right_offset;
+    crop_y *= (guint64)(context->frame_crop_top_offset) +
+        context->frame_crop_bottom_offset;
+    if (width > G_MAXUINT16 || height > G_MAXUINT16 ||
+        crop_x >= width || crop_y >= height)
+        return false;
+    context->width = width - crop_x;
+    context->height = height - crop_y;
+
+    context->framerate_num = 0;
+    context->framerate_den = 0;
+    if (context->timing_info_present_flag &&
+        context->num_units_in_tick > 0 && context->time_scale > 0)
+    {
+        num = context->time_scale;
+        den = (guint64)(context->num_units_in_tick) * 2;
+        for (divisor = num, remainder = den; remainder != 0; )
+        {
+            dpb = divisor % remainder;
+            divisor = remainder;
+            remainder = dpb;
+        }
+        num /= divisor;
+        den /= divisor;
+        if (den <= G_MAXUINT32)
+        {
+            context->framerate_num = num;
+            context->framerate_den = den;
+        }
+    }
+
+    if (context->bitstream_restriction_flag)
+        return true;
+
+    switch (context->profile_idc)
+    {
+        case 44:
+        case 86:
+        case 100:
+        case 110:
+        case 122:
+        case 244:
+            if (context->constraint_set3_flag)
+            {
+                context->max_num_reorder_frames = 0;
+                context->max_dec_frame_buffering = 0;
+                return true;
+            }
+            break;
+        default: break;
+    }
+
+    dpb = h264_get_max_dpb_mbs(context);
+    dpb = (dpb == 0) ? 16 : MIN(dpb / mbs, 16);
+    context->max_num_reorder_frames = dpb;
+    context->max_dec_frame_buffering = dpb;
+
+    return true;
+}
+
+/* NOTE: MaxDpbMbs of Table A-1, 0 for a level it does not list. Level 11
+ * with constraint_set3_flag outside the High profiles is level 1b */
+static INLINE uint32_t
+h264_get_max_dpb_mbs(const h264_context_t *context)
+{
+    g_return_val_if_fail(NULL != context, 0);
+
+    switch (context->level_idc)
+    {
+        case 9:
+        case 10: return 396;
+        case 11:
+            return (context->constraint_set3_flag &&
+                    !h264_is_high_profile(context->profile_idc)) ? 396 : 900;
+        case 12:
+        case 13:
+        case 20: return 2376;
+        case 21: return 4752;
+        case 22:
+        case 30: return 8100;
+        case 31: return 18000;
+        case 32: return 20480;
+        case 40:
+        case 41: return 32768;
+        case 42: return 34816;
+        case 50: return 110400;
+        case 51:
+        case 52: return 184320;
+        case 60:
+        case 61:
+        case 62: return 696320;
+        default: return 0;
+    }
+}
+
+static INLINE void
+h264_restore_sps(h264_context_t       *context,
+                 const h264_context_t *sps)
+{
+    h264_context_t restored;
+
+    g_return_if_fail(NULL != context);
+    g_return_if_fail(NULL != sps);
+
+    /* Keep the slice header and reassembly state */
+    restored = *sps;
+    restored.first_mb_in_slice = context->first_mb_in_slice;
+    restored.slice_type = context->slice_type;
+    restored.pic_parameter_set_id = context->pic_parameter_set_id;
+    restored.colour_plane_id = context->colour_plane_id;
+    restored.frame_num = context->frame_num;
+    restored.fu_offset = context->fu_offset;
+    restored.fu_length = context->fu_length;
+    restored.fu_zeros = context->fu_zeros;
+    restored.parameter_sets = context->parameter_sets;
+    restored.generation = context->generation;
+    *context = restored;
+}
+
+/* NOTE: scaling_list() of 7.3.2.1.1.1, only the reads matter here */
+static INLINE void
+h264_skip_scaling_list(bitstream_t *reader,
+                       size_t       size)
+{
+    int32_t last  = 8;
+    int32_t next  = 8;
+    size_t  index = 0;
+
+    g_return_if_fail(NULL != reader);
+
+    for (index = 0; index < size && next != 0 && !reader->error; index++)
+    {
+        next = (last + bitstream_get_se(reader) + 256) % 256;
+        last = (next == 0) ? last : next;
+    }
+}
+
+/* NOTE: profiles whose SPS carries chroma_format_idc and bit depths */
+static INLINE bool
+h264_is_high_profile(uint8_t profile_idc)
+{
+    switch (profile_idc)
+    {
+        case 44:
+        case 83:
+        case 86:
+        case 100:
+        case 110:
+        case 118:
+        case 122:
+        case 128:
+        case 134:
+        case 135:
+        case 138:
+        case 139:
+        case 144:
+        case 244:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* NOTE: maps a bit offset into the RBSP back onto the NALU it was taken
+ * from, past the end of the NALU if it is not in there */
+static INLINE size_t
+h264_map_rbsp_offset(const uint8_t *nalu,
+                     size_t         length,
+                     size_t         offset)
+{
+    size_t index   = 0;
+    size_t rbsplen = 0;
+    size_t zeros   = 0;
+
+    g_return_val_if_fail(NULL != nalu, 0);
+
+    for (index = 0; index < length; index++)
+    {
+        if (zeros >= 2 && nalu[index] == 0x03)
+        {
+            zeros = 0;
+            continue;
+        }
+        if (rbsplen == (offset >> 3))
+            return (index << 3) | (offset & 0x7);
+        zeros = (nalu[index] == 0x00) ? zeros + 1 : 0;
+        ++rbsplen;
+    }
+
+    return length << 3;
+}
+
 static INLINE void
 h264_print_sps(const h264_context_t *context)
 {
@@ -676,7 +1757,7 @@ h264_print_sps(const h264_context_t *context)
     printf("   offset_for_non_ref_pic: %d\n", context->offset_for_non_ref_pic);
     printf("   offset_for_top_to_bottom_field: %d\n",
             context->offset_for_top_to_bottom_field);
-    printf("   num_ref_frames_in_pic_order_cnt_cycle: %d\n",
+    printf("   num_ref_frames_in_pic_order_cnt_cycle: %u\n",
             context->num_ref_frames_in_pic_order_cnt_cycle);
     printf("   num_ref_frames: %u\n", context->num_ref_frames);
     printf("   gaps_in_frame_num_value_allowed_flag: %u\n",
@@ -685,86 +1766,207 @@ h264_print_sps(const h264_context_t *context)
     printf("   pic_height_in_map_units_minus_1: %u\n",
             context->pic_height_in_map_units_minus_1);
     printf("   frame_mbs_only_flag: %u\n", context->frame_mbs_only_flag);
+    printf("   mb_adaptive_frame_field_flag: %u\n",
+            context->mb_adaptive_frame_field_flag);
     printf("   direct_8x8_inference_flag: %u\n",
             context->direct_8x8_inference_flag);
     printf("   frame_cropping_flag: %u\n", context->frame_cropping_flag);
+    printf("   frame_crop_offsets: %u %u %u %u\n",
+            context->frame_crop_left_offset,
+            context->frame_crop_right_offset,
+            context->frame_crop_top_offset,
+            context->frame_crop_bottom_offset);
     printf("   vui_prameters_present_flag: %u\n",
             context->vui_prameters_present_flag);
+    printf("   aspect_ratio_idc: %u (%u:%u)\n", context->aspect_ratio_idc,
+            context->sar_width, context->sar_height);
+    printf("   video_format: %u\n", context->video_format);
+    printf("   video_full_range_flag: %u\n", context->video_full_range_flag);
+    printf("   colour_description: %u %u %u\n", context->colour_primaries,
+            context->transfer_characteristics, context->matrix_coefficients);
+    printf("   timing_info: %u/%u fixed %u\n", context->num_units_in_tick,
+            context->time_scale, context->fixed_frame_rate_flag);
+    printf("   nal/vcl_hrd_parameters_present_flag: %u %u\n",
+            context->nal_hrd_parameters_present_flag,
+            context->vcl_hrd_parameters_present_flag);
+    printf("   pic_struct_present_flag: %u\n",
+            context->pic_struct_present_flag);
+    printf("   bitstream_restriction_flag: %u\n",
+            context->bitstream_restriction_flag);
+    printf("   max_num_reorder_frames: %u\n",
+            context->max_num_reorder_frames);
+    printf("   max_dec_frame_buffering: %u\n",
+            context->max_dec_frame_buffering);
     printf("   rbsp_stop_one_bit: %u\n", context->rbsp_stop_one_bit);
+    printf("   output: %ux%u @ %u/%u\n", context->width, context->height,
+            context->framerate_num, context->framerate_den);
 }
 
-static INLINE uint32_t
-h264_decode_uexpgolomb(const uint8_t *bitstream,
-                       size_t        *offset)
+/* NOTE: only the ids are read, a PPS is kept as is under its own */
+static INLINE bool
+h264_update_pps(const uint8_t  *nalu,
+                size_t          length,
+                h264_context_t *context)
 {
-    uint32_t zeroes = -1;
-    uint32_t code   = 0;
-    uint8_t  bit    = 0x00;
-    uint32_t retval = 0;
+    h264_parameter_sets_t *sets    = NULL;
+    bitstream_t            reader;
+    uint8_t                rbsp[8];
+    size_t                 rbsplen = 0;
+    uint32_t               id      = 0;
+    uint32_t               sps_id  = 0;
 
-    g_return_val_if_fail(NULL != bitstream, 0);
-    g_return_val_if_fail(NULL != offset, 0);
+    g_return_val_if_fail(NULL != nalu, false);
+    g_return_val_if_fail(NULL != context, false);
 
-    for (bit = 0; !bit; zeroes++)
-        bit = h264_get_bit(bitstream, (*offset)++);
-    if (zeroes > 0)
-    {
-        code = h264_get_bits(bitstream, offset, zeroes);
-        retval = (1 << zeroes) - 1 + code;
-    }
+    /* Both ids fit in the first 5 bytes of the RBSP */
+    rbsplen = scan_extract_rbsp(nalu, length, rbsp, sizeof(rbsp));
+    bitstream_init(&reader, rbsp, rbsplen);
+    bitstream_skip_bits(&reader, 8);
+    id = bitstream_get_ue(&reader);
+    sps_id = bitstream_get_ue(&reader);
+    if (reader.error || id >= H264_MAX_PPS_COUNT ||
+        sps_id >= H264_MAX_SPS_COUNT)
+        return false;
+
+    sets = context->parameter_sets;
+    if (!sets)
+        return true;
+
+    if (sets->pps[id] && sets->pps[id]->len == length &&
+        sets->pps_sps_id[id] == sps_id &&
+        !memcmp(sets->pps[id]->data, nalu, length))
+        return true;
+
+    if (!sets->pps[id])
+        sets->pps[id] = g_byte_array_sized_new(length);
+    g_byte_array_set_size(sets->pps[id], 0);
+    g_byte_array_append(sets->pps[id], nalu, length);
+    sets->pps_sps_id[id] = sps_id;
+    ++(sets->generation);
 
-    return retval;
+    return true;
 }
 
-static INLINE uint32_t
-h264_decode_sexpgolomb(const uint8_t *bitstream,
-                       size_t        *offset)
+/* NOTE: avcC is ISO/IEC 14496-15 5.2.4.1, profile and level come from the
+ * lowest SPS id; high profiles carry the chroma format and bit depths */
+static bool
+h264_build_parameter_sets(h264_parameter_sets_t *sets)
 {
-    uint32_t retval = 0;
+    const h264_sps_entry_t *first    = NULL;
+    uint8_t                 header[6];
+    uint8_t                 trailer[4];
+    uint8_t                 length[2];
+    size_t                  spscount = 0;
+    size_t                  ppscount = 0;
+    size_t                  id       = 0;
+    uint8_t                 count    = 0;
 
-    g_return_val_if_fail(NULL != bitstream, 0);
-    g_return_val_if_fail(NULL != offset, 0);
+    static const uint8_t start_code[] = {0x00, 0x00, 0x00, 0x01};
 
-    retval = h264_decode_uexpgolomb(bitstream, offset);
-    retval = (retval & 0x01 ? -1 : 1) * ceil(retval / 2.0);
+    g_return_val_if_fail(NULL != sets, false);
 
-    return retval;
-}
-
-static INLINE uint32_t
-h264_get_bits(const uint8_t *bitstream,
-              size_t        *offset,
-              size_t         count)
-{
-    size_t   limit = 0;
-    uint32_t code  = 0;
+    if (sets->avcc && sets->built == sets->generation)
+        return true;
 
-    g_return_val_if_fail(NULL != bitstream, 0);
-    g_return_val_if_fail(NULL != offset, 0);
-    g_return_val_if_fail(0 < count, 0);
+    for (id = 0; id < H264_MAX_SPS_COUNT; id++)
+    {
+        if (!sets->sps[id].emitted)
+            continue;
+        first = first ? first : &(sets->sps[id]);
+        ++spscount;
+    }
+    for (id = 0; id < H264_MAX_PPS_COUNT; id++)
+        ppscount += (NULL != sets->pps[id]);
+    if (!first || ppscount == 0)
+        return false;
+
+    /* The record counts SPS in 5 bits and PPS in 8 */
+    spscount = MIN(spscount, 31);
+    ppscount = MIN(ppscount, 255);
+
+    if (!sets->avcc)
+        sets->avcc = g_byte_array_new();
+    if (!sets->annexb)
+        sets->annexb = g_byte_array_new();
+    g_byte_array_set_size(sets->avcc, 0);
+    g_byte_array_set_size(sets->annexb, 0);
+
+    header[0] = 1;
+    header[1] = first->decoded.profile_idc;
+    header[2] = first->emitted->data[2];
+    header[3] = first->decoded.level_idc;
+    header[4] = 0xFC | 3;
+    header[5] = 0xE0 | spscount;
+    g_byte_array_append(sets->avcc, header, sizeof(header));
+    for (id = 0, count = 0; id < H264_MAX_SPS_COUNT && count < spscount;
+         id++)
+    {
+        if (!sets->sps[id].emitted)
+            continue;
+        length[0] = sets->sps[id].emitted->len >> 8;
+        length[1] = sets->sps[id].emitted->len & 0xFF;
+        g_byte_array_append(sets->avcc, length, sizeof(length));
+        g_byte_array_append(sets->avcc, sets->sps[id].emitted->data,
+                sets->sps[id].emitted->len);
+        g_byte_array_append(sets->annexb, start_code, sizeof(start_code));
+        g_byte_array_append(sets->annexb, sets->sps[id].emitted->data,
+                sets->sps[id].emitted->len);
+        ++count;
+    }
 
-    for (limit = *offset + count; *offset < limit; (*offset)++)
-        code = (code << 1) + h264_get_bit(bitstream, *offset);
+    header[0] = ppscount;
+    g_byte_array_append(sets->avcc, header, 1);
+    for (id = 0, count = 0; id < H264_MAX_PPS_COUNT && count < ppscount;
+         id++)
+    {
+        if (!sets->pps[id])
+            continue;
+        length[0] = sets->pps[id]->len >> 8;
+        length[1] = sets->pps[id]->len & 0xFF;
+        g_byte_array_append(sets->avcc, length, sizeof(length));
+        g_byte_array_append(sets->avcc, sets->pps[id]->data,
+                sets->pps[id]->len);
+        g_byte_array_append(sets->annexb, start_code, sizeof(start_code));
+        g_byte_array_append(sets->annexb, sets->pps[id]->data,
+                sets->pps[id]->len);
+        ++count;
+    }
 
-    return code;
-}
+    if (h264_is_high_profile(first->decoded.profile_idc))
+    {
+        trailer[0] = 0xFC | first->decoded.chroma_format_idc;
+        trailer[1] = 0xF8 | first->decoded.bit_depth_luma_minus8;
+        trailer[2] = 0xF8 | first->decoded.bit_depth_chroma_minus8;
+        trailer[3] = 0;
+        g_byte_array_append(sets->avcc, trailer, sizeof(trailer));
+    }
 
-static INLINE uint32_t
-h264_get_bit(const uint8_t *bitstream,
-             size_t         offset)
-{
-    g_return_val_if_fail(NULL != bitstream, 0);
+    sets->built = sets->generation;
 
-    return (bitstream[offset >> 3] >> (7 - (offset & 0x7))) & 0x01;
+    return true;
 }
 
+/* NOTE: leaves alone a bit past the end and a zero byte of a 00 00 03,
+ * setting it would turn the emulation prevention byte into data */
 static INLINE void
 h264_set_bit(uint8_t *bitstream,
+             size_t   length,
              size_t   offset)
 {
+    size_t index = offset >> 3;
+
     g_return_if_fail(NULL != bitstream);
 
-    bitstream[offset >> 3] |= (0x01 << (7 - (offset & 0x7)));
+    if (index >= length)
+        return;
+    if (bitstream[index] == 0x00 &&
+        ((index >= 1 && index + 1 < length && bitstream[index - 1] == 0x00 &&
+          bitstream[index + 1] == 0x03) ||
+         (index + 2 < length && bitstream[index + 1] == 0x00 &&
+          bitstream[index + 2] == 0x03)))
+        return;
+
+    bitstream[index] |= (0x01 << (7 - (offset & 0x7)));
 }
 
 static INLINE void
@@ -7,6 +7,7 @@
 
 #pragma once
 
+#include <glib.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -40,51 +41,151 @@ extern "C"
 
     } __attribute__ ((__packed__)) h264_fu_header_t;
 
+    #define H264_MAX_SPS_COUNT 32
+    #define H264_MAX_PPS_COUNT 256
+    #define H264_MAX_SPS_SIZE  1024
+
+    struct h264_parameter_sets_t;
+
     typedef struct h264_context_t
     {
         /* NALU Header */
-        uint8_t forbidden_zero_bit;
-        uint8_t nal_ref_idc;
-        uint8_t nal_unit_type;
+        uint8_t  forbidden_zero_bit;
+        uint8_t  nal_ref_idc;
+        uint8_t  nal_unit_type;
 
         /* H.264 Slice Header */
-        uint8_t first_mb_in_slice;
-        uint8_t slice_type;
-        uint8_t pic_parameter_set_id;
-        uint8_t colour_plane_id; // not present in Baseline Profile
-        uint8_t frame_num;
+        uint32_t first_mb_in_slice;
+        uint8_t  slice_type;
+        uint8_t  pic_parameter_set_id;
+        uint8_t  colour_plane_id; // not present in Baseline Profile
+        uint16_t frame_num;
 
         /* H.264 Sequence Parameter Set */
-        uint8_t profile_idc;
-        bool    constraint_set0_flag;
-        bool    constraint_set1_flag;
-        bool    constraint_set2_flag;
-        bool    constraint_set3_flag;
-        bool    reserved_zero_4bits;
-        uint8_t level_idc;
-        uint8_t seq_parameter_set_id;
-        uint8_t chroma_format_idc;  // not present in Baseline Profile
-        bool    separate_colour_plane_flag; // not present in Baseline Profile
-        uint8_t log2_max_frame_num_minus4;
-        uint8_t pic_order_cnt_type;
-        uint8_t log2_max_pic_order_cnt_lsb_minus4;
-        bool    delta_pic_order_always_zero_flag;
-        int8_t  offset_for_non_ref_pic;
-        int8_t  offset_for_top_to_bottom_field;
-        int8_t  num_ref_frames_in_pic_order_cnt_cycle;
-        uint8_t num_ref_frames;
-        bool    gaps_in_frame_num_value_allowed_flag;
-        uint8_t pic_width_in_mbs_minus_1;
-        uint8_t pic_height_in_map_units_minus_1;
-        bool    frame_mbs_only_flag;
-        bool    direct_8x8_inference_flag;
-        bool    frame_cropping_flag;
-        bool    vui_prameters_present_flag;
-        bool    rbsp_stop_one_bit;
+        uint8_t  profile_idc;
+        bool     constraint_set0_flag;
+        bool     constraint_set1_flag;
+        bool     constraint_set2_flag;
+        bool     constraint_set3_flag;
+        bool     reserved_zero_4bits;
+        uint8_t  level_idc;
+        uint8_t  seq_parameter_set_id;
+        uint8_t  chroma_format_idc;  // not present in Baseline Profile
+        bool     separate_colour_plane_flag; // not present in Baseline Profile
+        uint8_t  bit_depth_luma_minus8; // not present in Baseline Profile
+        uint8_t  bit_depth_chroma_minus8; // not present in Baseline Profile
+        bool     qpprime_y_zero_transform_bypass_flag; // not present in Baseline Profile
+        bool     seq_scaling_matrix_present_flag; // not present in Baseline Profile
+        uint8_t  log2_max_frame_num_minus4;
+        uint8_t  pic_order_cnt_type;
+        uint8_t  log2_max_pic_order_cnt_lsb_minus4;
+        bool     delta_pic_order_always_zero_flag;
+        int32_t  offset_for_non_ref_pic;
+        int32_t  offset_for_top_to_bottom_field;
+        uint8_t  num_ref_frames_in_pic_order_cnt_cycle;
+        uint8_t  num_ref_frames;
+        bool     gaps_in_frame_num_value_allowed_flag;
+        uint32_t pic_width_in_mbs_minus_1;
+        uint32_t pic_height_in_map_units_minus_1;
+        bool     frame_mbs_only_flag;
+        bool     mb_adaptive_frame_field_flag;
+        bool     direct_8x8_inference_flag;
+        bool     frame_cropping_flag;
+        uint32_t frame_crop_left_offset;
+        uint32_t frame_crop_right_offset;
+        uint32_t frame_crop_top_offset;
+        uint32_t frame_crop_bottom_offset;
+        bool     vui_prameters_present_flag;
+        bool     rbsp_stop_one_bit;
+
+        /* H.264 VUI Parameters (Annex E) */
+        bool     aspect_ratio_info_present_flag;
+        uint8_t  aspect_ratio_idc;
+        uint16_t sar_width;
+        uint16_t sar_height;
+        bool     overscan_info_present_flag;
+        bool     overscan_appropriate_flag;
+        bool     video_signal_type_present_flag;
+        uint8_t  video_format;
+        bool     video_full_range_flag;
+        bool     colour_description_present_flag;
+        uint8_t  colour_primaries;
+        uint8_t  transfer_characteristics;
+        uint8_t  matrix_coefficients;
+        bool     chroma_loc_info_present_flag;
+        uint8_t  chroma_sample_loc_type_top_field;
+        uint8_t  chroma_sample_loc_type_bottom_field;
+        bool     timing_info_present_flag;
+        uint32_t num_units_in_tick;
+        uint32_t time_scale;
+        bool     fixed_frame_rate_flag;
+        bool     nal_hrd_parameters_present_flag;
+        bool     vcl_hrd_parameters_present_flag;
+        bool     low_delay_hrd_flag;
+        bool     pic_struct_present_flag;
+        bool     bitstream_restriction_flag;
+        bool     motion_vectors_over_pic_boundaries_flag;
+        uint8_t  max_bytes_per_pic_denom;
+        uint8_t  max_bits_per_mb_denom;
+        uint8_t  log2_max_mv_length_horizontal;
+        uint8_t  log2_max_mv_length_vertical;
+        uint8_t  max_num_reorder_frames;
+        uint8_t  max_dec_frame_buffering;
+
+        /* Derived from the SPS: the cropped output size in pixels and the
+         * frame rate as a reduced fraction, 0/0 without timing info. The
+         * reorder and DPB depths above are inferred as E.2.1 says when
+         * the VUI leaves them out */
+        uint32_t width;
+        uint32_t height;
+        uint32_t framerate_num;
+        uint32_t framerate_den;
+
+        /* Reassembly state, bytes written since the rebuilt header of the
+         * NALU being defragmented and, for vectors, its prefix offset. For
+         * Annex B, fu_zeros is the zero bytes its last fragment ended with */
+        size_t    fu_offset;
+        uint32_t  fu_length;
+        uint8_t   fu_zeros;
+
+        /* Parameter sets seen so far, owned by the depacketizer and NULL
+         * in the contexts of media and vectors, which reach them through
+         * rtp_depacketizer_get_parameter_sets(). generation is theirs when
+         * this context was last decoded */
+        struct h264_parameter_sets_t *parameter_sets;
+        guint32                       generation;
 
     } h264_context_t;
 
+    /* An SPS as received, to spot repeats, and as emitted with the gaps
+     * flag patched, along with what it decoded to */
+    typedef struct h264_sps_entry_t
+    {
+        GByteArray     *received;
+        GByteArray     *emitted;
+        size_t          gaps_offset;
+        h264_context_t  decoded;
+
+    } h264_sps_entry_t;
+
+    /* SPS and PPS by id. Repeats are compared by content and cost a
+     * memcmp, generation only moves when a set is new or its bytes differ.
+     * The avcC record and the Annex B blob of all sets are rebuilt on
+     * demand once generation has moved past built */
+    typedef struct h264_parameter_sets_t
+    {
+        h264_sps_entry_t  sps[H264_MAX_SPS_COUNT];
+        GByteArray       *pps[H264_MAX_PPS_COUNT];
+        uint8_t           pps_sps_id[H264_MAX_PPS_COUNT];
+        guint32           generation;
+        guint32           built;
+        GByteArray       *avcc;
+        GByteArray       *annexb;
+
+    } h264_parameter_sets_t;
+
     typedef enum prefix_t prefix_t;
+    typedef struct media_vector_t media_vector_t;
 
     bool h264_reassemble_frame(uint8_t **index, size_t *length, const uint8_t *limit,
             prefix_t prefix, const uint8_t *naluptr, size_t nalulen, bool completed,
@@ -93,6 +194,20 @@ extern "C"
     uint8_t h264_get_frame_type(const uint8_t *naluptr, size_t nalulen);
     bool h264_is_first_nalu(const uint8_t *naluptr, size_t nalulen);
     bool h264_is_last_nalu(const uint8_t *naluptr, size_t nalulen);
+    size_t h264_measure_nalu(const uint8_t *naluptr, size_t nalulen,
+            prefix_t prefix);
+    void h264_conceal_nalu(uint8_t *output, size_t length, bool closing,
+            void *data);
+    bool h264_scatter_frame(media_vector_t *vector, prefix_t prefix,
+            const uint8_t *naluptr, size_t nalulen, bool completed,
+            void *data);
+    void h264_merge_context(void *data, const void *frame);
+    h264_parameter_sets_t *h264_parameter_sets_create(void);
+    bool h264_parameter_sets_get_avcc(h264_parameter_sets_t *sets,
+            const uint8_t **data, size_t *length);
+    bool h264_parameter_sets_get_annexb(h264_parameter_sets_t *sets,
+            const uint8_t **data, size_t *length);
+    void h264_parameter_sets_destroy(gpointer data);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,1314 @@
+/*
+ * Author: Pu-Chen Mao
+ * Date:   2026/10/15
+ * File:   hevc.c
+ * Desc:   H.265/HEVC RTP (RFC 7798) bitstream reassembly
+ */
+
+#include <arpa/inet.h>
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bitstream.h"
+#include "format.h"
+#include "hevc.h"
+#include "media.h"
+#include "scan.h"
+
+// #define DEBUG
+#define INLINE inline
+
+/* NOTE: sprop-max-don-diff is taken to be 0, as it is for every sender we
+ * know of, so aggregation and fragmentation units carry no DONL or DOND */
+#define HEVC_NALU_HEADER_SIZE 2
+#define HEVC_AP               48
+#define HEVC_FU               49
+
+static INLINE uint8_t hevc_get_nalu_type(const uint8_t *naluptr);
+static INLINE bool hevc_compose_single_nalu(uint8_t **index, size_t *length,
+        const uint8_t *limit, prefix_t prefix, const uint8_t *naluptr,
+        size_t nalulen);
+static INLINE bool hevc_compose_aggregation_unit(uint8_t **index,
+        size_t *length, const uint8_t *limit, prefix_t prefix,
+        const uint8_t *naluptr, size_t nalulen, hevc_context_t *context);
+static INLINE bool hevc_compose_fragmentation_unit(uint8_t **index,
+        size_t *length, const uint8_t *limit, prefix_t prefix,
+        const uint8_t *naluptr, size_t nalulen, bool completed,
+        hevc_context_t *context);
+static INLINE bool hevc_compose_prefix(uint8_t **index, size_t *length,
+        const uint8_t *limit, prefix_t prefix, size_t nalulen);
+static INLINE bool hevc_scatter_single_nalu(media_vector_t *vector,
+        prefix_t prefix, const uint8_t *naluptr, size_t nalulen,
+        hevc_context_t *context);
+static INLINE bool hevc_scatter_aggregation_unit(media_vector_t *vector,
+        prefix_t prefix, const uint8_t *naluptr, size_t nalulen,
+        hevc_context_t *context);
+static INLINE bool hevc_scatter_fragmentation_unit(media_vector_t *vector,
+        prefix_t prefix, const uint8_t *naluptr, size_t nalulen,
+        bool completed, hevc_context_t *context);
+static INLINE bool hevc_scatter_prefix(media_vector_t *vector,
+        prefix_t prefix, size_t nalulen);
+static INLINE void hevc_rebuild_nalu_header(uint8_t *header,
+        const uint8_t *naluptr, const hevc_fu_header_t *fuhdr,
+        bool completed);
+static INLINE bool hevc_decode_context(const uint8_t *nalu, size_t nalulen,
+        hevc_context_t *context);
+static INLINE void hevc_decode_nalu_header(bitstream_t *reader,
+        hevc_context_t *context);
+static INLINE bool hevc_decode_slice_header(const uint8_t *nalu,
+        size_t length, hevc_context_t *context);
+static INLINE bool hevc_update_vps(const uint8_t *nalu, size_t length,
+        hevc_context_t *context);
+static INLINE bool hevc_update_sps(const uint8_t *nalu, size_t length,
+        hevc_context_t *context);
+static INLINE bool hevc_decode_sps(const uint8_t *rbsp, size_t length,
+        hevc_context_t *context);
+static INLINE bool hevc_update_pps(const uint8_t *nalu, size_t length,
+        hevc_context_t *context);
+static INLINE void hevc_decode_profile_tier_level(bitstream_t *reader,
+        uint8_t max_sub_layers_minus1, hevc_context_t *context);
+static INLINE bool hevc_store_parameter_set(hevc_parameter_sets_t *sets,
+        GByteArray **slot, const uint8_t *nalu, size_t length);
+static bool hevc_build_parameter_sets(hevc_parameter_sets_t *sets);
+static void hevc_append_array(hevc_parameter_sets_t *sets, uint8_t type,
+        GByteArray **list, size_t count);
+static INLINE void hevc_print_sps(const hevc_context_t *context);
+
+bool
+hevc_reassemble_frame(uint8_t       **index,
+                      size_t         *length,
+                      const uint8_t  *limit,
+                      prefix_t        prefix,
+                      const uint8_t  *payload,
+                      size_t          size,
+                      bool            completed,
+                      void           *data)
+{
+    hevc_context_t *context = NULL;
+    uint8_t        *start   = NULL;
+    uint8_t         type    = 0;
+    bool            result  = false;
+
+    g_return_val_if_fail(NULL != index, false);
+    g_return_val_if_fail(NULL != *index, false);
+    g_return_val_if_fail(NULL != length, false);
+    g_return_val_if_fail(NULL != limit, false);
+    g_return_val_if_fail(NULL != payload, false);
+    g_return_val_if_fail(NULL != data, false);
+    g_return_val_if_fail(HEVC_NALU_HEADER_SIZE < size, false);
+
+    start = *index + ((prefix == PREFIX_NONE) ? 0 : sizeof(uint32_t));
+    context = (hevc_context_t *)(data);
+
+    /* Any unit but an FU closes the FU still open, as for H.264 */
+    type = hevc_get_nalu_type(payload);
+    if (type != HEVC_FU)
+    {
+        context->fu_length = 0;
+        context->fu_zeros = 0;
+    }
+    if (type < HEVC_AP)
+        result = hevc_compose_single_nalu(index, length, limit, prefix,
+                payload, size) && hevc_decode_context(start, size, context);
+    else if (type == HEVC_AP)
+        result = hevc_compose_aggregation_unit(index, length, limit, prefix,
+                payload, size, context);
+    else if (type == HEVC_FU)
+        result = hevc_compose_fragmentation_unit(index, length, limit,
+                prefix, payload, size, completed, context);
+    else
+        result = false;
+
+    return result;
+}
+
+bool
+hevc_is_fragmented(const uint8_t *naluptr,
+                   size_t         nalulen)
+{
+    g_return_val_if_fail(NULL != naluptr, false);
+    g_return_val_if_fail(HEVC_NALU_HEADER_SIZE <= nalulen, false);
+
+    return hevc_get_nalu_type(naluptr) == HEVC_FU;
+}
+
+uint8_t
+hevc_get_frame_type(const uint8_t *naluptr,
+                    size_t         nalulen)
+{
+    g_return_val_if_fail(NULL != naluptr, 0);
+
+    return hevc_get_nalu_type(naluptr + sizeof(uint32_t));
+}
+
+bool
+hevc_is_first_nalu(const uint8_t *naluptr,
+                   size_t         nalulen)
+{
+    hevc_fu_header_t *fuhdr = NULL;
+    uint8_t           type  = 0;
+
+    g_return_val_if_fail(NULL != naluptr, false);
+    g_return_val_if_fail(HEVC_NALU_HEADER_SIZE < nalulen, false);
+
+    type = hevc_get_nalu_type(naluptr);
+    fuhdr = (hevc_fu_header_t *)(naluptr + HEVC_NALU_HEADER_SIZE);
+    switch (type)
+    {
+        case 36: /* End of sequence */
+        case 37: /* End of bitstream */
+            return false;
+        case HEVC_AP:
+            return true;
+        case HEVC_FU:
+            return fuhdr->start;
+        default:
+            return type < HEVC_AP;
+    }
+}
+
+bool
+hevc_is_last_nalu(const uint8_t *naluptr,
+                  size_t         nalulen)
+{
+    hevc_fu_header_t *fuhdr = NULL;
+    uint8_t           type  = 0;
+
+    g_return_val_if_fail(NULL != naluptr, false);
+    g_return_val_if_fail(HEVC_NALU_HEADER_SIZE < nalulen, false);
+
+    type = hevc_get_nalu_type(naluptr);
+    fuhdr = (hevc_fu_header_t *)(naluptr + HEVC_NALU_HEADER_SIZE);
+    switch (type)
+    {
+        case HEVC_AP:
+            return false;
+        case HEVC_FU:
+            return fuhdr->end;
+        default:
+            return type < HEVC_AP;
+    }
+}
+
+/* NOTE: returns the bytes the reassembled form of this RTP payload takes,
+ * prefixes included, or 0 for payloads that cannot be reassembled; mirrors
+ * the hevc_compose_*() functions below */
+size_t
+hevc_measure_nalu(const uint8_t *naluptr,
+                  size_t         nalulen,
+                  prefix_t       prefix)
+{
+    hevc_fu_header_t *fuhdr    = NULL;
+    const uint8_t    *aulenptr = NULL;
+    uint16_t          aulen    = 0;
+    size_t            hdrlen   = 0;
+    size_t            size     = 0;
+    uint8_t           type     = 0;
+
+    g_return_val_if_fail(NULL != naluptr, 0);
+    g_return_val_if_fail(HEVC_NALU_HEADER_SIZE < nalulen, 0);
+
+    hdrlen = (prefix == PREFIX_NONE) ? 0 : sizeof(uint32_t);
+    type = hevc_get_nalu_type(naluptr);
+    if (type < HEVC_AP)
+        size = hdrlen + nalulen;
+    else if (type == HEVC_AP)
+    {
+        for (aulenptr = naluptr + HEVC_NALU_HEADER_SIZE;
+             aulenptr + sizeof(uint16_t) < naluptr + nalulen;
+             aulenptr += sizeof(uint16_t) + aulen)
+        {
+            aulen = (aulenptr[0] << 8) | aulenptr[1];
+            if (aulenptr + sizeof(uint16_t) + aulen > naluptr + nalulen)
+                return 0;
+            size += hdrlen + aulen;
+        }
+    }
+    else if (type == HEVC_FU)
+    {
+        fuhdr = (hevc_fu_header_t *)(naluptr + HEVC_NALU_HEADER_SIZE);
+        size = nalulen - HEVC_NALU_HEADER_SIZE - sizeof(*fuhdr);
+        if (fuhdr->start)
+            size += hdrlen + HEVC_NALU_HEADER_SIZE;
+    }
+
+    return size;
+}
+
+/* NOTE: sets the forbidden_zero_bit of the NALU still being defragmented,
+ * as h264_conceal_nalu() does */
+void
+hevc_conceal_nalu(uint8_t *output,
+                  size_t   length,
+                  bool     closing,
+                  void    *data)
+{
+    hevc_context_t *context = NULL;
+
+    g_return_if_fail(NULL != output);
+    g_return_if_fail(NULL != data);
+
+    context = (hevc_context_t *)(data);
+    if (context->fu_length > 0 && context->fu_length <= length)
+        output[length - context->fu_length] |= 0x80;
+    if (closing)
+    {
+        context->fu_length = 0;
+        context->fu_zeros = 0;
+    }
+}
+
+/* NOTE: same output as hevc_reassemble_frame(), but payload bytes are only
+ * referenced by the vector. Nothing is patched, so unlike H.264 no NALU
+ * needs copying */
+bool
+hevc_scatter_frame(media_vector_t *vector,
+                   prefix_t        prefix,
+                   const uint8_t  *payload,
+                   size_t          size,
+                   bool            completed,
+                   void           *data)
+{
+    hevc_context_t *context = NULL;
+    uint8_t         type    = 0;
+    bool            result  = false;
+
+    g_return_val_if_fail(NULL != vector, false);
+    g_return_val_if_fail(NULL != payload, false);
+    g_return_val_if_fail(NULL != data, false);
+    g_return_val_if_fail(HEVC_NALU_HEADER_SIZE < size, false);
+
+    context = (hevc_context_t *)(data);
+    type = hevc_get_nalu_type(payload);
+    if (type != HEVC_FU)
+    {
+        context->fu_length = 0;
+        context->fu_zeros = 0;
+    }
+    if (type < HEVC_AP)
+        result = hevc_scatter_single_nalu(vector, prefix, payload, size,
+                context);
+    else if (type == HEVC_AP)
+        result = hevc_scatter_aggregation_unit(vector, prefix, payload,
+                size, context);
+    else if (type == HEVC_FU)
+        result = hevc_scatter_fragmentation_unit(vector, prefix, payload,
+                size, completed, context);
+    else
+        result = false;
+
+    return result;
+}
+
+/* NOTE: as h264_merge_context(), the VPS, SPS and PPS fields are taken
+ * again from the cache through the slice's PPS, everything else but the
+ * reassembly state of data is the frame's */
+void
+hevc_merge_context(void       *data,
+                   const void *frame)
+{
+    hevc_context_t        *context = NULL;
+    const hevc_context_t  *decoded = NULL;
+    hevc_parameter_sets_t *sets    = NULL;
+    hevc_context_t         merged;
+    uint8_t                pps_id  = 0;
+    uint8_t                sps_id  = 0;
+
+    g_return_if_fail(NULL != data);
+    g_return_if_fail(NULL != frame);
+
+    context = (hevc_context_t *)(data);
+    decoded = (const hevc_context_t *)(frame);
+    sets = context->parameter_sets;
+    pps_id = decoded->slice_pic_parameter_set_id;
+    sps_id = sets ? sets->pps_sps_id[pps_id] : 0;
+
+    if (sets && sets->pps[pps_id] && sets->sps[sps_id].received)
+    {
+        merged = sets->sps[sps_id].decoded;
+        merged.parameter_sets = sets;
+        hevc_update_pps(sets->pps[pps_id]->data, sets->pps[pps_id]->len,
+                &merged);
+    }
+    else if ((gint32)(decoded->generation - context->generation) < 0)
+        merged = *context;
+    else
+        merged = *decoded;
+    merged.forbidden_zero_bit = decoded->forbidden_zero_bit;
+    merged.nal_unit_type = decoded->nal_unit_type;
+    merged.nuh_layer_id = decoded->nuh_layer_id;
+    merged.nuh_temporal_id_plus1 = decoded->nuh_temporal_id_plus1;
+    merged.first_slice_segment_in_pic_flag =
+        decoded->first_slice_segment_in_pic_flag;
+    merged.no_output_of_prior_pics_flag =
+        decoded->no_output_of_prior_pics_flag;
+    merged.slice_pic_parameter_set_id = decoded->slice_pic_parameter_set_id;
+    merged.fu_offset = context->fu_offset;
+    merged.fu_length = context->fu_length;
+    merged.fu_zeros = context->fu_zeros;
+    merged.parameter_sets = sets;
+    merged.generation = sets ? sets->generation : decoded->generation;
+    *context = merged;
+}
+
+hevc_parameter_sets_t *
+hevc_parameter_sets_create(void)
+{
+    return g_try_new0(hevc_parameter_sets_t, 1);
+}
+
+/* NOTE: the record covers every VPS, SPS and PPS seen, with 4-byte NALU
+ * lengths. It stays valid until the next call after generation has moved */
+bool
+hevc_parameter_sets_get_hvcc(hevc_parameter_sets_t  *sets,
+                             const uint8_t         **data,
+                             size_t                 *length)
+{
+    g_return_val_if_fail(NULL != sets, false);
+    g_return_val_if_fail(NULL != data, false);
+    g_return_val_if_fail(NULL != length, false);
+
+    if (!hevc_build_parameter_sets(sets))
+        return false;
+
+    *data = sets->hvcc->data;
+    *length = sets->hvcc->len;
+
+    return true;
+}
+
+/* NOTE: every VPS, then SPS, then PPS, each behind a 4-byte start code */
+bool
+hevc_parameter_sets_get_annexb(hevc_parameter_sets_t  *sets,
+                               const uint8_t         **data,
+                               size_t                 *length)
+{
+    g_return_val_if_fail(NULL != sets, false);
+    g_return_val_if_fail(NULL != data, false);
+    g_return_val_if_fail(NULL != length, false);
+
+    if (!hevc_build_parameter_sets(sets))
+        return false;
+
+    *data = sets->annexb->data;
+    *length = sets->annexb->len;
+
+    return true;
+}
+
+void
+hevc_parameter_sets_destroy(gpointer data)
+{
+    hevc_parameter_sets_t *sets = NULL;
+    size_t                 id   = 0;
+
+    g_return_if_fail(NULL != data);
+
+    sets = (hevc_parameter_sets_t *)(data);
+    for (id = 0; id < HEVC_MAX_VPS_COUNT; id++)
+        if (sets->vps[id])
+            g_byte_array_free(sets->vps[id], TRUE);
+    for (id = 0; id < HEVC_MAX_SPS_COUNT; id++)
+        if (sets->sps[id].received)
+            g_byte_array_free(sets->sps[id].received, TRUE);
+    for (id = 0; id < HEVC_MAX_PPS_COUNT; id++)
+        if (sets->pps[id])
+            g_byte_array_free(sets->pps[id], TRUE);
+    if (sets->hvcc)
+        g_byte_array_free(sets->hvcc, TRUE);
+    if (sets->annexb)
+        g_byte_array_free(sets->annexb, TRUE);
+    g_clear_pointer(&sets, g_free);
+}
+
+static INLINE uint8_t
+hevc_get_nalu_type(const uint8_t *naluptr)
+{
+    return (naluptr[0] >> 1) & 0x3F;
+}
+
+static INLINE bool
+hevc_compose_single_nalu(uint8_t       **index,
+                         size_t         *length,
+                         const uint8_t  *limit,
+                         prefix_t        prefix,
+                         const uint8_t  *naluptr,
+                         size_t          nalulen)
+{
+    uint8_t zeros  = 0;
+    bool    result = false;
+
+    g_return_val_if_fail(NULL != index, false);
+    g_return_val_if_fail(NULL != *index, false);
+    g_return_val_if_fail(NULL != length, false);
+    g_return_val_if_fail(NULL != limit, false);
+    g_return_val_if_fail(NULL != naluptr, false);
+
+    if (prefix == PREFIX_ANNEXB && !scan_validate_payload(naluptr, nalulen,
+                &zeros))
+        return false;
+    result = hevc_compose_prefix(index, length, limit, prefix, nalulen);
+    g_return_val_if_fail(result, false);
+    g_return_val_if_fail(*index + nalulen <= limit, false);
+    memcpy(*index, naluptr, nalulen);
+    *index += nalulen;
+    *length += nalulen;
+
+    return true;
+}
+
+static INLINE bool
+hevc_compose_aggregation_unit(uint8_t       **index,
+                              size_t         *length,
+                              const uint8_t  *limit,
+                              prefix_t        prefix,
+                              const uint8_t  *naluptr,
+                              size_t          nalulen,
+                              hevc_context_t *context)
+{
+    const uint8_t *aulenptr = NULL;
+    const uint8_t *auptr    = NULL;
+    uint16_t       aulen    = 0;
+    uint8_t        zeros    = 0;
+    bool           result   = false;
+
+    g_return_val_if_fail(NULL != index, false);
+    g_return_val_if_fail(NULL != *index, false);
+    g_return_val_if_fail(NULL != length, false);
+    g_return_val_if_fail(NULL != limit, false);
+    g_return_val_if_fail(NULL != naluptr, false);
+    g_return_val_if_fail(NULL != context, false);
+
+    for (aulenptr = naluptr + HEVC_NALU_HEADER_SIZE;
+         aulenptr + sizeof(uint16_t) < naluptr + nalulen;
+         aulenptr += sizeof(uint16_t) + aulen)
+    {
+        auptr = aulenptr + sizeof(uint16_t);
+        aulen = (aulenptr[0] << 8) | aulenptr[1];
+        g_return_val_if_fail(auptr + aulen <= naluptr + nalulen, false);
+        zeros = 0;
+        if (prefix == PREFIX_ANNEXB &&
+            !scan_validate_payload(auptr, aulen, &zeros))
+            return false;
+        result = hevc_compose_prefix(index, length, limit, prefix, aulen);
+        g_return_val_if_fail(result, false);
+        g_return_val_if_fail(*index + aulen <= limit, false);
+        memcpy(*index, auptr, aulen);
+        *index += aulen;
+        *length += aulen;
+        if (aulen > HEVC_NALU_HEADER_SIZE)
+            hevc_decode_context(*index - aulen, aulen, context);
+    }
+
+    return true;
+}
+
+static INLINE bool
+hevc_compose_fragmentation_unit(uint8_t       **index,
+                                size_t         *length,
+                                const uint8_t  *limit,
+                                prefix_t        prefix,
+                                const uint8_t  *naluptr,
+                                size_t          nalulen,
+                                bool            completed,
+                                hevc_context_t *context)
+{
+    hevc_fu_header_t *fuhdr   = NULL;
+    uint8_t          *header  = NULL;
+    size_t            hdrlen  = 0;
+    uint32_t          avcclen = 0;
+    uint8_t           zeros   = 0;
+    bool              result  = false;
+
+    g_return_val_if_fail(NULL != index, false);
+    g_return_val_if_fail(NULL != *index, false);
+    g_return_val_if_fail(NULL != length, false);
+    g_return_val_if_fail(NULL != limit, false);
+    g_return_val_if_fail(NULL != naluptr, false);
+    g_return_val_if_fail(NULL != context, false);
+
+    hdrlen = HEVC_NALU_HEADER_SIZE + sizeof(hevc_fu_header_t);
+    g_return_val_if_fail(hdrlen <= nalulen, false);
+
+    fuhdr = (hevc_fu_header_t *)(naluptr + HEVC_NALU_HEADER_SIZE);
+    zeros = fuhdr->start ? 0 : context->fu_zeros;
+    if (prefix == PREFIX_ANNEXB && !scan_validate_payload(naluptr + hdrlen,
+                nalulen - hdrlen, &zeros))
+        return false;
+    context->fu_zeros = zeros;
+    if (fuhdr->start)
+    {
+        result = hevc_compose_prefix(index, length, limit, prefix, nalulen);
+        g_return_val_if_fail(result, false);
+        context->fu_length = HEVC_NALU_HEADER_SIZE;
+        g_return_val_if_fail(*index + HEVC_NALU_HEADER_SIZE <= limit, false);
+        header = *index;
+        hevc_rebuild_nalu_header(header, naluptr, fuhdr, completed);
+        *index += HEVC_NALU_HEADER_SIZE;
+        *length += HEVC_NALU_HEADER_SIZE;
+    }
+
+    g_return_val_if_fail(*index + (nalulen - hdrlen) <= limit, false);
+    memcpy(*index, naluptr + hdrlen, nalulen - hdrlen);
+    *index += nalulen - hdrlen;
+    *length += nalulen - hdrlen;
+    /* The slice segment header sits right after the rebuilt NALU header */
+    if (header && fuhdr->type < 32)
+        hevc_decode_context(header, *index - header, context);
+    if (context->fu_length > 0)
+        context->fu_length += nalulen - hdrlen;
+    if (context->fu_length > 0 && prefix == PREFIX_AVCC)
+    {
+        avcclen = htonl(context->fu_length);
+        memcpy(*index - context->fu_length - sizeof(avcclen), &avcclen,
+                sizeof(avcclen));
+    }
+    if (fuhdr->end)
+    {
+        context->fu_length = 0;
+        context->fu_zeros = 0;
+    }
+
+    return true;
+}
+
+static INLINE bool
+hevc_compose_prefix(uint8_t       **index,
+                    size_t         *length,
+                    const uint8_t  *limit,
+                    prefix_t        prefix,
+                    size_t          nalulen)
+{
+    static const uint8_t start_code[] = {0x00, 0x00, 0x00, 0x01};
+    uint32_t             avcclen      = 0;
+
+    g_return_val_if_fail(NULL != index, false);
+    g_return_val_if_fail(NULL != *index, false);
+    g_return_val_if_fail(NULL != length, false);
+    g_return_val_if_fail(NULL != limit, false);
+
+    switch (prefix)
+    {
+        case PREFIX_ANNEXB:
+            g_return_val_if_fail(*index + sizeof(start_code) <= limit, false);
+            memcpy(*index, start_code, sizeof(start_code));
+            break;
+        case PREFIX_AVCC:
+            g_return_val_if_fail(*index + sizeof(avcclen) <= limit, false);
+            avcclen = htonl((uint32_t)(nalulen));
+            memcpy(*index, &avcclen, sizeof(avcclen));
+            break;
+        case PREFIX_NONE:
+        default:
+            return true;
+    }
+    *index += sizeof(uint32_t);
+    *length += sizeof(uint32_t);
+
+    return true;
+}
+
+static INLINE bool
+hevc_scatter_single_nalu(media_vector_t *vector,
+                         prefix_t        prefix,
+                         const uint8_t  *naluptr,
+                         size_t          nalulen,
+                         hevc_context_t *context)
+{
+    uint8_t zeros = 0;
+
+    g_return_val_if_fail(NULL != vector, false);
+    g_return_val_if_fail(NULL != naluptr, false);
+    g_return_val_if_fail(NULL != context, false);
+
+    if (prefix == PREFIX_ANNEXB && !scan_validate_payload(naluptr, nalulen,
+                &zeros))
+        return false;
+    if (!hevc_scatter_prefix(vector, prefix, nalulen))
+        return false;
+
+    if (nalulen > HEVC_NALU_HEADER_SIZE)
+        hevc_decode_context(naluptr, nalulen, context);
+
+    return media_vector_append(vector, naluptr, nalulen);
+}
+
+static INLINE bool
+hevc_scatter_aggregation_unit(media_vector_t *vector,
+                              prefix_t        prefix,
+                              const uint8_t  *naluptr,
+                              size_t          nalulen,
+                              hevc_context_t *context)
+{
+    const uint8_t *aulenptr = NULL;
+    const uint8_t *auptr    = NULL;
+    uint16_t       aulen    = 0;
+
+    g_return_val_if_fail(NULL != vector, false);
+    g_return_val_if_fail(NULL != naluptr, false);
+    g_return_val_if_fail(NULL != context, false);
+
+    for (aulenptr = naluptr + HEVC_NALU_HEADER_SIZE;
+         aulenptr + sizeof(uint16_t) < naluptr + nalulen;
+         aulenptr += sizeof(uint16_t) + aulen)
+    {
+        auptr = aulenptr + sizeof(uint16_t);
+        aulen = (aulenptr[0] << 8) | aulenptr[1];
+        g_return_val_if_fail(auptr + aulen <= naluptr + nalulen, false);
+        if (!hevc_scatter_single_nalu(vector, prefix, auptr, aulen, context))
+            return false;
+    }
+
+    return true;
+}
+
+static INLINE bool
+hevc_scatter_fragmentation_unit(media_vector_t *vector,
+                                prefix_t        prefix,
+                                const uint8_t  *naluptr,
+                                size_t          nalulen,
+                                bool            completed,
+                                hevc_context_t *context)
+{
+    hevc_fu_header_t *fuhdr   = NULL;
+    uint8_t          *header  = NULL;
+    uint8_t           slice[64];
+    size_t            hdrlen  = 0;
+    size_t            length  = 0;
+    uint32_t          avcclen = 0;
+    uint8_t           zeros   = 0;
+
+    g_return_val_if_fail(NULL != vector, false);
+    g_return_val_if_fail(NULL != naluptr, false);
+    g_return_val_if_fail(NULL != context, false);
+
+    hdrlen = HEVC_NALU_HEADER_SIZE + sizeof(hevc_fu_header_t);
+    g_return_val_if_fail(hdrlen <= nalulen, false);
+
+    fuhdr = (hevc_fu_header_t *)(naluptr + HEVC_NALU_HEADER_SIZE);
+    zeros = fuhdr->start ? 0 : context->fu_zeros;
+    if (prefix == PREFIX_ANNEXB && !scan_validate_payload(naluptr + hdrlen,
+                nalulen - hdrlen, &zeros))
+        return false;
+    context->fu_zeros = zeros;
+    if (fuhdr->start)
+    {
+        context->fu_offset = vector->headerlen;
+        context->fu_length = HEVC_NALU_HEADER_SIZE;
+        if (!hevc_scatter_prefix(vector, prefix, nalulen))
+            return false;
+
+        header = media_vector_claim(vector, HEVC_NALU_HEADER_SIZE);
+        g_return_val_if_fail(NULL != header, false);
+        hevc_rebuild_nalu_header(header, naluptr, fuhdr, completed);
+
+        /* The slice segment header sits right after the rebuilt header */
+        length = MIN(sizeof(slice) - HEVC_NALU_HEADER_SIZE, nalulen - hdrlen);
+        memcpy(slice, header, HEVC_NALU_HEADER_SIZE);
+        memcpy(slice + HEVC_NALU_HEADER_SIZE, naluptr + hdrlen, length);
+        if (fuhdr->type < 32)
+            hevc_decode_context(slice, length + HEVC_NALU_HEADER_SIZE,
+                    context);
+
+        if (!media_vector_commit(vector, HEVC_NALU_HEADER_SIZE))
+            return false;
+    }
+
+    if (nalulen > hdrlen &&
+        !media_vector_append(vector, naluptr + hdrlen, nalulen - hdrlen))
+        return false;
+
+    if (context->fu_length > 0)
+        context->fu_length += nalulen - hdrlen;
+    if (context->fu_length > 0 && prefix == PREFIX_AVCC)
+    {
+        avcclen = htonl(context->fu_length);
+        memcpy(vector->header + context->fu_offset, &avcclen,
+                sizeof(avcclen));
+    }
+    if (fuhdr->end)
+    {
+        context->fu_length = 0;
+        context->fu_zeros = 0;
+    }
+
+    return true;
+}
+
+static INLINE bool
+hevc_scatter_prefix(media_vector_t *vector,
+                    prefix_t        prefix,
+                    size_t          nalulen)
+{
+    uint8_t *index  = NULL;
+    size_t   length = 0;
+
+    g_return_val_if_fail(NULL != vector, false);
+
+    index = media_vector_claim(vector, sizeof(uint32_t));
+    g_return_val_if_fail(NULL != index, false);
+    if (!hevc_compose_prefix(&index, &length, index + sizeof(uint32_t),
+                prefix, nalulen))
+        return false;
+
+    return media_vector_commit(vector, length);
+}
+
+/* NOTE: the FU payload header carries F, LayerId and TID of the NALU, its
+ * type is in the FU header. F is set for a NALU of an incomplete frame */
+static INLINE void
+hevc_rebuild_nalu_header(uint8_t                *header,
+                         const uint8_t          *naluptr,
+                         const hevc_fu_header_t *fuhdr,
+                         bool                    completed)
+{
+    g_return_if_fail(NULL != header);
+    g_return_if_fail(NULL != naluptr);
+    g_return_if_fail(NULL != fuhdr);
+
+    header[0] = (completed ? 0x00 : 0x80) | (fuhdr->type << 1) |
+        (naluptr[0] & 0x01);
+    header[1] = naluptr[1];
+}
+
+/* NOTE: the context only takes what decodes in full, a truncated or
+ * corrupt NALU leaves it as it was and does not fail reassembly */
+static INLINE bool
+hevc_decode_context(const uint8_t  *nalu,
+                    size_t          nalulen,
+                    hevc_context_t *context)
+{
+    hevc_context_t decoded;
+    uint8_t        type    = 0;
+    bool           result  = false;
+
+    g_return_val_if_fail(NULL != nalu, false);
+    g_return_val_if_fail(NULL != context, false);
+
+    if (nalulen <= HEVC_NALU_HEADER_SIZE)
+        return true;
+
+    decoded = *context;
+    type = hevc_get_nalu_type(nalu);
+    switch (type)
+    {
+        /* Get slice segment header information */
+        case 0 ... 9:   /* Trailing, TSA, STSA, RADL and RASL pictures */
+        case 16 ... 21: /* BLA, IDR and CRA pictures */
+            result = hevc_decode_slice_header(nalu, nalulen, &decoded);
+            break;
+        case 32: /* VPS */
+            result = hevc_update_vps(nalu, nalulen, &decoded);
+            break;
+        case 33: /* SPS */
+            result = hevc_update_sps(nalu, nalulen, &decoded);
+            break;
+        case 34: /* PPS */
+            result = hevc_update_pps(nalu, nalulen, &decoded);
+            break;
+        default: break;
+    }
+
+    if (result && decoded.parameter_sets)
+        decoded.generation = decoded.parameter_sets->generation;
+    if (result)
+        *context = decoded;
+
+    return true;
+}
+
+static INLINE void
+hevc_decode_nalu_header(bitstream_t    *reader,
+                        hevc_context_t *context)
+{
+    g_return_if_fail(NULL != reader);
+    g_return_if_fail(NULL != context);
+
+    context->forbidden_zero_bit = bitstream_get_bits(reader, 1);
+    context->nal_unit_type = bitstream_get_bits(reader, 6);
+    context->nuh_layer_id = bitstream_get_bits(reader, 6);
+    context->nuh_temporal_id_plus1 = bitstream_get_bits(reader, 3);
+}
+
+/* NOTE: only what precedes the PPS dependent fields of
+ * slice_segment_header() in 7.3.6.1 */
+static INLINE bool
+hevc_decode_slice_header(const uint8_t  *nalu,
+                         size_t          length,
+                         hevc_context_t *context)
+{
+    bitstream_t reader;
+    uint8_t     rbsp[16];
+    size_t      rbsplen = 0;
+    uint32_t    pps_id  = 0;
+
+    g_return_val_if_fail(NULL != nalu, false);
+    g_return_val_if_fail(NULL != context, false);
+
+    rbsplen = scan_extract_rbsp(nalu, length, rbsp, sizeof(rbsp));
+    bitstream_init(&reader, rbsp, rbsplen);
+    hevc_decode_nalu_header(&reader, context);
+    context->first_slice_segment_in_pic_flag = bitstream_get_bits(&reader, 1);
+    context->no_output_of_prior_pics_flag = false;
+    if (context->nal_unit_type >= 16 && context->nal_unit_type <= 23)
+        context->no_output_of_prior_pics_flag =
+            bitstream_get_bits(&reader, 1);
+    pps_id = bitstream_get_ue(&reader);
+    if (pps_id >= HEVC_MAX_PPS_COUNT)
+        return false;
+    context->slice_pic_parameter_set_id = pps_id;
+
+    return !reader.error;
+}
+
+/* NOTE: video_parameter_set_rbsp() of 7.3.2.1 up to the general profile,
+ * tier and level; a VPS is kept as is under its id */
+static INLINE bool
+hevc_update_vps(const uint8_t  *nalu,
+                size_t          length,
+                hevc_context_t *context)
+{
+    bitstream_t reader;
+    uint8_t     rbsp[64];
+    size_t      rbsplen = 0;
+
+    g_return_val_if_fail(NULL != nalu, false);
+    g_return_val_if_fail(NULL != context, false);
+
+    rbsplen = scan_extract_rbsp(nalu, length, rbsp, sizeof(rbsp));
+    bitstream_init(&reader, rbsp, rbsplen);
+    hevc_decode_nalu_header(&reader, context);
+    context->vps_video_parameter_set_id = bitstream_get_bits(&reader, 4);
+    context->vps_base_layer_internal_flag = bitstream_get_bits(&reader, 1);
+    context->vps_base_layer_available_flag = bitstream_get_bits(&reader, 1);
+    context->vps_max_layers_minus1 = bitstream_get_bits(&reader, 6);
+    context->vps_max_sub_layers_minus1 = bitstream_get_bits(&reader, 3);
+    context->vps_temporal_id_nesting_flag = bitstream_get_bits(&reader, 1);
+    /* vps_reserved_0xffff_16bits */
+    (void)(bitstream_get_bits(&reader, 16));
+    if (context->vps_max_sub_layers_minus1 > 6)
+        return false;
+    hevc_decode_profile_tier_level(&reader,
+            context->vps_max_sub_layers_minus1, context);
+    if (reader.error)
+        return false;
+
+    return !context->parameter_sets || hevc_store_parameter_set(
+            context->parameter_sets,
+            &(context->parameter_sets->vps[context->vps_video_parameter_set_id]),
+            nalu, length);
+}
+
+/* NOTE: an SPS whose bytes match the one cached under its id takes the
+ * decoded fields from the cache, as for H.264. The id sits behind the
+ * variable length profile_tier_level(), so the SPS is decoded first */
+static INLINE bool
+hevc_update_sps(const uint8_t  *nalu,
+                size_t          length,
+                hevc_context_t *context)
+{
+    hevc_parameter_sets_t *sets    = NULL;
+    hevc_sps_entry_t      *entry   = NULL;
+    hevc_context_t         decoded;
+    uint8_t                rbsp[HEVC_MAX_SPS_SIZE];
+    size_t                 rbsplen = 0;
+
+    g_return_val_if_fail(NULL != nalu, false);
+    g_return_val_if_fail(NULL != context, false);
+
+    rbsplen = scan_extract_rbsp(nalu, length, rbsp, sizeof(rbsp));
+    decoded = *context;
+    if (!hevc_decode_sps(rbsp, rbsplen, &decoded))
+        return false;
+
+    sets = context->parameter_sets;
+    entry = sets ? &(sets->sps[decoded.sps_seq_parameter_set_id]) : NULL;
+    if (!entry || (entry->received && entry->received->len == length &&
+        !memcmp(entry->received->data, nalu, length)))
+    {
+        *context = decoded;
+        return true;
+    }
+
+    if (!entry->received)
+        entry->received = g_byte_array_sized_new(length);
+    g_byte_array_set_size(entry->received, 0);
+    g_byte_array_append(entry->received, nalu, length);
+    entry->decoded = decoded;
+    ++(sets->generation);
+    *context = decoded;
+
+    return true;
+}
+
+/* NOTE: seq_parameter_set_rbsp() of 7.3.2.2.1 up to the sub-layer
+ * ordering info; the scaling lists, reference picture sets and VUI that
+ * follow are not needed for the hvcC record */
+static INLINE bool
+hevc_decode_sps(const uint8_t  *rbsp,
+                size_t          length,
+                hevc_context_t *context)
+{
+    bitstream_t reader;
+    guint64     width     = 0;
+    guint64     height    = 0;
+    uint32_t    sub_width = 1;
+    uint32_t    sub_height = 1;
+    uint32_t    value     = 0;
+    uint32_t    layer     = 0;
+
+    g_return_val_if_fail(NULL != rbsp, false);
+    g_return_val_if_fail(NULL != context, false);
+    g_return_val_if_fail(0 < length, false);
+
+    bitstream_init(&reader, rbsp, length);
+    hevc_decode_nalu_header(&reader, context);
+    context->sps_video_parameter_set_id = bitstream_get_bits(&reader, 4);
+    context->sps_max_sub_layers_minus1 = bitstream_get_bits(&reader, 3);
+    context->sps_temporal_id_nesting_flag = bitstream_get_bits(&reader, 1);
+    if (context->sps_max_sub_layers_minus1 > 6)
+        return false;
+    hevc_decode_profile_tier_level(&reader,
+            context->sps_max_sub_layers_minus1, context);
+    value = bitstream_get_ue(&reader);
+    if (value >= HEVC_MAX_SPS_COUNT)
+        return false;
+    context->sps_seq_parameter_set_id = value;
+    value = bitstream_get_ue(&reader);
+    if (value > 3)
+        return false;
+    context->chroma_format_idc = value;
+    context->separate_colour_plane_flag = false;
+    if (context->chroma_format_idc == 3)
+        context->separate_colour_plane_flag = bitstream_get_bits(&reader, 1);
+    context->pic_width_in_luma_samples = bitstream_get_ue(&reader);
+    context->pic_height_in_luma_samples = bitstream_get_ue(&reader);
+    context->conformance_window_flag = bitstream_get_bits(&reader, 1);
+    context->conf_win_left_offset = 0;
+    context->conf_win_right_offset = 0;
+    context->conf_win_top_offset = 0;
+    context->conf_win_bottom_offset = 0;
+    if (context->conformance_window_flag)
+    {
+        context->conf_win_left_offset = bitstream_get_ue(&reader);
+        context->conf_win_right_offset = bitstream_get_ue(&reader);
+        context->conf_win_top_offset = bitstream_get_ue(&reader);
+        context->conf_win_bottom_offset = bitstream_get_ue(&reader);
+    }
+    context->bit_depth_luma_minus8 = bitstream_get_ue(&reader);
+    context->bit_depth_chroma_minus8 = bitstream_get_ue(&reader);
+    if (context->bit_depth_luma_minus8 > 8 ||
+        context->bit_depth_chroma_minus8 > 8)
+        return false;
+    value = bitstream_get_ue(&reader);
+    if (value > 12)
+        return false;
+    context->log2_max_pic_order_cnt_lsb_minus4 = value;
+    context->sps_sub_layer_ordering_info_present_flag =
+        bitstream_get_bits(&reader, 1);
+    for (layer = context->sps_sub_layer_ordering_info_present_flag ? 0 :
+         context->sps_max_sub_layers_minus1;
+         layer <= context->sps_max_sub_layers_minus1; layer++)
+    {
+        value = bitstream_get_ue(&reader);
+        if (value > 15)
+            return false;
+        context->sps_max_dec_pic_buffering_minus1 = value;
+        value = bitstream_get_ue(&reader);
+        if (value > context->sps_max_dec_pic_buffering_minus1)
+            return false;
+        context->sps_max_num_reorder_pics = value;
+        context->sps_max_latency_increase_plus1 = bitstream_get_ue(&reader);
+    }
+    if (reader.error)
+        return false;
+
+    /* SubWidthC and SubHeightC of Table 6-1 scale the window offsets */
+    if (!context->separate_colour_plane_flag &&
+        context->chroma_format_idc != 0)
+    {
+        sub_width = (context->chroma_format_idc == 3) ? 1 : 2;
+        sub_height = (context->chroma_format_idc == 1) ? 2 : 1;
+    }
+    width = (guint64)(context->conf_win_left_offset) +
+        context->conf_win_right_offset;
+    height = (guint64)(context->conf_win_top_offset) +
+        context->conf_win_bottom_offset;
+    width *= sub_width;
+    height *= sub_height;
+    if (context->pic_width_in_luma_samples > G_MAXUINT16 ||
+        context->pic_height_in_luma_samples > G_MAXUINT16 ||
+        width >= context->pic_width_in_luma_samples ||
+        height >= context->pic_height_in_luma_samples)
+        return false;
+    context->width = context->pic_width_in_luma_samples - width;
+    context->height = context->pic_height_in_luma_samples - height;
+#ifdef DEBUG
+    hevc_print_sps(context);
+#endif
+
+    return true;
+}
+
+/* NOTE: pic_parameter_set_rbsp() of 7.3.2.3.1 up to the fields the slice
+ * segment header depends on; a PPS is kept as is under its own id */
+static INLINE bool
+hevc_update_pps(const uint8_t  *nalu,
+                size_t          length,
+                hevc_context_t *context)
+{
+    hevc_parameter_sets_t *sets    = NULL;
+    bitstream_t            reader;
+    uint8_t                rbsp[16];
+    size_t                 rbsplen = 0;
+    uint32_t               id      = 0;
+    uint32_t               sps_id  = 0;
+
+    g_return_val_if_fail(NULL != nalu, false);
+    g_return_val_if_fail(NULL != context, false);
+
+    rbsplen = scan_extract_rbsp(nalu, length, rbsp, sizeof(rbsp));
+    bitstream_init(&reader, rbsp, rbsplen);
+    hevc_decode_nalu_header(&reader, context);
+    id = bitstream_get_ue(&reader);
+    sps_id = bitstream_get_ue(&reader);
+    if (id >= HEVC_MAX_PPS_COUNT || sps_id >= HEVC_MAX_SPS_COUNT)
+        return false;
+    context->pps_pic_parameter_set_id = id;
+    context->pps_seq_parameter_set_id = sps_id;
+    context->dependent_slice_segments_enabled_flag =
+        bitstream_get_bits(&reader, 1);
+    context->output_flag_present_flag = bitstream_get_bits(&reader, 1);
+    context->num_extra_slice_header_bits = bitstream_get_bits(&reader, 3);
+    if (reader.error)
+        return false;
+
+    sets = context->parameter_sets;
+    if (!sets)
+        return true;
+
+    sets->pps_sps_id[id] = sps_id;
+
+    return hevc_store_parameter_set(sets, &(sets->pps[id]), nalu, length);
+}
+
+/* NOTE: profile_tier_level(1, max_sub_layers_minus1) of 7.3.3, only the
+ * general part is kept */
+static INLINE void
+hevc_decode_profile_tier_level(bitstream_t    *reader,
+                               uint8_t         max_sub_layers_minus1,
+                               hevc_context_t *context)
+{
+    bool    profile_present[8];
+    bool    level_present[8];
+    uint8_t layer = 0;
+
+    g_return_if_fail(NULL != reader);
+    g_return_if_fail(NULL != context);
+    g_return_if_fail(8 > max_sub_layers_minus1);
+
+    context->general_profile_space = bitstream_get_bits(reader, 2);
+    context->general_tier_flag = bitstream_get_bits(reader, 1);
+    context->general_profile_idc = bitstream_get_bits(reader, 5);
+    context->general_profile_compatibility_flags =
+        bitstream_get_bits(reader, 32);
+    context->general_constraint_indicator_flags =
+        (uint64_t)(bitstream_get_bits(reader, 16)) << 32;
+    context->general_constraint_indicator_flags |=
+        bitstream_get_bits(reader, 32);
+    context->general_level_idc = bitstream_get_bits(reader, 8);
+
+    for (layer = 0; layer < max_sub_layers_minus1; layer++)
+    {
+        profile_present[layer] = bitstream_get_bits(reader, 1);
+        level_present[layer] = bitstream_get_bits(reader, 1);
+    }
+    /* reserved_zero_2bits up to 8 sub-layers */
+    if (max_sub_layers_minus1 > 0)
+        bitstream_skip_bits(reader, 2 * (8 - max_sub_layers_minus1));
+    for (layer = 0; layer < max_sub_layers_minus1; layer++)
+    {
+        /* Profile space, tier, profile, compatibility and constraints */
+        if (profile_present[layer])
+            bitstream_skip_bits(reader, 88);
+        if (level_present[layer])
+            bitstream_skip_bits(reader, 8);
+    }
+}
+
+/* NOTE: stores a parameter set under *slot unless it holds the same bytes
+ * already, generation only moves when it did not */
+static INLINE bool
+hevc_store_parameter_set(hevc_parameter_sets_t  *sets,
+                         GByteArray            **slot,
+                         const uint8_t          *nalu,
+                         size_t                  length)
+{
+    g_return_val_if_fail(NULL != sets, false);
+    g_return_val_if_fail(NULL != slot, false);
+    g_return_val_if_fail(NULL != nalu, false);
+
+    if (*slot && (*slot)->len == length && !memcmp((*slot)->data, nalu,
+                length))
+        return true;
+
+    if (!*slot)
+        *slot = g_byte_array_sized_new(length);
+    g_byte_array_set_size(*slot, 0);
+    g_byte_array_append(*slot, nalu, length);
+    ++(sets->generation);
+
+    return true;
+}
+
+/* NOTE: hvcC is ISO/IEC 14496-15 8.3.3.1, the general profile, tier and
+ * level, chroma format and bit depths come from the lowest SPS id; the
+ * frame rate and spatial segmentation fields are left unspecified */
+static bool
+hevc_build_parameter_sets(hevc_parameter_sets_t *sets)
+{
+    const hevc_context_t *first = NULL;
+    GByteArray           *list[HEVC_MAX_PPS_COUNT];
+    uint8_t               header[23];
+    size_t                vpscount = 0;
+    size_t                spscount = 0;
+    size_t                ppscount = 0;
+    size_t                id       = 0;
+
+    g_return_val_if_fail(NULL != sets, false);
+
+    if (sets->hvcc && sets->built == sets->generation)
+        return true;
+
+    for (id = 0; id < HEVC_MAX_SPS_COUNT; id++)
+        if (sets->sps[id].received)
+            first = first ? first : &(sets->sps[id].decoded);
+    for (id = 0; id < HEVC_MAX_VPS_COUNT; id++)
+        vpscount += (NULL != sets->vps[id]);
+    for (id = 0; id < HEVC_MAX_PPS_COUNT; id++)
+        ppscount += (sets->pps[id] && sets->pps[id]->len > 0);
+    if (!first || vpscount == 0 || ppscount == 0)
+        return false;
+
+    if (!sets->hvcc)
+        sets->hvcc = g_byte_array_new();
+    if (!sets->annexb)
+        sets->annexb = g_byte_array_new();
+    g_byte_array_set_size(sets->hvcc, 0);
+    g_byte_array_set_size(sets->annexb, 0);
+
+    header[0] = 1;
+    header[1] = (first->general_profile_space << 6) |
+        (first->general_tier_flag << 5) | first->general_profile_idc;
+    header[2] = first->general_profile_compatibility_flags >> 24;
+    header[3] = first->general_profile_compatibility_flags >> 16;
+    header[4] = first->general_profile_compatibility_flags >> 8;
+    header[5] = first->general_profile_compatibility_flags;
+    header[6] = first->general_constraint_indicator_flags >> 40;
+    header[7] = first->general_constraint_indicator_flags >> 32;
+    header[8] = first->general_constraint_indicator_flags >> 24;
+    header[9] = first->general_constraint_indicator_flags >> 16;
+    header[10] = first->general_constraint_indicator_flags >> 8;
+    header[11] = first->general_constraint_indicator_flags;
+    header[12] = first->general_level_idc;
+    /* min_spatial_segmentation_idc and parallelismType */
+    header[13] = 0xF0;
+    header[14] = 0x00;
+    header[15] = 0xFC;
+    header[16] = 0xFC | first->chroma_format_idc;
+    header[17] = 0xF8 | first->bit_depth_luma_minus8;
+    header[18] = 0xF8 | first->bit_depth_chroma_minus8;
+    /* avgFrameRate */
+    header[19] = 0x00;
+    header[20] = 0x00;
+    /* constantFrameRate, numTemporalLayers, temporalIdNested and
+     * lengthSizeMinusOne */
+    header[21] = ((first->sps_max_sub_layers_minus1 + 1) << 3) |
+        (first->sps_temporal_id_nesting_flag << 2) | 3;
+    header[22] = 3;
+    g_byte_array_append(sets->hvcc, header, sizeof(header));
+
+    for (id = 0, vpscount = 0; id < HEVC_MAX_VPS_COUNT; id++)
+        if (sets->vps[id])
+            list[vpscount++] = sets->vps[id];
+    hevc_append_array(sets, 32, list, vpscount);
+    for (id = 0, spscount = 0; id < HEVC_MAX_SPS_COUNT; id++)
+        if (sets->sps[id].received)
+            list[spscount++] = sets->sps[id].received;
+    hevc_append_array(sets, 33, list, spscount);
+    for (id = 0, ppscount = 0; id < HEVC_MAX_PPS_COUNT; id++)
+        if (sets->pps[id] && sets->pps[id]->len > 0)
+            list[ppscount++] = sets->pps[id];
+    hevc_append_array(sets, 34, list, ppscount);
+
+    sets->built = sets->generation;
+
+    return true;
+}
+
+/* NOTE: one hvcC array, complete and of a single NALU type, and the same
+ * NALUs behind start codes for the Annex B blob */
+static void
+hevc_append_array(hevc_parameter_sets_t  *sets,
+                  uint8_t                 type,
+                  GByteArray            **list,
+                  size_t                  count)
+{
+    static const uint8_t start_code[] = {0x00, 0x00, 0x00, 0x01};
+    uint8_t              header[3];
+    uint8_t              length[2];
+    size_t               idx          = 0;
+
+    g_return_if_fail(NULL != sets);
+    g_return_if_fail(NULL != list);
+
+    header[0] = 0x80 | type;
+    header[1] = count >> 8;
+    header[2] = count & 0xFF;
+    g_byte_array_append(sets->hvcc, header, sizeof(header));
+    for (idx = 0; idx < count; idx++)
+    {
+        length[0] = list[idx]->len >> 8;
+        length[1] = list[idx]->len & 0xFF;
+        g_byte_array_append(sets->hvcc, length, sizeof(length));
+        g_byte_array_append(sets->hvcc, list[idx]->data, list[idx]->len);
+        g_byte_array_append(sets->annexb, start_code, sizeof(start_code));
+        g_byte_array_append(sets->annexb, list[idx]->data, list[idx]->len);
+    }
+}
+
+static INLINE void
+hevc_print_sps(const hevc_context_t *context)
+{
+    g_return_if_fail(NULL != context);
+
+    printf("H.265 SPS:\n");
+    printf("   nal_unit_type: %u\n", context->nal_unit_type);
+    printf("   sps_video_parameter_set_id: %u\n",
+            context->sps_video_parameter_set_id);
+    printf("   sps_max_sub_layers_minus1: %u\n",
+            context->sps_max_sub_layers_minus1);
+    printf("   general_profile_space: %u\n", context->general_profile_space);
+    printf("   general_tier_flag: %u\n", context->general_tier_flag);
+    printf("   general_profile_idc: %u\n", context->general_profile_idc);
+    printf("   general_level_idc: %u\n", context->general_level_idc);
+    printf("   sps_seq_parameter_set_id: %u\n",
+            context->sps_seq_parameter_set_id);
+    printf("   chroma_format_idc: %u\n", context->chroma_format_idc);
+    printf("   pic_width_in_luma_samples: %u\n",
+            context->pic_width_in_luma_samples);
+    printf("   pic_height_in_luma_samples: %u\n",
+            context->pic_height_in_luma_samples);
+    printf("   conf_win_offsets: %u %u %u %u\n",
+            context->conf_win_left_offset, context->conf_win_right_offset,
+            context->conf_win_top_offset, context->conf_win_bottom_offset);
+    printf("   bit_depth_luma_minus8: %u\n", context->bit_depth_luma_minus8);
+    printf("   bit_depth_chroma_minus8: %u\n",
+            context->bit_depth_chroma_minus8);
+    printf("   sps_max_dec_pic_buffering_minus1: %u\n",
+            context->sps_max_dec_pic_buffering_minus1);
+    printf("   sps_max_num_reorder_pics: %u\n",
+            context->sps_max_num_reorder_pics);
+    printf("   output: %ux%u\n", context->width, context->height);
+}
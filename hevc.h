@@ -0,0 +1,166 @@
+/*
+ * Author: Pu-Chen Mao
+ * Date:   2026/10/15
+ * File:   hevc.h
+ * Desc:   H.265/HEVC RTP (RFC 7798) bitstream reassembly
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    #define HEVC_MAX_VPS_COUNT 16
+    #define HEVC_MAX_SPS_COUNT 16
+    #define HEVC_MAX_PPS_COUNT 64
+    #define HEVC_MAX_SPS_SIZE  1024
+
+    /* The NAL unit header is two bytes, F(1) Type(6) LayerId(6) TID(3),
+     * the fields straddle bytes so it is read through shifts instead */
+    typedef struct hevc_fu_header_t
+    {
+        #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        uint8_t type:  6;
+        uint8_t end:   1;
+        uint8_t start: 1;
+        #else
+            #error "little-endian only"
+        #endif
+
+    } __attribute__ ((__packed__)) hevc_fu_header_t;
+
+    typedef struct hevc_context_t
+    {
+        /* NALU Header */
+        bool     forbidden_zero_bit;
+        uint8_t  nal_unit_type;
+        uint8_t  nuh_layer_id;
+        uint8_t  nuh_temporal_id_plus1;
+
+        /* H.265 Slice Segment Header */
+        bool     first_slice_segment_in_pic_flag;
+        bool     no_output_of_prior_pics_flag; // IRAP pictures only
+        uint8_t  slice_pic_parameter_set_id;
+
+        /* H.265 Video Parameter Set */
+        uint8_t  vps_video_parameter_set_id;
+        bool     vps_base_layer_internal_flag;
+        bool     vps_base_layer_available_flag;
+        uint8_t  vps_max_layers_minus1;
+        uint8_t  vps_max_sub_layers_minus1;
+        bool     vps_temporal_id_nesting_flag;
+
+        /* H.265 Profile, Tier and Level, general part of the last VPS or
+         * SPS decoded */
+        uint8_t  general_profile_space;
+        bool     general_tier_flag;
+        uint8_t  general_profile_idc;
+        uint32_t general_profile_compatibility_flags;
+        uint64_t general_constraint_indicator_flags; // 48 bits
+        uint8_t  general_level_idc;
+
+        /* H.265 Sequence Parameter Set, sub-layer values are those of the
+         * highest sub-layer */
+        uint8_t  sps_video_parameter_set_id;
+        uint8_t  sps_max_sub_layers_minus1;
+        bool     sps_temporal_id_nesting_flag;
+        uint8_t  sps_seq_parameter_set_id;
+        uint8_t  chroma_format_idc;
+        bool     separate_colour_plane_flag;
+        uint32_t pic_width_in_luma_samples;
+        uint32_t pic_height_in_luma_samples;
+        bool     conformance_window_flag;
+        uint32_t conf_win_left_offset;
+        uint32_t conf_win_right_offset;
+        uint32_t conf_win_top_offset;
+        uint32_t conf_win_bottom_offset;
+        uint8_t  bit_depth_luma_minus8;
+        uint8_t  bit_depth_chroma_minus8;
+        uint8_t  log2_max_pic_order_cnt_lsb_minus4;
+        bool     sps_sub_layer_ordering_info_present_flag;
+        uint8_t  sps_max_dec_pic_buffering_minus1;
+        uint8_t  sps_max_num_reorder_pics;
+        uint32_t sps_max_latency_increase_plus1;
+
+        /* H.265 Picture Parameter Set */
+        uint8_t  pps_pic_parameter_set_id;
+        uint8_t  pps_seq_parameter_set_id;
+        bool     dependent_slice_segments_enabled_flag;
+        bool     output_flag_present_flag;
+        uint8_t  num_extra_slice_header_bits;
+
+        /* Derived from the SPS, the output size after the conformance
+         * window */
+        uint32_t width;
+        uint32_t height;
+
+        /* Reassembly state, as for H.264 */
+        size_t    fu_offset;
+        uint32_t  fu_length;
+        uint8_t   fu_zeros;
+
+        /* Parameter sets seen so far and their generation when this context
+         * was last decoded, kept out of media contexts as for H.264 */
+        struct hevc_parameter_sets_t *parameter_sets;
+        guint32                       generation;
+
+    } hevc_context_t;
+
+    /* An SPS as received, to spot repeats, along with what it decoded to */
+    typedef struct hevc_sps_entry_t
+    {
+        GByteArray     *received;
+        hevc_context_t  decoded;
+
+    } hevc_sps_entry_t;
+
+    /* VPS, SPS and PPS by id, kept as for H.264. The hvcC record and the
+     * Annex B blob of all sets are rebuilt on demand once generation has
+     * moved past built */
+    typedef struct hevc_parameter_sets_t
+    {
+        GByteArray       *vps[HEVC_MAX_VPS_COUNT];
+        hevc_sps_entry_t  sps[HEVC_MAX_SPS_COUNT];
+        GByteArray       *pps[HEVC_MAX_PPS_COUNT];
+        uint8_t           pps_sps_id[HEVC_MAX_PPS_COUNT];
+        guint32           generation;
+        guint32           built;
+        GByteArray       *hvcc;
+        GByteArray       *annexb;
+
+    } hevc_parameter_sets_t;
+
+    typedef enum prefix_t prefix_t;
+    typedef struct media_vector_t media_vector_t;
+
+    bool hevc_reassemble_frame(uint8_t **index, size_t *length,
+            const uint8_t *limit, prefix_t prefix, const uint8_t *naluptr,
+            size_t nalulen, bool completed, void *data);
+    bool hevc_is_fragmented(const uint8_t *naluptr, size_t nalulen);
+    uint8_t hevc_get_frame_type(const uint8_t *naluptr, size_t nalulen);
+    bool hevc_is_first_nalu(const uint8_t *naluptr, size_t nalulen);
+    bool hevc_is_last_nalu(const uint8_t *naluptr, size_t nalulen);
+    size_t hevc_measure_nalu(const uint8_t *naluptr, size_t nalulen,
+            prefix_t prefix);
+    void hevc_conceal_nalu(uint8_t *output, size_t length, bool closing,
+            void *data);
+    bool hevc_scatter_frame(media_vector_t *vector, prefix_t prefix,
+            const uint8_t *naluptr, size_t nalulen, bool completed,
+            void *data);
+    void hevc_merge_context(void *data, const void *frame);
+    hevc_parameter_sets_t *hevc_parameter_sets_create(void);
+    bool hevc_parameter_sets_get_hvcc(hevc_parameter_sets_t *sets,
+            const uint8_t **data, size_t *length);
+    bool hevc_parameter_sets_get_annexb(hevc_parameter_sets_t *sets,
+            const uint8_t **data, size_t *length);
+    void hevc_parameter_sets_destroy(gpointer data);
+
+#ifdef __cplusplus
+}
+#endif
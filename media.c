@@ -14,20 +14,32 @@
 
 media_t *
 media_create(prefix_t prefix)
+{
+    return media_create_sized(prefix, MAX_FRAME_BUFFER_SIZE);
+}
+
+/* NOTE: pair with rtp_depacketizer_get_frame_size() and media_reserve() to
+ * size buffers per frame instead of for the largest possible one */
+media_t *
+media_create_sized(prefix_t prefix,
+                   size_t   capacity)
 {
     media_t *media  = NULL;
     bool     result = false;
 
+    g_return_val_if_fail(0 < capacity, NULL);
+
     media = g_try_new0(media_t, 1);
     if (!media)
         goto RETURN;
 
-    media->buffer = g_try_malloc(MAX_FRAME_BUFFER_SIZE);
+    media->buffer = g_try_malloc(capacity);
     if (!media->buffer)
         goto RETURN;
 
     media->prefix = prefix;
-    media->length = MAX_FRAME_BUFFER_SIZE;
+    media->capacity = capacity;
+    media->length = capacity;
     result = true;
 
 RETURN:
@@ -38,6 +50,30 @@ RETURN:
     return media;
 }
 
+/* NOTE: grows the buffer to at least capacity bytes, never shrinks it, and
+ * resets length to the whole buffer ready for the next frame */
+bool
+media_reserve(media_t *media,
+              size_t   capacity)
+{
+    uint8_t *buffer = NULL;
+
+    g_return_val_if_fail(NULL != media, false);
+    g_return_val_if_fail(0 < capacity, false);
+
+    if (capacity > media->capacity)
+    {
+        buffer = g_try_realloc(media->buffer, capacity);
+        if (!buffer)
+            return false;
+        media->buffer = buffer;
+        media->capacity = capacity;
+    }
+    media->length = media->capacity;
+
+    return true;
+}
+
 gint
 media_compare_timestamp(gconstpointer lval,
                         gconstpointer rval,
@@ -72,3 +108,187 @@ media_destroy(gpointer data)
     g_clear_pointer(&media, g_free);
 }
 
+
+media_vector_t *
+media_vector_create(prefix_t prefix)
+{
+    media_vector_t *vector = NULL;
+    bool            result = false;
+
+    vector = g_try_new0(media_vector_t, 1);
+    if (!vector)
+        goto RETURN;
+
+    vector->iov = g_try_new0(struct iovec, MEDIA_VECTOR_MIN_IOVCNT);
+    if (!vector->iov)
+        goto RETURN;
+
+    vector->header = g_try_malloc(MEDIA_VECTOR_MIN_HEADER);
+    if (!vector->header)
+        goto RETURN;
+
+    vector->prefix = prefix;
+    vector->iovcap = MEDIA_VECTOR_MIN_IOVCNT;
+    vector->headercap = MEDIA_VECTOR_MIN_HEADER;
+    result = true;
+
+RETURN:
+
+    if (!result)
+        g_clear_pointer(&vector, media_vector_destroy);
+
+    return vector;
+}
+
+/* NOTE: hands the retained packets back, invalidating the iovecs */
+void
+media_vector_reset(media_vector_t *vector)
+{
+    g_return_if_fail(NULL != vector);
+
+    if (vector->retained && vector->release)
+        vector->release(vector->retained);
+    vector->retained = NULL;
+    vector->release = NULL;
+    vector->iovcnt = 0;
+    vector->headerlen = 0;
+    vector->length = 0;
+}
+
+/* NOTE: returns room for size bytes at the end of the header buffer, the
+ * bytes actually written there are added with media_vector_commit() */
+uint8_t *
+media_vector_claim(media_vector_t *vector,
+                   size_t          size)
+{
+    uint8_t *header   = NULL;
+    size_t   capacity = 0;
+
+    g_return_val_if_fail(NULL != vector, NULL);
+
+    if (vector->headerlen + size > vector->headercap)
+    {
+        for (capacity = vector->headercap;
+             capacity < vector->headerlen + size; capacity <<= 1);
+        header = g_try_realloc(vector->header, capacity);
+        if (!header)
+            return NULL;
+        vector->header = header;
+        vector->headercap = capacity;
+    }
+
+    return vector->header + vector->headerlen;
+}
+
+/* NOTE: header bytes are recorded with a NULL base while the header buffer
+ * may still move, media_vector_finish() points them at their final place */
+bool
+media_vector_commit(media_vector_t *vector,
+                    size_t          size)
+{
+    struct iovec *last = NULL;
+
+    g_return_val_if_fail(NULL != vector, false);
+    g_return_val_if_fail(vector->headerlen + size <= vector->headercap,
+            false);
+
+    if (size == 0)
+        return true;
+
+    last = (vector->iovcnt > 0) ? &(vector->iov[vector->iovcnt - 1]) : NULL;
+    if (!last || last->iov_base)
+    {
+        if (!media_vector_append(vector, NULL, 0))
+            return false;
+        last = &(vector->iov[vector->iovcnt - 1]);
+    }
+
+    last->iov_len += size;
+    vector->headerlen += size;
+    vector->length += size;
+
+    return true;
+}
+
+bool
+media_vector_append(media_vector_t *vector,
+                    const uint8_t  *data,
+                    size_t          size)
+{
+    struct iovec *iov      = NULL;
+    size_t        capacity = 0;
+
+    g_return_val_if_fail(NULL != vector, false);
+    g_return_val_if_fail(NULL != data || 0 == size, false);
+
+    if (vector->iovcnt == vector->iovcap)
+    {
+        capacity = vector->iovcap << 1;
+        iov = g_try_renew(struct iovec, vector->iov, capacity);
+        if (!iov)
+            return false;
+        vector->iov = iov;
+        vector->iovcap = capacity;
+    }
+
+    vector->iov[vector->iovcnt].iov_base = (void *)(data);
+    vector->iov[vector->iovcnt].iov_len = size;
+    ++(vector->iovcnt);
+    vector->length += size;
+
+    return true;
+}
+
+void
+media_vector_finish(media_vector_t *vector)
+{
+    size_t offset = 0;
+    size_t idx    = 0;
+
+    g_return_if_fail(NULL != vector);
+
+    for (idx = 0; idx < vector->iovcnt; idx++)
+    {
+        if (vector->iov[idx].iov_base)
+            continue;
+        vector->iov[idx].iov_base = vector->header + offset;
+        offset += vector->iov[idx].iov_len;
+    }
+}
+
+/* NOTE: gathers the first size bytes of a finished vector into buffer */
+size_t
+media_vector_peek(const media_vector_t *vector,
+                  uint8_t              *buffer,
+                  size_t                size)
+{
+    size_t copied = 0;
+    size_t length = 0;
+    size_t idx    = 0;
+
+    g_return_val_if_fail(NULL != vector, 0);
+    g_return_val_if_fail(NULL != buffer, 0);
+
+    for (idx = 0; idx < vector->iovcnt && copied < size; idx++)
+    {
+        length = MIN(size - copied, vector->iov[idx].iov_len);
+        memcpy(buffer + copied, vector->iov[idx].iov_base, length);
+        copied += length;
+    }
+
+    return copied;
+}
+
+void
+media_vector_destroy(gpointer data)
+{
+    media_vector_t *vector = NULL;
+
+    g_return_if_fail(NULL != data);
+
+    vector = (media_vector_t *)(data);
+    media_vector_reset(vector);
+    g_clear_pointer(&(vector->iov), g_free);
+    g_clear_pointer(&(vector->header), g_free);
+    g_clear_pointer(&vector, g_free);
+}
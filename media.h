@@ -10,6 +10,7 @@
 #include <glib.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <sys/uio.h>
 
 #include "format.h"
 
@@ -19,6 +20,8 @@ extern "C"
 #endif
 
     #define MAX_FRAME_BUFFER_SIZE (512 * 1024)
+    #define MEDIA_VECTOR_MIN_IOVCNT 16
+    #define MEDIA_VECTOR_MIN_HEADER 256
 
     typedef struct media_t
     {
@@ -29,6 +32,7 @@ extern "C"
         gint64     created_us;
         uint32_t   timestamp;
         uint8_t   *buffer;
+        size_t     capacity;
         size_t     length;
         uint16_t   head_seq;
         uint16_t   tail_seq;
@@ -36,11 +40,50 @@ extern "C"
 
     } media_t;
 
+    /* A frame as an iovec array for writev()/sendmsg(): payload bytes are
+     * referenced in place inside the packets the vector retains, prefixes
+     * and rebuilt NALU headers are copied into the small header buffer.
+     * The iovecs stay valid until the vector is reset or destroyed */
+    typedef struct media_vector_t
+    {
+        bool            is_audio;
+        prefix_t        prefix;
+        uint8_t         type;
+        uint32_t        rtptime;
+        gint64          created_us;
+        struct iovec   *iov;
+        size_t          iovcnt;
+        size_t          iovcap;
+        uint8_t        *header;
+        size_t          headerlen;
+        size_t          headercap;
+        size_t          length;
+        uint16_t        head_seq;
+        uint16_t        tail_seq;
+        context_t       context;
+        gpointer        retained;
+        GDestroyNotify  release;
+
+    } media_vector_t;
+
     media_t *media_create(prefix_t prefix);
+    media_t *media_create_sized(prefix_t prefix, size_t capacity);
+    bool media_reserve(media_t *media, size_t capacity);
     gint media_compare_timestamp(gconstpointer lval, gconstpointer rval,
             gpointer data);
     void media_destroy(gpointer data);
 
+    media_vector_t *media_vector_create(prefix_t prefix);
+    void media_vector_reset(media_vector_t *vector);
+    uint8_t *media_vector_claim(media_vector_t *vector, size_t size);
+    bool media_vector_commit(media_vector_t *vector, size_t size);
+    bool media_vector_append(media_vector_t *vector, const uint8_t *data,
+            size_t size);
+    void media_vector_finish(media_vector_t *vector);
+    size_t media_vector_peek(const media_vector_t *vector, uint8_t *buffer,
+            size_t size);
+    void media_vector_destroy(gpointer data);
+
 
 #ifdef __cplusplus
 }
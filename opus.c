@@ -11,6 +11,7 @@
 #include <string.h>
 
 #include "format.h"
+#include "media.h"
 #include "opus.h"
 
 bool
@@ -43,14 +44,14 @@ opus_reassemble_frame(uint8_t       **index,
         case 1:
         case 2:
             result = true; break;
-        case 3:
-            fprintf(stderr, "opus header type not implemented\n");
+        case 3:  /* Arbitrary number of frames, not supported */
         default:
             result = false;
     }
 
-    g_return_val_if_fail(*index + size < limit, false);
+    g_return_val_if_fail(*index + size <= limit, false);
     memcpy(*index, payload, size);
+    *index += size;
     *length += size;
     (void)(context);
 
@@ -99,3 +100,50 @@ opus_is_last_frame(const uint8_t *frameptr,
     return true;
 }
 
+
+size_t
+opus_measure_frame(const uint8_t *frameptr,
+                   size_t         framelen,
+                   prefix_t       prefix)
+{
+    g_return_val_if_fail(NULL != frameptr, 0);
+    g_return_val_if_fail(1 <= framelen, 0);
+
+    return framelen;
+}
+
+void
+opus_conceal_frame(uint8_t *output,
+                   size_t   length,
+                   bool     closing,
+                   void    *data)
+{
+    g_return_if_fail(NULL != output);
+}
+
+bool
+opus_scatter_frame(media_vector_t *vector,
+                   prefix_t        prefix,
+                   const uint8_t  *frameptr,
+                   size_t          framelen,
+                   bool            completed,
+                   void           *data)
+{
+    g_return_val_if_fail(NULL != vector, false);
+    g_return_val_if_fail(NULL != frameptr, false);
+    g_return_val_if_fail(1 <= framelen, false);
+
+    if (((opus_toc_header_t *)(frameptr))->count == 3)
+        return false;
+
+    return media_vector_append(vector, frameptr, framelen);
+}
+
+/* NOTE: Opus keeps no state across frames */
+void
+opus_merge_context(void       *data,
+                   const void *frame)
+{
+    g_return_if_fail(NULL != data);
+    g_return_if_fail(NULL != frame);
+}
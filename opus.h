@@ -34,6 +34,7 @@ extern "C"
     } opus_context_t;
 
     typedef enum prefix_t prefix_t;
+    typedef struct media_vector_t media_vector_t;
 
     bool opus_reassemble_frame(uint8_t **index, size_t *length,
             const uint8_t *limit, prefix_t prefix, const uint8_t *frameptr,
@@ -42,6 +43,14 @@ extern "C"
     uint8_t opus_get_frame_type(const uint8_t *frameptr, size_t framelen);
     bool opus_is_first_frame(const uint8_t *frameptr, size_t framelen);
     bool opus_is_last_frame(const uint8_t *frameptr, size_t framelen);
+    size_t opus_measure_frame(const uint8_t *frameptr, size_t framelen,
+            prefix_t prefix);
+    void opus_conceal_frame(uint8_t *output, size_t length, bool closing,
+            void *data);
+    bool opus_scatter_frame(media_vector_t *vector, prefix_t prefix,
+            const uint8_t *frameptr, size_t framelen, bool completed,
+            void *data);
+    void opus_merge_context(void *data, const void *frame);
 
 #ifdef __cplusplus
 }
@@ -12,14 +12,27 @@
 #include <glib.h>
 
 #include "packet.h"
+#include "pool.h"
 
-static size_t packet_padding_length(const packet_t *packet);
-
+/* NOTE: without copy, ownership of a g_malloc()'d buffer is transferred and
+ * it is g_free()'d with the packet; see packet_create_borrowed() for buffers
+ * owned by someone else */
 packet_t *
 packet_create(const uint8_t *buffer,
               size_t         length,
               bool           is_audio,
               bool           copy)
+{
+    return packet_create_at(buffer, length, is_audio, copy,
+            g_get_monotonic_time());
+}
+
+packet_t *
+packet_create_at(const uint8_t *buffer,
+                 size_t         length,
+                 bool           is_audio,
+                 bool           copy,
+                 gint64         created_us)
 {
     packet_t *packet = NULL;
     bool      result = false;
@@ -42,9 +55,9 @@ packet_create(const uint8_t *buffer,
     }
 
     packet->length = length;
-    packet->created_us = g_get_monotonic_time();
+    packet->created_us = created_us;
     packet->is_audio = is_audio;
-    result = true;
+    result = packet_parse(packet);
 
 RETURN:
 
@@ -54,37 +67,110 @@ RETURN:
     return packet;
 }
 
+/* NOTE: the buffer stays owned by the caller, release is invoked with the
+ * cookie when the packet is destroyed. If creation fails or the buffer is
+ * not a valid RTP packet, it is released before returning */
+packet_t *
+packet_create_borrowed(uint8_t          *buffer,
+                       size_t            length,
+                       bool              is_audio,
+                       gint64            created_us,
+                       packet_release_t  release,
+                       gpointer          cookie)
+{
+    packet_t *packet = NULL;
+
+    g_return_val_if_fail(NULL != buffer, NULL);
+    g_return_val_if_fail(NULL != release, NULL);
+
+    packet = g_try_new0(packet_t, 1);
+    if (!packet || length <= 0)
+    {
+        release(buffer, cookie);
+        g_clear_pointer(&packet, g_free);
+        return NULL;
+    }
+
+    packet->rtp = (rtp_packet_t *)(buffer);
+    packet->length = length;
+    packet->created_us = created_us;
+    packet->is_audio = is_audio;
+    packet->release = release;
+    packet->cookie = cookie;
+    if (!packet_parse(packet))
+        g_clear_pointer(&packet, packet_destroy);
+
+    return packet;
+}
+
+/* NOTE: fills in the cached header fields from packet->rtp. Fails for
+ * anything but RTP version 2, and for packets whose CSRCs, extension or
+ * padding overrun them or that carry no payload */
 bool
-packet_get_payload(const packet_t  *packet,
-                   const uint8_t  **payload,
-                   size_t          *length)
+packet_parse(packet_t *packet)
 {
     const rtp_header_t     *header    = NULL;
     const rtp_ext_header_t *extension = NULL;
-    const uint8_t          *index     = NULL;
-    ptrdiff_t               nalulen   = 0;
+    const uint8_t          *data      = NULL;
+    size_t                  offset    = 0;
     size_t                  padlen    = 0;
 
-    g_return_val_if_fail(NULL != packet, NULL);
-    g_return_val_if_fail(NULL != packet->rtp, NULL);
-    g_return_val_if_fail(NULL != payload, NULL);
-    g_return_val_if_fail(NULL != length, NULL);
+    g_return_val_if_fail(NULL != packet, false);
+    g_return_val_if_fail(NULL != packet->rtp, false);
+
+    if (packet->length < sizeof(rtp_header_t))
+        return false;
 
     header = &(packet->rtp->header);
-    index = packet->rtp->payload;
-    extension = (rtp_ext_header_t *)(index);
-    index += header->csrc_cnt * sizeof(uint32_t);
-    index += header->extension * sizeof(rtp_ext_header_t);
-    index += header->extension * ntohs(extension->extension_length);
+    data = (const uint8_t *)(header);
+    if (header->version != 2)
+        return false;
+
+    offset = sizeof(rtp_header_t) + header->csrc_cnt * sizeof(uint32_t);
+    if (header->extension)
+    {
+        if (offset + sizeof(rtp_ext_header_t) > packet->length)
+            return false;
+        extension = (const rtp_ext_header_t *)(data + offset);
+        offset += sizeof(rtp_ext_header_t) + sizeof(uint32_t) *
+            ntohs(extension->extension_length);
+    }
+    if (offset >= packet->length)
+        return false;
+
     if (header->padding)
-        padlen = packet_padding_length(packet);
-    nalulen = (uintptr_t)(index) - (uintptr_t)(header);
-    *length = packet->length - nalulen - padlen;
-    *payload = index;
+    {
+        padlen = data[packet->length - 1];
+        if (padlen == 0 || offset + padlen >= packet->length)
+            return false;
+    }
+
+    packet->timestamp = ntohl(header->timestamp);
+    packet->ssrc = ntohl(header->ssrc);
+    packet->sequence = ntohs(header->sequence);
+    packet->payload_type = header->profile;
+    packet->marker = header->marker;
+    packet->payload = data + offset;
+    packet->payloadlen = packet->length - offset - padlen;
 
     return true;
 }
 
+bool
+packet_get_payload(const packet_t  *packet,
+                   const uint8_t  **payload,
+                   size_t          *length)
+{
+    g_return_val_if_fail(NULL != packet, false);
+    g_return_val_if_fail(NULL != payload, false);
+    g_return_val_if_fail(NULL != length, false);
+
+    *payload = packet->payload;
+    *length = packet->payloadlen;
+
+    return NULL != packet->payload;
+}
+
 gint
 packet_compare_sequence(gconstpointer lval,
                         gconstpointer rval,
@@ -101,8 +187,8 @@ packet_compare_sequence(gconstpointer lval,
 
     lpkt = (packet_t *)(lval);
     rpkt = (packet_t *)(rval);
-    lseq = ntohs((lpkt->rtp->header).sequence);
-    rseq = ntohs((rpkt->rtp->header).sequence);
+    lseq = lpkt->sequence;
+    rseq = rpkt->sequence;
     wrapped = 1 - 2 * (ABS(lseq - rseq) > (G_MAXUSHORT >> 1)); // [0, 1] -> [-1, 1]
 
     return wrapped * (lseq - rseq);
@@ -117,22 +203,17 @@ packet_destroy(gpointer data)
     g_return_if_fail(GUINT_TO_POINTER(G_MAXSIZE) != data);
 
     packet = (packet_t *)(data);
-    g_clear_pointer(&(packet->rtp), g_free);
-    g_clear_pointer(&packet, g_free);
-}
-
-static size_t
-packet_padding_length(const packet_t *packet)
-{
-    uint8_t *padptr = NULL;
-    size_t   length = 0;
-
-    g_return_val_if_fail(NULL != packet, 0);
-
-    padptr = (uint8_t *)(&(packet->rtp->header));
-    length = (size_t)(padptr[packet->length - 1]);
+    if (packet->pool)
+    {
+        packet_pool_release(packet->pool, packet);
+        return;
+    }
 
-    return length;
+    if (packet->release)
+        packet->release((uint8_t *)(packet->rtp), packet->cookie);
+    else
+        g_clear_pointer(&(packet->rtp), g_free);
+    g_clear_pointer(&packet, g_free);
 }
 
 #ifdef DEBUG
@@ -140,19 +221,16 @@ void
 packet_print_info(gpointer data,
                   gpointer userdata)
 {
-    packet_t     *packet = NULL;
-    rtp_header_t *header = NULL;
+    packet_t *packet = NULL;
 
     g_return_if_fail(NULL != data);
 
     packet = (packet_t *)(data);
-    g_return_if_fail(NULL != packet->rtp);
-    header = &(packet->rtp->header);
+    g_return_if_fail(NULL != packet->payload);
 
     /* timestamp, sequence, size, type */
-    printf("(%u, %u, %zu, %u) ", ntohl(header->timestamp),
-            ntohs(header->sequence), packet->length,
-            (packet->rtp->payload)[0] & 0x1F);
+    printf("(%u, %u, %zu, %u) ", packet->timestamp, packet->sequence,
+            packet->length, packet->payload[0] & 0x1F);
 }
 #endif
 
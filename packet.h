@@ -10,6 +10,7 @@
 #include <glib.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C"
@@ -53,17 +54,41 @@ extern "C"
         #endif
     } __attribute__ ((__packed__)) rtp_packet_t;
 
+    typedef struct packet_pool_t packet_pool_t;
+
+    /* Hands a borrowed buffer back to its owner once the packet is gone */
+    typedef void (*packet_release_t)(uint8_t *buffer, gpointer cookie);
+
+    /* The header is parsed once at creation: sequence, timestamp, ssrc,
+     * payload_type and marker are in host order, payload/payloadlen span
+     * what is left after CSRCs, the extension and padding */
     typedef struct packet_t
     {
-        rtp_packet_t *rtp;
-        size_t        length;
-        gint64        created_us;
-        bool          is_audio;
+        rtp_packet_t     *rtp;
+        size_t            length;
+        uint32_t          timestamp;
+        uint32_t          ssrc;
+        uint16_t          sequence;
+        uint8_t           payload_type;
+        bool              marker;
+        const uint8_t    *payload;
+        size_t            payloadlen;
+        gint64            created_us;
+        bool              is_audio;
+        packet_pool_t    *pool;
+        packet_release_t  release;
+        gpointer          cookie;
 
     } packet_t;
 
     packet_t *packet_create(const uint8_t *buffer, size_t length,
             bool is_audio, bool copy);
+    packet_t *packet_create_at(const uint8_t *buffer, size_t length,
+            bool is_audio, bool copy, gint64 created_us);
+    packet_t *packet_create_borrowed(uint8_t *buffer, size_t length,
+            bool is_audio, gint64 created_us, packet_release_t release,
+            gpointer cookie);
+    bool packet_parse(packet_t *packet);
     bool packet_get_payload(const packet_t *packet, const uint8_t **payload,
             size_t *length);
     gint packet_compare_sequence(gconstpointer lval, gconstpointer rval,
@@ -0,0 +1,209 @@
+/*
+ * Author: Pu-Chen Mao
+ * Date:   2026/10/15
+ * File:   pool.c
+ * Desc:   Slab pool of single-allocation RTP packets
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pool.h"
+
+#define PACKET_POOL_ALIGNMENT 64
+
+static bool packet_pool_grow(packet_pool_t *pool);
+static void packet_pool_free(packet_pool_t *pool);
+static inline void packet_pool_lock(packet_pool_t *pool);
+static inline void packet_pool_unlock(packet_pool_t *pool);
+
+packet_pool_t *
+packet_pool_create(size_t mtu,
+                   size_t slots_per_slab)
+{
+    packet_pool_t *pool   = NULL;
+    bool           result = false;
+
+    g_return_val_if_fail(0 < mtu, NULL);
+    g_return_val_if_fail(0 < slots_per_slab, NULL);
+
+    pool = g_try_new0(packet_pool_t, 1);
+    if (!pool)
+        goto RETURN;
+
+    /* Slabs come from posix_memalign(), so they go back through free() */
+    pool->slabs = g_ptr_array_new_with_free_func(free);
+    if (!pool->slabs)
+        goto RETURN;
+
+    /* Round the slot up to a whole number of cache lines */
+    pool->mtu = mtu;
+    pool->slot_size = (sizeof(packet_t) + mtu + PACKET_POOL_ALIGNMENT - 1) &
+        ~(size_t)(PACKET_POOL_ALIGNMENT - 1);
+    pool->slots_per_slab = slots_per_slab;
+    result = true;
+
+RETURN:
+
+    if (!result)
+        g_clear_pointer(&pool, packet_pool_destroy);
+
+    return pool;
+}
+
+packet_pool_t *
+packet_pool_create_shared(size_t mtu,
+                          size_t slots_per_slab)
+{
+    packet_pool_t *pool = NULL;
+
+    pool = packet_pool_create(mtu, slots_per_slab);
+    if (!pool)
+        return NULL;
+
+    g_mutex_init(&(pool->lock));
+    pool->shared = true;
+
+    return pool;
+}
+
+/* NOTE: buffers larger than the pool MTU fall back to a heap packet */
+packet_t *
+packet_pool_acquire(packet_pool_t *pool,
+                    const uint8_t *buffer,
+                    size_t         length,
+                    bool           is_audio,
+                    gint64         created_us)
+{
+    packet_t *packet = NULL;
+
+    g_return_val_if_fail(NULL != pool, NULL);
+    g_return_val_if_fail(NULL != buffer, NULL);
+    g_return_val_if_fail(0 < length, NULL);
+
+    if (length > pool->mtu)
+        return packet_create_at(buffer, length, is_audio, true, created_us);
+
+    packet_pool_lock(pool);
+    if (pool->free || packet_pool_grow(pool))
+    {
+        packet = pool->free;
+        pool->free = *(packet_t **)(packet);
+        ++(pool->outstanding);
+    }
+    packet_pool_unlock(pool);
+    if (!packet)
+        return NULL;
+
+    memset(packet, 0, sizeof(*packet));
+    packet->rtp = (rtp_packet_t *)((uint8_t *)(packet) + sizeof(*packet));
+    memcpy(packet->rtp, buffer, length);
+    packet->length = length;
+    packet->created_us = created_us;
+    packet->is_audio = is_audio;
+    packet->pool = pool;
+    if (!packet_parse(packet))
+        g_clear_pointer(&packet, packet_destroy);
+
+    return packet;
+}
+
+void
+packet_pool_release(packet_pool_t *pool,
+                    packet_t      *packet)
+{
+    bool drained = false;
+
+    g_return_if_fail(NULL != pool);
+    g_return_if_fail(NULL != packet);
+
+    /* NOTE: a release without an acquire is dropped */
+    packet_pool_lock(pool);
+    if (pool->outstanding == 0)
+    {
+        packet_pool_unlock(pool);
+        return;
+    }
+    *(packet_t **)(packet) = pool->free;
+    pool->free = packet;
+    --(pool->outstanding);
+    drained = pool->closing && pool->outstanding == 0;
+    packet_pool_unlock(pool);
+
+    if (drained)
+        packet_pool_free(pool);
+}
+
+/* NOTE: packets still held elsewhere keep the slabs alive,
+ * the pool is freed when the last of them is released */
+void
+packet_pool_destroy(gpointer data)
+{
+    packet_pool_t *pool    = NULL;
+    bool           drained = false;
+
+    g_return_if_fail(NULL != data);
+
+    pool = (packet_pool_t *)(data);
+    packet_pool_lock(pool);
+    pool->closing = true;
+    drained = pool->outstanding == 0;
+    packet_pool_unlock(pool);
+
+    if (drained)
+        packet_pool_free(pool);
+}
+
+static bool
+packet_pool_grow(packet_pool_t *pool)
+{
+    void   *slab = NULL;
+    size_t  idx  = 0;
+
+    g_return_val_if_fail(NULL != pool, false);
+    g_return_val_if_fail(NULL != pool->slabs, false);
+
+    /* Slots are a whole number of cache lines, the slab has to start on
+     * one for every slot to */
+    if (posix_memalign(&slab, PACKET_POOL_ALIGNMENT,
+                pool->slot_size * pool->slots_per_slab) != 0)
+        return false;
+    g_ptr_array_add(pool->slabs, slab);
+
+    for (idx = pool->slots_per_slab; idx > 0; idx--)
+    {
+        *(packet_t **)((uint8_t *)(slab) + (idx - 1) * pool->slot_size) =
+            pool->free;
+        pool->free = (packet_t *)((uint8_t *)(slab) +
+                (idx - 1) * pool->slot_size);
+    }
+
+    return true;
+}
+
+static void
+packet_pool_free(packet_pool_t *pool)
+{
+    g_return_if_fail(NULL != pool);
+
+    if (pool->slabs)
+        g_ptr_array_free(pool->slabs, TRUE);
+    if (pool->shared)
+        g_mutex_clear(&(pool->lock));
+    g_clear_pointer(&pool, g_free);
+}
+
+static inline void
+packet_pool_lock(packet_pool_t *pool)
+{
+    if (pool->shared)
+        g_mutex_lock(&(pool->lock));
+}
+
+static inline void
+packet_pool_unlock(packet_pool_t *pool)
+{
+    if (pool->shared)
+        g_mutex_unlock(&(pool->lock));
+}
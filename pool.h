@@ -0,0 +1,54 @@
+/*
+ * Author: Pu-Chen Mao
+ * Date:   2026/10/15
+ * File:   pool.h
+ * Desc:   Slab pool of single-allocation RTP packets
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "packet.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    #define PACKET_POOL_MTU            1500
+    #define PACKET_POOL_SLOTS_PER_SLAB 32
+
+    /* Each slot holds a packet_t immediately followed by the RTP bytes, so a
+     * pooled packet is one cache-friendly block. Free slots are kept on an
+     * intrusive list, slabs are only returned on packet_pool_destroy(). A
+     * shared pool takes its lock around the free list, so packets may be
+     * acquired and released from different threads */
+    typedef struct packet_pool_t
+    {
+        GPtrArray *slabs;
+        packet_t  *free;
+        size_t     mtu;
+        size_t     slot_size;
+        size_t     slots_per_slab;
+        size_t     outstanding;
+        bool       closing;
+        bool       shared;
+        GMutex     lock;
+
+    } packet_pool_t;
+
+    packet_pool_t *packet_pool_create(size_t mtu, size_t slots_per_slab);
+    packet_pool_t *packet_pool_create_shared(size_t mtu,
+            size_t slots_per_slab);
+    packet_t *packet_pool_acquire(packet_pool_t *pool, const uint8_t *buffer,
+            size_t length, bool is_audio, gint64 created_us);
+    void packet_pool_release(packet_pool_t *pool, packet_t *packet);
+    void packet_pool_destroy(gpointer data);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,271 @@
+/*
+ * Author: Pu-Chen Mao
+ * Date:   2026/10/15
+ * File:   ring.c
+ * Desc:   Bounded lock-free MPSC ring of RTP packets
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "ring.h"
+
+static void packet_ring_notify(packet_ring_t *ring);
+
+/* NOTE: capacity is rounded up to a power of two */
+packet_ring_t *
+packet_ring_create(size_t capacity)
+{
+    packet_ring_t *ring   = NULL;
+    size_t         idx    = 0;
+    bool           result = false;
+
+    g_return_val_if_fail(0 < capacity, NULL);
+
+    if (posix_memalign((void **)(&ring), PACKET_RING_CACHELINE,
+                sizeof(*ring)) != 0)
+        return NULL;
+    memset(ring, 0, sizeof(*ring));
+    ring->eventfd = -1;
+
+    for (capacity--, idx = 1; idx < sizeof(size_t) * 8; idx <<= 1)
+        capacity |= capacity >> idx;
+    capacity++;
+
+    ring->cells = g_try_new0(packet_ring_cell_t, capacity);
+    if (!ring->cells)
+        goto RETURN;
+
+    ring->eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ring->eventfd < 0)
+        goto RETURN;
+
+    ring->mask = capacity - 1;
+    for (idx = 0; idx < capacity; idx++)
+        atomic_init(&(ring->cells[idx].sequence), idx);
+    atomic_init(&(ring->tail), 0);
+    atomic_init(&(ring->armed), false);
+    result = true;
+
+RETURN:
+
+    if (!result)
+        g_clear_pointer(&ring, packet_ring_destroy);
+
+    return ring;
+}
+
+/* NOTE: safe from any thread. On success the ring owns the packet, when
+ * the ring is full false is returned and the packet stays the caller's */
+bool
+packet_ring_push(packet_ring_t *ring,
+                 packet_t      *packet)
+{
+    packet_ring_cell_t *cell     = NULL;
+    size_t              position = 0;
+    size_t              sequence = 0;
+
+    g_return_val_if_fail(NULL != ring, false);
+    g_return_val_if_fail(NULL != packet, false);
+
+    position = atomic_load_explicit(&(ring->tail), memory_order_relaxed);
+    for (;;)
+    {
+        cell = &(ring->cells[position & ring->mask]);
+        sequence = atomic_load_explicit(&(cell->sequence),
+                memory_order_acquire);
+        if (sequence == position)
+        {
+            /* On failure position is reloaded with the current tail */
+            if (atomic_compare_exchange_weak_explicit(&(ring->tail),
+                        &position, position + 1, memory_order_relaxed,
+                        memory_order_relaxed))
+                break;
+        }
+        else if ((ptrdiff_t)(sequence - position) < 0)
+            return false;
+        else
+            position = atomic_load_explicit(&(ring->tail),
+                    memory_order_relaxed);
+    }
+
+    cell->packet = packet;
+    atomic_store_explicit(&(cell->sequence), position + 1,
+            memory_order_release);
+    packet_ring_notify(ring);
+
+    return true;
+}
+
+/* NOTE: copies the buffer into a heap packet, the depacketizer's packet
+ * pool belongs to its own thread and cannot be used by producers */
+bool
+packet_ring_push_buffer(packet_ring_t *ring,
+                        const uint8_t *buffer,
+                        size_t         length,
+                        bool           is_audio)
+{
+    packet_t *packet = NULL;
+
+    g_return_val_if_fail(NULL != ring, false);
+    g_return_val_if_fail(NULL != buffer, false);
+
+    if (length < sizeof(rtp_header_t))
+        return false;
+
+    packet = packet_create_at(buffer, length, is_audio, true,
+            g_get_monotonic_time());
+    if (!packet)
+        return false;
+
+    if (!packet_ring_push(ring, packet))
+    {
+        g_clear_pointer(&packet, packet_destroy);
+        return false;
+    }
+
+    return true;
+}
+
+/* NOTE: consumer thread only, NULL when the ring is empty. A producer that
+ * claimed the next cell but has not filled it yet also reads as empty */
+packet_t *
+packet_ring_pop(packet_ring_t *ring)
+{
+    packet_ring_cell_t *cell     = NULL;
+    packet_t           *packet   = NULL;
+    size_t              sequence = 0;
+
+    g_return_val_if_fail(NULL != ring, NULL);
+
+    cell = &(ring->cells[ring->head & ring->mask]);
+    sequence = atomic_load_explicit(&(cell->sequence), memory_order_acquire);
+    if (sequence != ring->head + 1)
+        return NULL;
+
+    packet = cell->packet;
+    cell->packet = NULL;
+    atomic_store_explicit(&(cell->sequence), ring->head + ring->mask + 1,
+            memory_order_release);
+    ++(ring->head);
+
+    return packet;
+}
+
+/* NOTE: readable once packets arrive while armed, for poll()/epoll() */
+int
+packet_ring_get_fd(const packet_ring_t *ring)
+{
+    g_return_val_if_fail(NULL != ring, -1);
+
+    return ring->eventfd;
+}
+
+/* NOTE: asks producers to signal the eventfd, true when the ring is still
+ * empty afterwards so the consumer may go to sleep on it. Either way the
+ * consumer calls packet_ring_ack() once it is awake again */
+bool
+packet_ring_arm(packet_ring_t *ring)
+{
+    packet_ring_cell_t *cell     = NULL;
+    size_t              sequence = 0;
+
+    g_return_val_if_fail(NULL != ring, false);
+
+    /* Pairs with the fence in packet_ring_notify(): either the producer
+     * sees armed set, or the packet it published is seen here */
+    atomic_store_explicit(&(ring->armed), true, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    cell = &(ring->cells[ring->head & ring->mask]);
+    sequence = atomic_load_explicit(&(cell->sequence), memory_order_acquire);
+
+    return sequence != ring->head + 1;
+}
+
+void
+packet_ring_ack(packet_ring_t *ring)
+{
+    uint64_t count = 0;
+
+    g_return_if_fail(NULL != ring);
+
+    atomic_store_explicit(&(ring->armed), false, memory_order_relaxed);
+    while (read(ring->eventfd, &count, sizeof(count)) < 0 && errno == EINTR);
+}
+
+/* NOTE: blocks until packets are available or timeout_us passes, a
+ * negative timeout waits forever. Returns false on timeout */
+bool
+packet_ring_wait(packet_ring_t *ring,
+                 gint64         timeout_us)
+{
+    struct pollfd pfd   = {0};
+    int           ready = 0;
+
+    g_return_val_if_fail(NULL != ring, false);
+
+    if (!packet_ring_arm(ring))
+    {
+        packet_ring_ack(ring);
+        return true;
+    }
+
+    pfd.fd = ring->eventfd;
+    pfd.events = POLLIN;
+    do
+        ready = poll(&pfd, 1, (timeout_us < 0) ? -1 :
+                (int)((timeout_us + 999) / 1000));
+    while (ready < 0 && errno == EINTR);
+    packet_ring_ack(ring);
+
+    return ready > 0;
+}
+
+/* NOTE: wakes the consumer whether armed or not, for events that do not
+ * go through the ring */
+void
+packet_ring_kick(packet_ring_t *ring)
+{
+    uint64_t count = 1;
+
+    g_return_if_fail(NULL != ring);
+
+    while (write(ring->eventfd, &count, sizeof(count)) < 0 && errno == EINTR);
+}
+
+/* NOTE: packets still queued are destroyed, producers must be done */
+void
+packet_ring_destroy(gpointer data)
+{
+    packet_ring_t *ring   = NULL;
+    packet_t      *packet = NULL;
+
+    g_return_if_fail(NULL != data);
+
+    ring = (packet_ring_t *)(data);
+    while (ring->cells && (packet = packet_ring_pop(ring)))
+        g_clear_pointer(&packet, packet_destroy);
+    if (ring->eventfd >= 0)
+        close(ring->eventfd);
+    g_clear_pointer(&(ring->cells), g_free);
+    free(ring);
+}
+
+static void
+packet_ring_notify(packet_ring_t *ring)
+{
+    uint64_t count = 1;
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!atomic_load_explicit(&(ring->armed), memory_order_relaxed))
+        return;
+
+    /* A full counter (EAGAIN) means the consumer is already signalled */
+    while (write(ring->eventfd, &count, sizeof(count)) < 0 && errno == EINTR);
+}
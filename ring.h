@@ -0,0 +1,65 @@
+/*
+ * Author: Pu-Chen Mao
+ * Date:   2026/10/15
+ * File:   ring.h
+ * Desc:   Bounded lock-free MPSC ring of RTP packets
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "packet.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    #define PACKET_RING_CACHELINE 64
+
+    /* A cell is free for the producer claiming position p while its
+     * sequence equals p, and holds a packet for the consumer once it
+     * equals p + 1 */
+    typedef struct packet_ring_cell_t
+    {
+        atomic_size_t  sequence;
+        packet_t      *packet;
+
+    } packet_ring_cell_t;
+
+    /* Any number of threads may push, one thread at a time may pop. The
+     * eventfd is only written while the consumer is armed, so producers
+     * stay out of the kernel as long as the consumer keeps up. Producer and
+     * consumer positions sit on their own cache lines */
+    typedef struct packet_ring_t
+    {
+        packet_ring_cell_t *cells;
+        size_t              mask;
+        int                 eventfd;
+
+        _Alignas(PACKET_RING_CACHELINE) atomic_size_t tail;
+        _Alignas(PACKET_RING_CACHELINE) size_t        head;
+        _Alignas(PACKET_RING_CACHELINE) atomic_bool   armed;
+
+    } packet_ring_t;
+
+    packet_ring_t *packet_ring_create(size_t capacity);
+    bool packet_ring_push(packet_ring_t *ring, packet_t *packet);
+    bool packet_ring_push_buffer(packet_ring_t *ring, const uint8_t *buffer,
+            size_t length, bool is_audio);
+    packet_t *packet_ring_pop(packet_ring_t *ring);
+    int packet_ring_get_fd(const packet_ring_t *ring);
+    bool packet_ring_arm(packet_ring_t *ring);
+    void packet_ring_ack(packet_ring_t *ring);
+    bool packet_ring_wait(packet_ring_t *ring, gint64 timeout_us);
+    void packet_ring_kick(packet_ring_t *ring);
+    void packet_ring_destroy(gpointer data);
+
+#ifdef __cplusplus
+}
+#endif
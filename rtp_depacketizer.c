@@ -5,7 +5,6 @@
  * Desc:   RTP depacketizer
  */
 
-#include <arpa/inet.h>
 #include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
@@ -14,12 +13,38 @@
 
 static bool rtp_depacketizer_enqueue_packet(rtp_depacketizer_t *depacketizer,
         packet_t *packet, bool *frame_ready);
-static gboolean rtp_depacketizer_reap_frame(gpointer key, gpointer val,
-        gpointer userdata);
-static gboolean rtp_depacketizer_remove_frame(gpointer key, gpointer val,
-        gpointer userdata);
-static gint rtp_depacketizer_compare_timestamps(gconstpointer lval,
-        gconstpointer rval, gpointer data);
+static bool rtp_depacketizer_insert_packet(rtp_depacketizer_t *depacketizer,
+        packet_t *packet, frame_t **frame);
+static void rtp_depacketizer_reap_frames(rtp_depacketizer_t *depacketizer);
+static void rtp_depacketizer_deliver_frames(
+        rtp_depacketizer_t *depacketizer);
+static bool rtp_depacketizer_ingest(rtp_depacketizer_t *depacketizer,
+        bool is_audio, const struct iovec *buffers, gpointer *cookies,
+        size_t count, packet_release_t release, bool *frame_ready);
+static void rtp_depacketizer_schedule_frame(rtp_depacketizer_t *depacketizer,
+        frame_t *frame);
+static void rtp_depacketizer_complete_frame(rtp_depacketizer_t *depacketizer,
+        frame_t *frame);
+static void rtp_depacketizer_count_packet(rtp_depacketizer_t *depacketizer,
+        uint16_t sequence, bool duplicate);
+static void rtp_depacketizer_count_frame(rtp_depacketizer_t *depacketizer,
+        const frame_t *frame, bool result);
+static gint64 rtp_depacketizer_extend_timestamp(
+        rtp_depacketizer_t *depacketizer, uint32_t timestamp);
+static void rtp_depacketizer_push_completed(rtp_depacketizer_t *depacketizer,
+        frame_t *frame);
+static frame_t *rtp_depacketizer_pop_completed(
+        rtp_depacketizer_t *depacketizer);
+static inline gint64 rtp_depacketizer_now(
+        const rtp_depacketizer_t *depacketizer);
+static inline bool rtp_depacketizer_precedes(const frame_t *lframe,
+        const frame_t *rframe);
+static inline void rtp_depacketizer_reset_fragment(
+        rtp_depacketizer_t *depacketizer);
+static void rtp_depacketizer_end_picture(rtp_depacketizer_t *depacketizer,
+        frame_t **frame);
+static bool rtp_depacketizer_filter_packet(rtp_depacketizer_t *depacketizer,
+        packet_t *packet);
 
 #ifdef DEBUG
 static void rtp_depacketizer_print_frames(rtp_depacketizer_t *depacketizer);
@@ -44,12 +69,36 @@ rtp_depacketizer_create(codec_t codec,
     if (!depacketizer->frames)
         goto RETURN;
 
-    depacketizer->completed = g_queue_new();
+    depacketizer->completed = g_ptr_array_new();
     if (!depacketizer->completed)
         goto RETURN;
 
+    depacketizer->pending = g_queue_new();
+    if (!depacketizer->pending)
+        goto RETURN;
+
+    depacketizer->pool = packet_pool_create(PACKET_POOL_MTU,
+            PACKET_POOL_SLOTS_PER_SLAB);
+    if (!depacketizer->pool)
+        goto RETURN;
+
+    if (codec == CODEC_H264)
+    {
+        depacketizer->context.h264.parameter_sets =
+            h264_parameter_sets_create();
+        if (!depacketizer->context.h264.parameter_sets)
+            goto RETURN;
+    }
+    else if (codec == CODEC_H265)
+    {
+        depacketizer->context.hevc.parameter_sets =
+            hevc_parameter_sets_create();
+        if (!depacketizer->context.hevc.parameter_sets)
+            goto RETURN;
+    }
+
     depacketizer->codec = codec;
-    depacketizer->refresh_us = g_get_monotonic_time();
+    depacketizer->refresh_us = rtp_depacketizer_now(depacketizer);
     depacketizer->timeout_us = timeout_us;
     depacketizer->reap_us = reap_us;
 
@@ -91,18 +140,276 @@ rtp_depacketizer_add_buffer(rtp_depacketizer_t *depacketizer,
     g_return_val_if_fail(0 < length, false);
     g_return_val_if_fail(NULL != frame_ready, false);
 
-    packet = packet_create(buffer, length, is_audio, true);
+    packet = packet_pool_acquire(depacketizer->pool, buffer, length,
+            is_audio, rtp_depacketizer_now(depacketizer));
+    if (!packet)
+        return false;
+
+    return rtp_depacketizer_enqueue_packet(depacketizer, packet, frame_ready);
+}
+
+bool
+rtp_depacketizer_add_buffers(rtp_depacketizer_t *depacketizer,
+                             bool                is_audio,
+                             const struct iovec *buffers,
+                             size_t              count,
+                             bool               *frame_ready)
+{
+    g_return_val_if_fail(NULL != depacketizer, false);
+    g_return_val_if_fail(NULL != buffers, false);
+    g_return_val_if_fail(NULL != frame_ready, false);
+
+    return rtp_depacketizer_ingest(depacketizer, is_audio, buffers, NULL,
+            count, NULL, frame_ready);
+}
+
+/* NOTE: the buffer is not copied, it is handed back through release once
+ * its frame has been reassembled or dropped. On error, it is released
+ * before returning */
+bool
+rtp_depacketizer_add_borrowed_buffer(rtp_depacketizer_t *depacketizer,
+                                     bool                is_audio,
+                                     uint8_t            *buffer,
+                                     size_t              length,
+                                     packet_release_t    release,
+                                     gpointer            cookie,
+                                     bool               *frame_ready)
+{
+    packet_t *packet = NULL;
+
+    g_return_val_if_fail(NULL != release, false);
+    g_return_val_if_fail(NULL != buffer, false);
+    if (!depacketizer || !frame_ready)
+    {
+        release(buffer, cookie);
+        g_return_val_if_fail(NULL != depacketizer, false);
+        g_return_val_if_fail(NULL != frame_ready, false);
+    }
+
+    packet = packet_create_borrowed(buffer, length, is_audio,
+            rtp_depacketizer_now(depacketizer), release, cookie);
     if (!packet)
         return false;
 
     return rtp_depacketizer_enqueue_packet(depacketizer, packet, frame_ready);
 }
 
+/* NOTE: cookies[i] is passed to release together with buffers[i]. As for
+ * a single buffer, every buffer is released on error */
+bool
+rtp_depacketizer_add_borrowed_buffers(rtp_depacketizer_t *depacketizer,
+                                      bool                is_audio,
+                                      const struct iovec *buffers,
+                                      gpointer           *cookies,
+                                      size_t              count,
+                                      packet_release_t    release,
+                                      bool               *frame_ready)
+{
+    size_t idx = 0;
+
+    g_return_val_if_fail(NULL != release, false);
+    g_return_val_if_fail(NULL != buffers, false);
+    if (!depacketizer || !cookies || !frame_ready)
+    {
+        for (idx = 0; idx < count; idx++)
+            if (buffers[idx].iov_base)
+                release((uint8_t *)(buffers[idx].iov_base),
+                        cookies ? cookies[idx] : NULL);
+        g_return_val_if_fail(NULL != depacketizer, false);
+        g_return_val_if_fail(NULL != cookies, false);
+        g_return_val_if_fail(NULL != frame_ready, false);
+    }
+
+    return rtp_depacketizer_ingest(depacketizer, is_audio, buffers, cookies,
+            count, release, frame_ready);
+}
+
+/* NOTE: moves up to budget packets (0 for all) from a ring filled by other
+ * threads into the depacketizer, on the depacketizer's own thread. The
+ * reap pass and deliveries run even when the ring is empty, so a consumer
+ * woken by a timer still flushes overdue frames */
+bool
+rtp_depacketizer_drain(rtp_depacketizer_t *depacketizer,
+                       packet_ring_t      *ring,
+                       size_t              budget,
+                       size_t             *drained,
+                       bool               *frame_ready)
+{
+    packet_t *packet = NULL;
+    frame_t  *frame  = NULL;
+    size_t    count  = 0;
+    bool      result = true;
+
+    g_return_val_if_fail(NULL != depacketizer, false);
+    g_return_val_if_fail(NULL != ring, false);
+    g_return_val_if_fail(NULL != frame_ready, false);
+
+    depacketizer->enqueue_us = rtp_depacketizer_now(depacketizer);
+    for (count = 0; budget == 0 || count < budget; count++)
+    {
+        packet = packet_ring_pop(ring);
+        if (!packet)
+            break;
+        if (!rtp_depacketizer_insert_packet(depacketizer, packet, &frame))
+            result = false;
+        if (!depacketizer->batched)
+            rtp_depacketizer_deliver_frames(depacketizer);
+    }
+    rtp_depacketizer_reap_frames(depacketizer);
+    rtp_depacketizer_deliver_frames(depacketizer);
+
+    if (drained)
+        *drained = count;
+    *frame_ready = depacketizer->completed->len > 0;
+
+    return result;
+}
+
+/* NOTE: hands every pending frame over as if reaped, for when no more
+ * packets will come, e.g. at the end of a capture. Frames go out through
+ * the callback if one is set, *frame_ready tells whether any are left */
+bool
+rtp_depacketizer_flush(rtp_depacketizer_t *depacketizer,
+                       bool               *frame_ready)
+{
+    frame_t *frame = NULL;
+
+    g_return_val_if_fail(NULL != depacketizer, false);
+    g_return_val_if_fail(NULL != frame_ready, false);
+
+    depacketizer->enqueue_us = rtp_depacketizer_now(depacketizer);
+    while ((frame = (frame_t *)(g_queue_peek_head(depacketizer->pending))))
+        rtp_depacketizer_complete_frame(depacketizer, frame);
+    rtp_depacketizer_deliver_frames(depacketizer);
+
+    *frame_ready = depacketizer->completed->len > 0;
+
+    return true;
+}
+
+/* NOTE: frames are created and reaped against clock instead of the
+ * monotonic clock, so that captures replayed faster than real time keep
+ * their deadlines. NULL goes back to the monotonic clock */
+bool
+rtp_depacketizer_set_clock(rtp_depacketizer_t *depacketizer,
+                           rtp_clock_t         clock,
+                           gpointer            userdata)
+{
+    g_return_val_if_fail(NULL != depacketizer, false);
+
+    depacketizer->clock = clock;
+    depacketizer->clock_data = userdata;
+
+    return true;
+}
+
+/* NOTE: from now on new frames are composed as their packets arrive, each
+ * in-order packet is copied while still hot and freed at once, making
+ * rtp_depacketizer_get_frame() a buffer swap. The prefix is fixed here,
+ * media and vectors of another prefix are refused by get_frame and
+ * get_frame_vector, and so is a callback already set for another one */
+bool
+rtp_depacketizer_set_incremental(rtp_depacketizer_t *depacketizer,
+                                 prefix_t            prefix)
+{
+    g_return_val_if_fail(NULL != depacketizer, false);
+    g_return_val_if_fail(!depacketizer->deliver ||
+            prefix == depacketizer->deliver_prefix, false);
+
+    depacketizer->incremental = true;
+    depacketizer->prefix = prefix;
+
+    return true;
+}
+
+/* NOTE: VP9 only, packets of spatial or temporal layers above the given
+ * ids are dropped as they arrive, before any frame holds them. Sequence
+ * numbers still account for them, so they do not count as lost */
+bool
+rtp_depacketizer_set_layer_filter(rtp_depacketizer_t *depacketizer,
+                                  uint8_t             max_spatial_id,
+                                  uint8_t             max_temporal_id)
+{
+    g_return_val_if_fail(NULL != depacketizer, false);
+
+    if (depacketizer->codec != CODEC_VP9)
+        return false;
+
+    depacketizer->layer_filter = true;
+    depacketizer->max_spatial_id = max_spatial_id;
+    depacketizer->max_temporal_id = max_temporal_id;
+
+    return true;
+}
+
+/* NOTE: once set, completed frames are reassembled and passed to deliver
+ * before the add call that completed or reaped them returns, so
+ * *frame_ready is only left set for frames that could not be delivered.
+ * Unbatched, each frame goes out alone right after the packet completing
+ * it; batched, everything one add call completes goes out in one call.
+ * deliver must not add packets to this depacketizer, a NULL one turns
+ * delivery off. Incremental, prefix must be the one frames are composed
+ * with */
+bool
+rtp_depacketizer_set_callback(rtp_depacketizer_t         *depacketizer,
+                              prefix_t                    prefix,
+                              bool                        batched,
+                              rtp_depacketizer_deliver_t  deliver,
+                              gpointer                    userdata)
+{
+    g_return_val_if_fail(NULL != depacketizer, false);
+    g_return_val_if_fail(!deliver || !depacketizer->incremental ||
+            prefix == depacketizer->prefix, false);
+
+    if (!depacketizer->deliveries)
+    {
+        depacketizer->deliveries = g_ptr_array_new_with_free_func(
+                media_destroy);
+        if (!depacketizer->deliveries)
+            return false;
+    }
+
+    /* Media already made for another prefix are of no use any more */
+    if (prefix != depacketizer->deliver_prefix)
+        g_ptr_array_set_size(depacketizer->deliveries, 0);
+
+    depacketizer->deliver = deliver;
+    depacketizer->userdata = userdata;
+    depacketizer->batched = batched;
+    depacketizer->deliver_prefix = prefix;
+
+    return true;
+}
+
+/* NOTE: size of the next frame rtp_depacketizer_get_frame() returns once
+ * reassembled with the given prefix, false when no frame is ready */
+bool
+rtp_depacketizer_get_frame_size(rtp_depacketizer_t *depacketizer,
+                                prefix_t            prefix,
+                                size_t             *size)
+{
+    g_return_val_if_fail(NULL != depacketizer, false);
+    g_return_val_if_fail(NULL != size, false);
+
+    if (depacketizer->completed->len == 0)
+        return false;
+
+    return frame_measure(
+            (frame_t *)(g_ptr_array_index(depacketizer->completed, 0)),
+            prefix, size);
+}
+
+/* NOTE: media->length is the buffer size on input and the frame size on
+ * output. A frame that does not fit stays queued and media->length is set
+ * to the size it needs, so the caller can grow the buffer and call again.
+ * A frame composed with another prefix than media's is refused and stays
+ * queued as well */
 bool
 rtp_depacketizer_get_frame(rtp_depacketizer_t *depacketizer,
                            media_t            *media)
 {
     frame_t *frame  = NULL;
+    size_t   size   = 0;
     bool     result = false;
 
     g_return_val_if_fail(NULL != depacketizer, false);
@@ -110,29 +417,172 @@ rtp_depacketizer_get_frame(rtp_depacketizer_t *depacketizer,
     g_return_val_if_fail(NULL != media->buffer, false);
     g_return_val_if_fail(0 < media->length, false);
 
-    if (g_queue_get_length(depacketizer->completed) <= 0)
+    /* Incremental frames are handed over by swapping buffers with media
+     * that owns its buffer, any size will do for those */
+    frame = (depacketizer->completed->len > 0) ?
+        (frame_t *)(g_ptr_array_index(depacketizer->completed, 0)) : NULL;
+    g_return_val_if_fail(!frame || !frame->incremental ||
+            frame->prefix == media->prefix, false);
+    if (frame && !(frame->incremental && media->capacity > 0) &&
+        frame_measure(frame, media->prefix, &size) && size > media->length)
+    {
+        media->length = size;
+        return false;
+    }
+
+    frame = rtp_depacketizer_pop_completed(depacketizer);
+    if (!frame)
+        goto RETURN;
+
+    rtp_depacketizer_reset_fragment(depacketizer);
+    result = frame_reassemble(frame, media, frame->completed,
+            &(depacketizer->context));
+    rtp_depacketizer_count_frame(depacketizer, frame, result);
+    if (!result)
         goto RETURN;
 
-    frame = (frame_t *)(g_queue_pop_head(depacketizer->completed));
+    /* NOTE: the parameter sets stay the depacketizer's, callers go through
+     * rtp_depacketizer_get_parameter_sets() */
+    if (frame->codec != CODEC_OPUS)
+        media->context = depacketizer->context;
+    if (frame->codec == CODEC_H264)
+        media->context.h264.parameter_sets = NULL;
+    else if (frame->codec == CODEC_H265)
+        media->context.hevc.parameter_sets = NULL;
+
+    /* The buffer media gave up is recycled for the next frame */
+    if (frame->incremental && !depacketizer->spare)
+    {
+        depacketizer->sparecap = frame->outcap;
+        depacketizer->spare = g_steal_pointer(&(frame->output));
+    }
+
+    result = true;
+
+RETURN:
+
+    g_clear_pointer(&frame, frame_destroy);
+
+    return result;
+}
+
+/* NOTE: the vector keeps the frame's packets alive until it is reset,
+ * destroyed or handed to the next call; a frame that fails to scatter is
+ * dropped like one that fails to reassemble. A frame composed with another
+ * prefix than vector's is refused and stays queued */
+bool
+rtp_depacketizer_get_frame_vector(rtp_depacketizer_t *depacketizer,
+                                  media_vector_t     *vector)
+{
+    frame_t *frame  = NULL;
+    bool     result = false;
+
+    g_return_val_if_fail(NULL != depacketizer, false);
+    g_return_val_if_fail(NULL != vector, false);
+
+    media_vector_reset(vector);
+
+    frame = (depacketizer->completed->len > 0) ?
+        (frame_t *)(g_ptr_array_index(depacketizer->completed, 0)) : NULL;
+    g_return_val_if_fail(!frame || !frame->incremental ||
+            frame->prefix == vector->prefix, false);
+
+    frame = rtp_depacketizer_pop_completed(depacketizer);
     if (!frame)
         goto RETURN;
 
-    if (!frame_reassemble(frame, media, frame->completed,
-                &(depacketizer->context)))
+    rtp_depacketizer_reset_fragment(depacketizer);
+    result = frame_scatter(frame, vector, frame->completed,
+            &(depacketizer->context));
+    rtp_depacketizer_count_frame(depacketizer, frame, result);
+    if (!result)
         goto RETURN;
 
+    if (frame->codec != CODEC_OPUS)
+        vector->context = depacketizer->context;
     if (frame->codec == CODEC_H264)
-        media->context = depacketizer->context;
+        vector->context.h264.parameter_sets = NULL;
+    else if (frame->codec == CODEC_H265)
+        vector->context.hevc.parameter_sets = NULL;
 
+    vector->retained = g_steal_pointer(&frame);
+    vector->release = frame_destroy;
     result = true;
 
 RETURN:
 
+    if (!result)
+        media_vector_reset(vector);
     g_clear_pointer(&frame, frame_destroy);
 
     return result;
 }
 
+/* NOTE: a snapshot of the counters, to be taken on the thread driving the
+ * depacketizer (the worker thread under the engine) */
+bool
+rtp_depacketizer_get_stats(const rtp_depacketizer_t *depacketizer,
+                           rtp_stats_t              *stats)
+{
+    g_return_val_if_fail(NULL != depacketizer, false);
+    g_return_val_if_fail(NULL != stats, false);
+
+    memcpy(stats, &(depacketizer->stats), sizeof(*stats));
+
+    return true;
+}
+
+void
+rtp_depacketizer_reset_stats(rtp_depacketizer_t *depacketizer)
+{
+    g_return_if_fail(NULL != depacketizer);
+
+    rtp_stats_reset(&(depacketizer->stats));
+}
+
+/* NOTE: H.264 and H.265 only, the avcC or hvcC record for PREFIX_AVCC and
+ * start-code prefixed parameter sets otherwise. generation only moves when a parameter
+ * set really changes; a frame's media context carries the generation it
+ * was decoded under, so comparing the two tells when to re-initialise.
+ * The data is valid until the next call, false until an SPS and a PPS
+ * have been seen */
+bool
+rtp_depacketizer_get_parameter_sets(rtp_depacketizer_t  *depacketizer,
+                                    prefix_t             prefix,
+                                    const uint8_t      **data,
+                                    size_t              *length,
+                                    guint32             *generation)
+{
+    h264_parameter_sets_t *sets = NULL;
+    hevc_parameter_sets_t *hevc = NULL;
+
+    g_return_val_if_fail(NULL != depacketizer, false);
+    g_return_val_if_fail(NULL != data, false);
+    g_return_val_if_fail(NULL != length, false);
+
+    if (depacketizer->codec == CODEC_H265)
+    {
+        hevc = depacketizer->context.hevc.parameter_sets;
+        if (generation)
+            *generation = hevc->generation;
+
+        return (prefix == PREFIX_AVCC) ?
+            hevc_parameter_sets_get_hvcc(hevc, data, length) :
+            hevc_parameter_sets_get_annexb(hevc, data, length);
+    }
+
+    if (depacketizer->codec != CODEC_H264)
+        return false;
+
+    sets = depacketizer->context.h264.parameter_sets;
+    if (generation)
+        *generation = sets->generation;
+
+    return (prefix == PREFIX_AVCC) ?
+        h264_parameter_sets_get_avcc(sets, data, length) :
+        h264_parameter_sets_get_annexb(sets, data, length);
+}
+
 void
 rtp_depacketizer_destroy(gpointer data)
 {
@@ -141,9 +591,27 @@ rtp_depacketizer_destroy(gpointer data)
     g_return_if_fail(NULL != data);
 
     depacketizer = (rtp_depacketizer_t *)(data);
+    /* Links are embedded in the frames, detach them before freeing either */
+    while (depacketizer->pending &&
+           g_queue_pop_head_link(depacketizer->pending));
+    g_clear_pointer(&(depacketizer->pending), g_queue_free);
     g_clear_pointer(&(depacketizer->frames), g_hash_table_destroy);
     if (depacketizer->completed)
-        g_queue_free_full(depacketizer->completed, frame_destroy);
+    {
+        g_ptr_array_foreach(depacketizer->completed, (GFunc)(frame_destroy),
+                NULL);
+        g_ptr_array_free(depacketizer->completed, TRUE);
+    }
+    g_clear_pointer(&(depacketizer->pool), packet_pool_destroy);
+    g_clear_pointer(&(depacketizer->spare), g_free);
+    if (depacketizer->codec == CODEC_H264)
+        g_clear_pointer(&(depacketizer->context.h264.parameter_sets),
+                h264_parameter_sets_destroy);
+    else if (depacketizer->codec == CODEC_H265)
+        g_clear_pointer(&(depacketizer->context.hevc.parameter_sets),
+                hevc_parameter_sets_destroy);
+    if (depacketizer->deliveries)
+        g_ptr_array_free(depacketizer->deliveries, TRUE);
     g_clear_pointer(&depacketizer, g_free);
 }
 
@@ -152,124 +620,575 @@ rtp_depacketizer_enqueue_packet(rtp_depacketizer_t *depacketizer,
                                 packet_t           *packet,
                                 bool               *frame_ready)
 {
-    frame_t  *frame     = NULL;
-    gint64    now_us    = 0;
-    uint32_t  timestamp = 0;
-    bool      new_frame = false;
-    bool      completed = false;
-    bool      result    = false;
+    frame_t *frame  = NULL;
+    bool     result = false;
 
     g_return_val_if_fail(NULL != depacketizer, false);
-    g_return_val_if_fail(NULL != depacketizer->frames, false);
     g_return_val_if_fail(NULL != depacketizer->completed, false);
     g_return_val_if_fail(NULL != packet, false);
-    g_return_val_if_fail(NULL != packet->rtp, false);
     g_return_val_if_fail(NULL != frame_ready, false);
 
-    depacketizer->enqueue_us = g_get_monotonic_time();
-    timestamp = ntohl((packet->rtp->header).timestamp);
-    frame = (frame_t *)(g_hash_table_lookup(depacketizer->frames,
-                GUINT_TO_POINTER(timestamp)));
-    if (!frame)
+    depacketizer->enqueue_us = rtp_depacketizer_now(depacketizer);
+    result = rtp_depacketizer_insert_packet(depacketizer, packet, &frame);
+    rtp_depacketizer_reap_frames(depacketizer);
+    rtp_depacketizer_deliver_frames(depacketizer);
+
+    *frame_ready = depacketizer->completed->len > 0;
+
+    return result;
+}
+
+/* NOTE: *frame caches the frame the previous packet went to, so a run of
+ * packets with the same RTP timestamp costs a single hash table lookup.
+ * On error, the packet is freed here */
+static bool
+rtp_depacketizer_insert_packet(rtp_depacketizer_t  *depacketizer,
+                               packet_t            *packet,
+                               frame_t            **frame)
+{
+    uint32_t timestamp = 0;
+    uint16_t sequence  = 0;
+    bool     new_frame = false;
+    bool     completed = false;
+    bool     duplicate = false;
+    bool     result    = false;
+
+    g_return_val_if_fail(NULL != depacketizer, false);
+    g_return_val_if_fail(NULL != depacketizer->frames, false);
+    g_return_val_if_fail(NULL != packet, false);
+    g_return_val_if_fail(NULL != packet->rtp, false);
+    g_return_val_if_fail(NULL != frame, false);
+
+    ++(depacketizer->stats.packets);
+    depacketizer->stats.bytes += packet->length;
+    timestamp = packet->timestamp;
+    sequence = packet->sequence;
+    if (depacketizer->layer_filter &&
+        !rtp_depacketizer_filter_packet(depacketizer, packet))
     {
-        frame = frame_create(timestamp, depacketizer->codec);
-        if (!frame)
-            goto RETURN;
-        new_frame = true;
+        ++(depacketizer->stats.packets_filtered);
+        rtp_depacketizer_count_packet(depacketizer, sequence, false);
+        if (packet->marker)
+            rtp_depacketizer_end_picture(depacketizer, frame);
+        g_clear_pointer(&packet, packet_destroy);
+        return true;
+    }
+    if (!*frame || (*frame)->timestamp != timestamp)
+    {
+        *frame = (frame_t *)(g_hash_table_lookup(depacketizer->frames,
+                    GUINT_TO_POINTER(timestamp)));
+        if (!*frame)
+        {
+            *frame = frame_create(timestamp, depacketizer->codec,
+                    depacketizer->enqueue_us);
+            if (!*frame)
+                goto RETURN;
+            (*frame)->extended = rtp_depacketizer_extend_timestamp(
+                    depacketizer, timestamp);
+            new_frame = true;
+            if (depacketizer->incremental &&
+                !frame_set_output(*frame, depacketizer->prefix,
+                    &(depacketizer->context), depacketizer->spare,
+                    depacketizer->sparecap))
+                goto RETURN;
+            depacketizer->spare = NULL;
+        }
     }
 
-    if (!frame_add_packet(frame, packet, &completed))
+    if (!frame_add_packet(*frame, packet, &completed, &duplicate))
         goto RETURN;
+    rtp_depacketizer_count_packet(depacketizer, sequence, duplicate);
+
     if (new_frame)
+    {
         g_hash_table_insert(depacketizer->frames,
-                GUINT_TO_POINTER(timestamp), frame);
-    g_hash_table_foreach_steal(depacketizer->frames,
-            rtp_depacketizer_reap_frame, depacketizer);
+                GUINT_TO_POINTER(timestamp), *frame);
+        rtp_depacketizer_schedule_frame(depacketizer, *frame);
+    }
+
+    /* A completed frame leaves the table at once, so later packets with
+     * the same timestamp start a new frame instead of reopening it */
+    if (completed)
+    {
+        rtp_depacketizer_complete_frame(depacketizer, *frame);
+        *frame = NULL;
+    }
 
-    *frame_ready = !g_queue_is_empty(depacketizer->completed);
     result = true;
 
 RETURN:
 
-    if (!result && new_frame)
-        g_clear_pointer(&frame, frame_destroy);
-    if (now_us - depacketizer->refresh_us > depacketizer->timeout_us)
+    if (!result)
     {
-        g_hash_table_foreach_remove(depacketizer->frames,
-                rtp_depacketizer_remove_frame, depacketizer);
-        depacketizer->refresh_us = now_us;
+        if (new_frame)
+            g_clear_pointer(frame, frame_destroy);
+        *frame = NULL;
+        g_clear_pointer(&packet, packet_destroy);
+    }
+
+    return result;
+}
+
+/* NOTE: pending frames are kept in deadline order, so only the frames that
+ * actually expire are visited. An expired frame is handed over incomplete
+ * when reap_us comes first, or dropped when timeout_us does */
+static void
+rtp_depacketizer_reap_frames(rtp_depacketizer_t *depacketizer)
+{
+    GList   *link  = NULL;
+    frame_t *frame = NULL;
+
+    g_return_if_fail(NULL != depacketizer);
+    g_return_if_fail(NULL != depacketizer->frames);
+    g_return_if_fail(NULL != depacketizer->pending);
+
+    while ((link = g_queue_peek_head_link(depacketizer->pending)))
+    {
+        frame = (frame_t *)(link->data);
+        if (frame->expire_us >= depacketizer->enqueue_us)
+            break;
+
+        if (depacketizer->reap_us <= depacketizer->timeout_us)
+            rtp_depacketizer_complete_frame(depacketizer, frame);
+        else
+        {
+            ++(depacketizer->stats.frames_timed_out);
+            g_queue_unlink(depacketizer->pending, link);
+            g_hash_table_remove(depacketizer->frames,
+                    GUINT_TO_POINTER(frame->timestamp));
+        }
+    }
+
 #ifdef DEBUG
+    if (depacketizer->enqueue_us - depacketizer->refresh_us >
+            depacketizer->timeout_us)
+    {
+        depacketizer->refresh_us = depacketizer->enqueue_us;
         rtp_depacketizer_print_frames(depacketizer);
         rtp_depacketizer_print_completed(depacketizer);
+    }
 #endif
+}
+
+/* NOTE: every frame gets the same offset from its creation time, so the new
+ * deadline is almost always the latest and the walk from the tail stops at
+ * once; it only matters if the clock steps back between ingest calls */
+static void
+rtp_depacketizer_schedule_frame(rtp_depacketizer_t *depacketizer,
+                                frame_t            *frame)
+{
+    GList *link = NULL;
+
+    g_return_if_fail(NULL != depacketizer);
+    g_return_if_fail(NULL != depacketizer->pending);
+    g_return_if_fail(NULL != frame);
+
+    frame->expire_us = frame->created_us +
+        MIN(depacketizer->reap_us, depacketizer->timeout_us);
+    frame->link.data = frame;
+    for (link = g_queue_peek_tail_link(depacketizer->pending);
+         link && ((frame_t *)(link->data))->expire_us > frame->expire_us;
+         link = link->prev);
+
+    if (link)
+        g_queue_insert_after_link(depacketizer->pending, link, &(frame->link));
+    else
+        g_queue_push_head_link(depacketizer->pending, &(frame->link));
+}
+
+/* NOTE: media are kept across calls, incremental frames swap their buffers
+ * with them and the others grow them to the largest frame seen so far */
+static void
+rtp_depacketizer_deliver_frames(rtp_depacketizer_t *depacketizer)
+{
+    GPtrArray *deliveries = NULL;
+    media_t   *media      = NULL;
+    frame_t   *frame      = NULL;
+    size_t     count      = 0;
+
+    g_return_if_fail(NULL != depacketizer);
+
+    deliveries = depacketizer->deliveries;
+    if (!depacketizer->deliver)
+        return;
+
+    while (depacketizer->completed->len > 0)
+    {
+        if (count == deliveries->len)
+        {
+            media = media_create_sized(depacketizer->deliver_prefix,
+                    FRAME_MIN_OUTPUT);
+            if (!media)
+                break;
+            g_ptr_array_add(deliveries, media);
+        }
+
+        media = (media_t *)(g_ptr_array_index(deliveries, count));
+        media->length = media->capacity;
+        if (!rtp_depacketizer_get_frame(depacketizer, media))
+        {
+            /* A frame too large stays queued with the size it needs, one
+             * that fails to reassemble is already gone */
+            if (media->length > media->capacity &&
+                !media_reserve(media, media->length))
+            {
+                frame = rtp_depacketizer_pop_completed(depacketizer);
+                g_clear_pointer(&frame, frame_destroy);
+            }
+            continue;
+        }
+
+        if (!depacketizer->batched)
+            depacketizer->deliver(depacketizer,
+                    (media_t **)(deliveries->pdata), 1,
+                    depacketizer->userdata);
+        else
+            ++count;
+    }
+
+    if (count > 0)
+        depacketizer->deliver(depacketizer, (media_t **)(deliveries->pdata),
+                count, depacketizer->userdata);
+}
+
+/* NOTE: moves a pending frame, complete or not, to the completed queue */
+static void
+rtp_depacketizer_complete_frame(rtp_depacketizer_t *depacketizer,
+                                frame_t            *frame)
+{
+    g_return_if_fail(NULL != depacketizer);
+    g_return_if_fail(NULL != frame);
+
+    g_queue_unlink(depacketizer->pending, &(frame->link));
+    g_hash_table_steal(depacketizer->frames,
+            GUINT_TO_POINTER(frame->timestamp));
+    rtp_depacketizer_push_completed(depacketizer, frame);
+
+    if (frame->completed)
+        ++(depacketizer->stats.frames_completed);
+    else
+        ++(depacketizer->stats.frames_reaped);
+    rtp_histogram_record(&(depacketizer->stats.assembly),
+            depacketizer->enqueue_us - frame->created_us);
+}
+
+/* NOTE: sequence numbers are compared against the highest seen modulo
+ * 2^16; a jump ahead counts the numbers skipped as lost, a late arrival
+ * is reordered by how far it is behind and takes one back off the loss */
+static void
+rtp_depacketizer_count_packet(rtp_depacketizer_t *depacketizer,
+                              uint16_t            sequence,
+                              bool                duplicate)
+{
+    rtp_stats_t *stats = NULL;
+    int16_t      delta = 0;
+
+    g_return_if_fail(NULL != depacketizer);
+
+    stats = &(depacketizer->stats);
+    if (duplicate)
+    {
+        ++(stats->duplicates);
+        return;
     }
 
+    if (!depacketizer->highest_valid)
+    {
+        depacketizer->highest = sequence;
+        depacketizer->highest_valid = true;
+        return;
+    }
+
+    delta = (int16_t)(sequence - depacketizer->highest);
+    if (delta > 0)
+    {
+        stats->lost += delta - 1;
+        depacketizer->highest = sequence;
+    }
+    else
+    {
+        ++(stats->reordered);
+        stats->max_reorder = MAX(stats->max_reorder, (guint64)(-delta));
+        --(stats->lost);
+    }
+}
+
+/* NOTE: a frame is rejected when its codec refused to reassemble it or,
+ * composed incrementally, any of its packets */
+static void
+rtp_depacketizer_count_frame(rtp_depacketizer_t *depacketizer,
+                             const frame_t      *frame,
+                             bool                result)
+{
+    g_return_if_fail(NULL != depacketizer);
+    g_return_if_fail(NULL != frame);
+
+    if (!result || frame->rejected)
+        ++(depacketizer->stats.frames_rejected);
+    if (result)
+        rtp_histogram_record(&(depacketizer->stats.delivery),
+                rtp_depacketizer_now(depacketizer) - frame->created_us);
+}
+
+/* NOTE: the clock is read once and the reap pass runs once for the whole
+ * batch; consecutive buffers sharing an RTP timestamp reuse one frame lookup.
+ * Buffers are copied into the packet pool unless release is given, in which
+ * case they are borrowed. A buffer that cannot be enqueued is dropped (or
+ * released) and the rest are still added */
+static bool
+rtp_depacketizer_ingest(rtp_depacketizer_t *depacketizer,
+                        bool                is_audio,
+                        const struct iovec *buffers,
+                        gpointer           *cookies,
+                        size_t              count,
+                        packet_release_t    release,
+                        bool               *frame_ready)
+{
+    packet_t *packet = NULL;
+    frame_t  *frame  = NULL;
+    uint8_t  *buffer = NULL;
+    size_t    length = 0;
+    size_t    idx    = 0;
+    bool      result = true;
+
+    g_return_val_if_fail(NULL != depacketizer, false);
+    g_return_val_if_fail(NULL != depacketizer->completed, false);
+    g_return_val_if_fail(NULL != buffers, false);
+    g_return_val_if_fail(NULL != frame_ready, false);
+
+    depacketizer->enqueue_us = rtp_depacketizer_now(depacketizer);
+    for (idx = 0; idx < count; idx++)
+    {
+        buffer = (uint8_t *)(buffers[idx].iov_base);
+        length = buffers[idx].iov_len;
+        if (!buffer || length < sizeof(rtp_header_t))
+        {
+            if (buffer && release)
+                release(buffer, cookies[idx]);
+            result = false;
+            continue;
+        }
+
+        if (release)
+            packet = packet_create_borrowed(buffer, length, is_audio,
+                    depacketizer->enqueue_us, release, cookies[idx]);
+        else
+            packet = packet_pool_acquire(depacketizer->pool, buffer, length,
+                    is_audio, depacketizer->enqueue_us);
+        if (!packet || !rtp_depacketizer_insert_packet(depacketizer, packet,
+                    &frame))
+            result = false;
+        if (!depacketizer->batched)
+            rtp_depacketizer_deliver_frames(depacketizer);
+    }
+    rtp_depacketizer_reap_frames(depacketizer);
+    rtp_depacketizer_deliver_frames(depacketizer);
+
+    *frame_ready = depacketizer->completed->len > 0;
+
     return result;
 }
 
-static gboolean
-rtp_depacketizer_reap_frame(gpointer key,
-                        gpointer val,
-                        gpointer userdata)
+/* NOTE: unwraps the 32-bit RTP timestamp against the newest one seen, so
+ * frames keep their order across the wrap-around (every ~13h at 90kHz) */
+static gint64
+rtp_depacketizer_extend_timestamp(rtp_depacketizer_t *depacketizer,
+                                  uint32_t            timestamp)
 {
-    rtp_depacketizer_t *depacketizer = NULL;
-    frame_t            *frame        = NULL;
-    gint64              age_us       = 0;
+    gint64 extended = 0;
 
-    g_return_val_if_fail(NULL != key, TRUE);
-    g_return_val_if_fail(NULL != val, TRUE);
-    g_return_val_if_fail(NULL != userdata, TRUE);
+    g_return_val_if_fail(NULL != depacketizer, 0);
 
-    depacketizer = (rtp_depacketizer_t *)(userdata);
-    frame = (frame_t *)(val);
-    age_us = depacketizer->enqueue_us - frame->created_us;
-    if (frame->completed || age_us > depacketizer->reap_us)
+    if (!depacketizer->extended_valid)
     {
-        g_queue_insert_sorted(depacketizer->completed, frame,
-                rtp_depacketizer_compare_timestamps, NULL);
-        return TRUE;
+        depacketizer->extended = timestamp;
+        depacketizer->extended_valid = true;
+        return depacketizer->extended;
     }
 
-    return FALSE;
+    extended = depacketizer->extended +
+        (int32_t)(timestamp - (uint32_t)(depacketizer->extended));
+    if (extended > depacketizer->extended)
+        depacketizer->extended = extended;
+
+    return extended;
 }
 
-static gboolean
-rtp_depacketizer_remove_frame(gpointer key,
-                          gpointer val,
-                          gpointer userdata)
+/* NOTE: completed frames form a binary min-heap on (extended timestamp,
+ * completion order), so insertion and removal are O(log n) and frames
+ * sharing a timestamp come out in the order they completed */
+static void
+rtp_depacketizer_push_completed(rtp_depacketizer_t *depacketizer,
+                                frame_t            *frame)
 {
-    rtp_depacketizer_t *depacketizer = NULL;
-    frame_t            *frame        = NULL;
-    gint64              age_us       = 0;
+    gpointer *heap   = NULL;
+    size_t    child  = 0;
+    size_t    parent = 0;
 
-    g_return_val_if_fail(NULL != key, TRUE);
-    g_return_val_if_fail(NULL != val, TRUE);
-    g_return_val_if_fail(NULL != userdata, TRUE);
+    g_return_if_fail(NULL != depacketizer);
+    g_return_if_fail(NULL != depacketizer->completed);
+    g_return_if_fail(NULL != frame);
 
-    depacketizer = (rtp_depacketizer_t *)(userdata);
-    frame = (frame_t *)(val);
-    age_us = depacketizer->enqueue_us - frame->created_us;
-    if (age_us > depacketizer->timeout_us)
-        return TRUE;
+    frame->order = depacketizer->completions++;
+    g_ptr_array_add(depacketizer->completed, frame);
+    heap = depacketizer->completed->pdata;
+    for (child = depacketizer->completed->len - 1; child > 0; child = parent)
+    {
+        parent = (child - 1) / 2;
+        if (!rtp_depacketizer_precedes(frame, (frame_t *)(heap[parent])))
+            break;
+        heap[child] = heap[parent];
+    }
+    heap[child] = frame;
+}
+
+static frame_t *
+rtp_depacketizer_pop_completed(rtp_depacketizer_t *depacketizer)
+{
+    gpointer *heap   = NULL;
+    frame_t  *head   = NULL;
+    frame_t  *last   = NULL;
+    size_t    length = 0;
+    size_t    parent = 0;
+    size_t    child  = 0;
+
+    g_return_val_if_fail(NULL != depacketizer, NULL);
+    g_return_val_if_fail(NULL != depacketizer->completed, NULL);
+
+    length = depacketizer->completed->len;
+    if (length == 0)
+        return NULL;
+
+    heap = depacketizer->completed->pdata;
+    head = (frame_t *)(heap[0]);
+    last = (frame_t *)(g_ptr_array_remove_index(depacketizer->completed,
+                --length));
+    if (length == 0)
+        return head;
 
-    return FALSE;
+    for (parent = 0; (child = 2 * parent + 1) < length; parent = child)
+    {
+        if (child + 1 < length && rtp_depacketizer_precedes(
+                    (frame_t *)(heap[child + 1]), (frame_t *)(heap[child])))
+            ++child;
+        if (!rtp_depacketizer_precedes((frame_t *)(heap[child]), last))
+            break;
+        heap[parent] = heap[child];
+    }
+    heap[parent] = last;
+
+    return head;
+}
+
+static inline gint64
+rtp_depacketizer_now(const rtp_depacketizer_t *depacketizer)
+{
+    return depacketizer->clock ?
+        depacketizer->clock(depacketizer->clock_data) :
+        g_get_monotonic_time();
 }
 
-static gint
-rtp_depacketizer_compare_timestamps(gconstpointer lval,
-                                gconstpointer rval,
-                                gpointer      data)
+static inline bool
+rtp_depacketizer_precedes(const frame_t *lframe,
+                          const frame_t *rframe)
 {
-    frame_t *lframe = NULL;
-    frame_t *rframe = NULL;
+    if (lframe->extended != rframe->extended)
+        return lframe->extended < rframe->extended;
 
-    g_return_val_if_fail(NULL != lval, 0);
-    g_return_val_if_fail(NULL != rval, 0);
+    return lframe->order < rframe->order;
+}
+
+/* NOTE: the marker packet of the picture was dropped while the packet
+ * ending its last layer frame kept already sits at the tail of its frame,
+ * which would otherwise wait for packets that never come */
+static void
+rtp_depacketizer_end_picture(rtp_depacketizer_t  *depacketizer,
+                             frame_t            **frame)
+{
+    frame_t *ended = NULL;
+
+    g_return_if_fail(NULL != depacketizer);
+    g_return_if_fail(NULL != frame);
 
-    lframe = (frame_t *)(lval);
-    rframe = (frame_t *)(rval);
+    if (!depacketizer->picture_end_valid)
+        return;
 
-    return (gint64)(lframe->timestamp) - (gint64)(rframe->timestamp);
+    ended = (frame_t *)(g_hash_table_lookup(depacketizer->frames,
+                GUINT_TO_POINTER(depacketizer->picture_timestamp)));
+    if (!ended || ended->tail != depacketizer->picture_end)
+        return;
+
+    if (frame_end_at_tail(ended))
+    {
+        rtp_depacketizer_complete_frame(depacketizer, ended);
+        if (*frame == ended)
+            *frame = NULL;
+    }
+}
+
+/* NOTE: false for a packet of a filtered out layer. With the upper spatial
+ * layers gone, the packet ending the highest one kept takes the marker
+ * over, or the picture would wait for packets that never come. A picture
+ * may skip layers, so the marker packet being dropped also ends it, at
+ * the last packet kept that ends a layer frame, whichever came first */
+static bool
+rtp_depacketizer_filter_packet(rtp_depacketizer_t *depacketizer,
+                               packet_t           *packet)
+{
+    uint8_t spatial_id  = 0;
+    uint8_t temporal_id = 0;
+    bool    end         = false;
+
+    g_return_val_if_fail(NULL != depacketizer, false);
+    g_return_val_if_fail(NULL != packet, false);
+
+    /* Unparseable packets are left for reassembly to reject */
+    if (!packet->payload || packet->payloadlen == 0 ||
+        !vp9_get_layer_ids(packet->payload, packet->payloadlen, &spatial_id,
+            &temporal_id, &end))
+        return true;
+
+    if (!depacketizer->picture_valid ||
+        depacketizer->picture_timestamp != packet->timestamp)
+    {
+        depacketizer->picture_timestamp = packet->timestamp;
+        depacketizer->picture_valid = true;
+        depacketizer->picture_end_valid = false;
+        depacketizer->picture_ended = false;
+    }
+
+    if (spatial_id > depacketizer->max_spatial_id ||
+        temporal_id > depacketizer->max_temporal_id)
+    {
+        if (packet->marker)
+            depacketizer->picture_ended = true;
+        return false;
+    }
+
+    if (!end)
+        return true;
+
+    if (spatial_id == depacketizer->max_spatial_id ||
+        depacketizer->picture_ended)
+        packet->marker = true;
+    if (!depacketizer->picture_end_valid ||
+        (int16_t)(packet->sequence - depacketizer->picture_end) > 0)
+    {
+        depacketizer->picture_end = packet->sequence;
+        depacketizer->picture_end_valid = true;
+    }
+
+    return true;
+}
+
+/* NOTE: a frame never starts inside a fragmented NALU of the previous one */
+static inline void
+rtp_depacketizer_reset_fragment(rtp_depacketizer_t *depacketizer)
+{
+    if (depacketizer->codec == CODEC_H264)
+        depacketizer->context.h264.fu_length = 0;
+    else if (depacketizer->codec == CODEC_H265)
+        depacketizer->context.hevc.fu_length = 0;
 }
 
 #ifdef DEBUG
@@ -286,7 +1205,7 @@ static void rtp_depacketizer_print_frames(rtp_depacketizer_t *depacketizer)
 
     printf("\nIncomplete frames:\n");
 
-    now_us = g_get_monotonic_time();
+    now_us = rtp_depacketizer_now(depacketizer);
     g_hash_table_iter_init(&frame_it, depacketizer->frames);
     while (g_hash_table_iter_next(&frame_it, (gpointer *)(&timestamp),
                 (gpointer *)(&frame)))
@@ -304,20 +1223,23 @@ static void rtp_depacketizer_print_completed(rtp_depacketizer_t *depacketizer)
     g_return_if_fail(NULL != depacketizer);
 
     printf("\nCompleted frames:\n");
-    g_queue_foreach(depacketizer->completed,
-            rtp_depacketizer_foreach_frame, NULL);
+    g_ptr_array_foreach(depacketizer->completed,
+            rtp_depacketizer_foreach_frame, depacketizer);
 }
 
 static void rtp_depacketizer_foreach_frame(gpointer data, gpointer userdata)
 {
-    frame_t *frame  = NULL;
-    gint64   now_us = 0;
-    float    age    = 0.0;
+    rtp_depacketizer_t *depacketizer = NULL;
+    frame_t            *frame        = NULL;
+    gint64              now_us       = 0;
+    float               age          = 0.0;
 
     g_return_if_fail(NULL != data);
+    g_return_if_fail(NULL != userdata);
 
+    depacketizer = (rtp_depacketizer_t *)(userdata);
     frame = (frame_t *)(data);
-    now_us = g_get_monotonic_time();
+    now_us = rtp_depacketizer_now(depacketizer);
     age = ((float)(now_us) - (float)(frame->created_us)) / 1000000;
     printf("Frame timestamp: [%u], marker: [%u], completed: [%u], "
             "age: [%03.3f], packets: ", frame->timestamp, frame->marker,
@@ -10,26 +10,70 @@
 #include <glib.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <sys/uio.h>
 
 #include "frame.h"
 #include "media.h"
 #include "packet.h"
+#include "pool.h"
+#include "ring.h"
+#include "stats.h"
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
+    struct rtp_depacketizer_t;
+
+    /* Called with frames taken off the completed queue, in the order
+     * rtp_depacketizer_get_frame() would return them. The media belong to
+     * the depacketizer and are only valid during the call */
+    typedef void (*rtp_depacketizer_deliver_t)(
+            struct rtp_depacketizer_t *depacketizer, media_t **media,
+            size_t count, gpointer userdata);
+
+    /* Time in microseconds that frame deadlines are kept against */
+    typedef gint64 (*rtp_clock_t)(gpointer userdata);
+
     typedef struct rtp_depacketizer_t
     {
-        GHashTable *frames;
-        GQueue     *completed;
-        codec_t     codec;
-        gint64      enqueue_us;
-        gint64      refresh_us;
-        gint64      timeout_us;
-        gint64      reap_us;
-        context_t   context;
+        GHashTable    *frames;
+        GPtrArray     *completed;
+        GQueue        *pending;
+        packet_pool_t *pool;
+        codec_t        codec;
+        gint64         extended;
+        bool           extended_valid;
+        guint64        completions;
+        gint64         enqueue_us;
+        gint64         refresh_us;
+        gint64         timeout_us;
+        gint64         reap_us;
+        rtp_clock_t    clock;
+        gpointer       clock_data;
+        bool           incremental;
+        prefix_t       prefix;
+        uint8_t       *spare;
+        size_t         sparecap;
+        context_t      context;
+        rtp_stats_t    stats;
+        uint16_t       highest;
+        bool           highest_valid;
+        bool           layer_filter;
+        uint8_t        max_spatial_id;
+        uint8_t        max_temporal_id;
+        uint32_t       picture_timestamp;
+        bool           picture_valid;
+        uint16_t       picture_end;        // last kept packet ending a layer
+        bool           picture_end_valid;
+        bool           picture_ended;      // its marker packet was dropped
+
+        rtp_depacketizer_deliver_t deliver;
+        gpointer                   userdata;
+        bool                       batched;
+        prefix_t                   deliver_prefix;
+        GPtrArray                 *deliveries;
 
     } rtp_depacketizer_t;
 
@@ -39,10 +83,43 @@ extern "C"
             gint64 timeout_us, gint64 reap_us);
     bool rtp_depacketizer_add_buffer(rtp_depacketizer_t *depacketizer,
             bool is_audio, uint8_t *buffer, size_t length, bool *frame_ready);
+    bool rtp_depacketizer_add_buffers(rtp_depacketizer_t *depacketizer,
+            bool is_audio, const struct iovec *buffers, size_t count,
+            bool *frame_ready);
+    bool rtp_depacketizer_add_borrowed_buffer(rtp_depacketizer_t *depacketizer,
+            bool is_audio, uint8_t *buffer, size_t length,
+            packet_release_t release, gpointer cookie, bool *frame_ready);
+    bool rtp_depacketizer_add_borrowed_buffers(rtp_depacketizer_t *depacketizer,
+            bool is_audio, const struct iovec *buffers, gpointer *cookies,
+            size_t count, packet_release_t release, bool *frame_ready);
     bool rtp_depacketizer_add_packet(rtp_depacketizer_t *depacketizer,
             packet_t *packet, bool *frame_ready);
+    bool rtp_depacketizer_drain(rtp_depacketizer_t *depacketizer,
+            packet_ring_t *ring, size_t budget, size_t *drained,
+            bool *frame_ready);
+    bool rtp_depacketizer_flush(rtp_depacketizer_t *depacketizer,
+            bool *frame_ready);
+    bool rtp_depacketizer_set_clock(rtp_depacketizer_t *depacketizer,
+            rtp_clock_t clock, gpointer userdata);
+    bool rtp_depacketizer_set_incremental(rtp_depacketizer_t *depacketizer,
+            prefix_t prefix);
+    bool rtp_depacketizer_set_layer_filter(rtp_depacketizer_t *depacketizer,
+            uint8_t max_spatial_id, uint8_t max_temporal_id);
+    bool rtp_depacketizer_set_callback(rtp_depacketizer_t *depacketizer,
+            prefix_t prefix, bool batched, rtp_depacketizer_deliver_t deliver,
+            gpointer userdata);
+    bool rtp_depacketizer_get_frame_size(rtp_depacketizer_t *depacketizer,
+            prefix_t prefix, size_t *size);
     bool rtp_depacketizer_get_frame(rtp_depacketizer_t *depacketizer,
             media_t *media);
+    bool rtp_depacketizer_get_frame_vector(rtp_depacketizer_t *depacketizer,
+            media_vector_t *vector);
+    bool rtp_depacketizer_get_stats(const rtp_depacketizer_t *depacketizer,
+            rtp_stats_t *stats);
+    void rtp_depacketizer_reset_stats(rtp_depacketizer_t *depacketizer);
+    bool rtp_depacketizer_get_parameter_sets(
+            rtp_depacketizer_t *depacketizer, prefix_t prefix,
+            const uint8_t **data, size_t *length, guint32 *generation);
     void rtp_depacketizer_destroy(gpointer data);
 
 #ifdef __cplusplus
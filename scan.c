@@ -0,0 +1,219 @@
+/*
+ * Author: Pu-Chen Mao
+ * Date:   2026/10/15
+ * File:   scan.c
+ * Desc:   Vectorized start code and emulation prevention scanner
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "scan.h"
+
+#define INLINE inline
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SCAN_AVX2 1
+#endif
+
+static INLINE size_t scan_find_scalar(const uint8_t *data, size_t offset,
+        size_t length);
+#ifdef __SSE2__
+static size_t scan_find_sse2(const uint8_t *data, size_t length);
+#endif
+#ifdef SCAN_AVX2
+static size_t scan_find_avx2(const uint8_t *data, size_t length)
+    __attribute__((target("avx2")));
+#endif
+
+size_t
+scan_find_emulation(const uint8_t *data,
+                    size_t         length)
+{
+    g_return_val_if_fail(NULL != data || 0 == length, length);
+
+#ifdef SCAN_AVX2
+    if (__builtin_cpu_supports("avx2"))
+        return scan_find_avx2(data, length);
+#endif
+#ifdef __SSE2__
+    return scan_find_sse2(data, length);
+#else
+    return scan_find_scalar(data, 0, length);
+#endif
+}
+
+/* NOTE: drops the emulation prevention byte of every 00 00 03, copying
+ * at most capacity bytes, and returns how many it copied. The runs in
+ * between are found by the scanner and copied whole, any other 00 00 0x
+ * is only stepped past its first zero so a 00 00 00 03 still loses the 03 */
+size_t
+scan_extract_rbsp(const uint8_t *nalu,
+                  size_t         length,
+                  uint8_t       *rbsp,
+                  size_t         capacity)
+{
+    size_t index   = 0;
+    size_t offset  = 0;
+    size_t end     = 0;
+    size_t count   = 0;
+    size_t rbsplen = 0;
+
+    g_return_val_if_fail(NULL != nalu, 0);
+    g_return_val_if_fail(NULL != rbsp, 0);
+
+    while (index < length && rbsplen < capacity)
+    {
+        offset = index + scan_find_emulation(nalu + index, length - index);
+        if (offset >= length)
+            end = length;
+        else
+            end = offset + ((nalu[offset + 2] == 0x03) ? 2 : 1);
+        count = MIN(end - index, capacity - rbsplen);
+        memcpy(rbsp + rbsplen, nalu + index, count);
+        rbsplen += count;
+        index += count;
+        if (index == offset + 2)
+            ++index;
+    }
+
+    return rbsplen;
+}
+
+/* NOTE: checks a NALU, or the next piece of one, for what would read as
+ * a start code once in Annex B: any 00 00 0x but an emulation prevention
+ * 00 00 03, including one straddling the previous piece, given the *zeros
+ * it ended with. *zeros is updated for the next piece. Trailing zeros are
+ * let through, Annex B parsers drop them as trailing_zero_8bits */
+bool
+scan_validate_payload(const uint8_t *data,
+                      size_t         length,
+                      uint8_t       *zeros)
+{
+    size_t index  = 0;
+    size_t offset = 0;
+
+    g_return_val_if_fail(NULL != data, false);
+    g_return_val_if_fail(NULL != zeros, false);
+
+    if (length > 0 && *zeros >= 2 && data[0] <= 0x02)
+        return false;
+    if (length > 1 && *zeros >= 1 && data[0] == 0x00 && data[1] <= 0x02)
+        return false;
+
+    for (offset = scan_find_emulation(data, length); offset < length;
+         offset = index + scan_find_emulation(data + index, length - index))
+    {
+        if (data[offset + 2] != 0x03)
+            return false;
+        index = offset + 3;
+    }
+
+    for (index = length; index > 0 && length - index < 2 &&
+         data[index - 1] == 0x00; index--);
+    *zeros = (index > 0) ? length - index : MIN(*zeros + length, 2);
+
+    return true;
+}
+
+/* NOTE: a byte above 3 at i + 2 rules out a match at i, i + 1 and i + 2,
+ * a non-zero one at i + 1 rules out i and i + 1, so most of the input is
+ * stepped over three bytes at a time */
+static INLINE size_t
+scan_find_scalar(const uint8_t *data,
+                 size_t         offset,
+                 size_t         length)
+{
+    size_t index = offset;
+
+    while (index + 2 < length)
+    {
+        if (data[index + 2] > 0x03)
+            index += 3;
+        else if (data[index + 1] != 0x00)
+            index += 2;
+        else if (data[index] != 0x00)
+            index += 1;
+        else
+            return index;
+    }
+
+    return length;
+}
+
+#ifdef __SSE2__
+/* NOTE: each lane i is compared at i, i + 1 and i + 2 through three
+ * unaligned loads, x <= 3 being min(x, 3) == x, so a set bit in the mask
+ * is a match and the lowest one is the first. The last 17 bytes are left
+ * to the scalar scan */
+static size_t
+scan_find_sse2(const uint8_t *data,
+               size_t         length)
+{
+    const __m128i zero   = _mm_setzero_si128();
+    const __m128i three  = _mm_set1_epi8(0x03);
+    __m128i       first;
+    __m128i       second;
+    __m128i       third;
+    __m128i       match;
+    size_t        offset = 0;
+    int           mask   = 0;
+
+    for (offset = 0; offset + 18 <= length; offset += 16)
+    {
+        first = _mm_loadu_si128((const __m128i *)(data + offset));
+        second = _mm_loadu_si128((const __m128i *)(data + offset + 1));
+        third = _mm_loadu_si128((const __m128i *)(data + offset + 2));
+        match = _mm_and_si128(_mm_cmpeq_epi8(first, zero),
+                _mm_cmpeq_epi8(second, zero));
+        match = _mm_and_si128(match,
+                _mm_cmpeq_epi8(_mm_min_epu8(third, three), third));
+        mask = _mm_movemask_epi8(match);
+        if (mask != 0)
+            return offset + __builtin_ctz((unsigned int)(mask));
+    }
+
+    return scan_find_scalar(data, offset, length);
+}
+#endif
+
+#ifdef SCAN_AVX2
+/* NOTE: as the SSE2 scan, 32 lanes at a time, the rest is handed down */
+static size_t
+scan_find_avx2(const uint8_t *data,
+               size_t         length)
+{
+    const __m256i zero   = _mm256_setzero_si256();
+    const __m256i three  = _mm256_set1_epi8(0x03);
+    __m256i       first;
+    __m256i       second;
+    __m256i       third;
+    __m256i       match;
+    size_t        offset = 0;
+    uint32_t      mask   = 0;
+
+    for (offset = 0; offset + 34 <= length; offset += 32)
+    {
+        first = _mm256_loadu_si256((const __m256i *)(data + offset));
+        second = _mm256_loadu_si256((const __m256i *)(data + offset + 1));
+        third = _mm256_loadu_si256((const __m256i *)(data + offset + 2));
+        match = _mm256_and_si256(_mm256_cmpeq_epi8(first, zero),
+                _mm256_cmpeq_epi8(second, zero));
+        match = _mm256_and_si256(match,
+                _mm256_cmpeq_epi8(_mm256_min_epu8(third, three), third));
+        mask = (uint32_t)(_mm256_movemask_epi8(match));
+        if (mask != 0)
+            return offset + __builtin_ctz(mask);
+    }
+
+#ifdef __SSE2__
+    return offset + scan_find_sse2(data + offset, length - offset);
+#else
+    return scan_find_scalar(data, offset, length);
+#endif
+}
+#endif
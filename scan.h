@@ -0,0 +1,31 @@
+/*
+ * Author: Pu-Chen Mao
+ * Date:   2026/10/15
+ * File:   scan.h
+ * Desc:   Vectorized start code and emulation prevention scanner
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /* Returns the offset of the first 00 00 0x with x <= 3 in data, or
+     * length if there is none. That covers start codes, emulation
+     * prevention sequences and the 00 00 00 and 00 00 02 a NALU may not
+     * hold. AVX2 is used when the CPU has it, then SSE2, then plain C */
+    size_t scan_find_emulation(const uint8_t *data, size_t length);
+    size_t scan_extract_rbsp(const uint8_t *nalu, size_t length,
+            uint8_t *rbsp, size_t capacity);
+    bool scan_validate_payload(const uint8_t *data, size_t length,
+            uint8_t *zeros);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,64 @@
+/*
+ * Author: Pu-Chen Mao
+ * Date:   2026/10/15
+ * File:   stats.c
+ * Desc:   RTP depacketizer statistics and latency histograms
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "stats.h"
+
+void
+rtp_histogram_record(rtp_histogram_t *histogram,
+                     gint64           latency_us)
+{
+    size_t bucket = 0;
+
+    g_return_if_fail(NULL != histogram);
+
+    if (latency_us > 1)
+        bucket = MIN((size_t)(63 - __builtin_clzll((guint64)(latency_us))),
+                (size_t)(RTP_STATS_HISTOGRAM_BUCKETS - 1));
+
+    ++(histogram->buckets[bucket]);
+    ++(histogram->count);
+    histogram->sum_us += MAX(latency_us, 0);
+    histogram->max_us = MAX(histogram->max_us, latency_us);
+}
+
+/* NOTE: the upper bound of the bucket holding the given percentile (0-100),
+ * so the result is within a factor of two of the exact value */
+gint64
+rtp_histogram_get_percentile(const rtp_histogram_t *histogram,
+                             double                 percentile)
+{
+    guint64 target = 0;
+    guint64 seen   = 0;
+    size_t  bucket = 0;
+
+    g_return_val_if_fail(NULL != histogram, 0);
+
+    if (histogram->count == 0)
+        return 0;
+
+    target = (guint64)(histogram->count * CLAMP(percentile, 0.0, 100.0) /
+            100.0);
+    for (bucket = 0; bucket < RTP_STATS_HISTOGRAM_BUCKETS; bucket++)
+    {
+        seen += histogram->buckets[bucket];
+        if (seen > target || seen == histogram->count)
+            break;
+    }
+
+    return MIN((gint64)(1) << (bucket + 1), histogram->max_us);
+}
+
+void
+rtp_stats_reset(rtp_stats_t *stats)
+{
+    g_return_if_fail(NULL != stats);
+
+    memset(stats, 0, sizeof(*stats));
+}
@@ -0,0 +1,61 @@
+/*
+ * Author: Pu-Chen Mao
+ * Date:   2026/10/15
+ * File:   stats.h
+ * Desc:   RTP depacketizer statistics and latency histograms
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    #define RTP_STATS_HISTOGRAM_BUCKETS 32
+
+    /* Bucket i counts latencies in [2^i, 2^(i+1)) microseconds, bucket 0
+     * also takes everything below 2us and the last everything above */
+    typedef struct rtp_histogram_t
+    {
+        guint64 buckets[RTP_STATS_HISTOGRAM_BUCKETS];
+        guint64 count;
+        gint64  sum_us;
+        gint64  max_us;
+
+    } rtp_histogram_t;
+
+    /* Plain counters, updated by the thread driving the depacketizer. lost
+     * follows RTCP's cumulative loss: sequence numbers skipped minus late
+     * arrivals filling them in, so duplicates can push it below zero */
+    typedef struct rtp_stats_t
+    {
+        guint64         packets;
+        guint64         bytes;
+        guint64         duplicates;
+        guint64         reordered;
+        guint64         max_reorder;
+        gint64          lost;
+        guint64         frames_completed;
+        guint64         frames_reaped;
+        guint64         frames_timed_out;
+        guint64         frames_rejected;
+        guint64         packets_filtered;
+        rtp_histogram_t assembly;
+        rtp_histogram_t delivery;
+
+    } rtp_stats_t;
+
+    void rtp_histogram_record(rtp_histogram_t *histogram, gint64 latency_us);
+    gint64 rtp_histogram_get_percentile(const rtp_histogram_t *histogram,
+            double percentile);
+    void rtp_stats_reset(rtp_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
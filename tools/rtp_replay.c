@@ -0,0 +1,418 @@
+/*
+ * Author: Pu-Chen Mao
+ * Date:   2026/10/15
+ * File:   tools/rtp_replay.c
+ * Desc:   Replays RTP from a pcap/pcapng capture and writes out the frames
+ */
+
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../capture.h"
+
+#define REPLAY_IVF_HEADER_SIZE 32
+#define REPLAY_IVF_CLOCK_RATE  90000
+
+typedef struct replay_config_t
+{
+    const char           *input;
+    const char           *output;
+    rtp_capture_filter_t  filter;
+    codec_t               codec;
+    gint64                timeout_us;
+    gint64                reap_us;
+    bool                  paced;
+
+} replay_config_t;
+
+/* One output file per SSRC, H.264 and H.265 as Annex B elementary
+ * streams, VP8 and VP9 in an IVF container on the 90 kHz RTP clock and
+ * Opus as frames each preceded by a 32-bit big-endian length. The IVF
+ * header is rewritten on close with the frame count and the first
+ * resolution seen */
+typedef struct replay_stream_t
+{
+    uint32_t     ssrc;
+    FILE        *file;
+    guint64      frames;
+    guint64      bytes;
+    const char  *fourcc;
+    uint16_t     width;
+    uint16_t     height;
+    uint32_t     rtptime;
+    guint64      pts;
+
+} replay_stream_t;
+
+typedef struct replay_t
+{
+    replay_config_t  config;
+    GHashTable      *streams;
+    media_t         *media;
+    bool             failed;
+
+} replay_t;
+
+static bool replay_parse_options(replay_config_t *config, int argc,
+        char **argv);
+static void replay_ready(uint32_t ssrc, rtp_depacketizer_t *depacketizer,
+        gpointer userdata);
+static replay_stream_t *replay_open_stream(replay_t *replay, uint32_t ssrc,
+        bool is_audio);
+static void replay_close_stream(gpointer data);
+static bool replay_write_frame(replay_stream_t *stream, const media_t *media);
+static bool replay_write_ivf_header(replay_stream_t *stream);
+static void replay_report(replay_t *replay, rtp_capture_t *capture,
+        rtp_demuxer_t *demuxer, gint64 elapsed_us);
+static void replay_usage(const char *name);
+
+int
+main(int    argc,
+     char **argv)
+{
+    replay_t       replay;
+    rtp_capture_t *capture = NULL;
+    rtp_demuxer_t *demuxer = NULL;
+    gint64         start   = 0;
+    int            status  = EXIT_FAILURE;
+
+    memset(&replay, 0, sizeof(replay));
+    if (!replay_parse_options(&(replay.config), argc, argv))
+    {
+        replay_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    capture = rtp_capture_open(replay.config.input);
+    if (!capture)
+        goto RETURN;
+    rtp_capture_set_filter(capture, &(replay.config.filter));
+
+    /* Streams outlive the whole replay, frames are reaped on capture time
+     * so that replaying faster than real time does not change the output */
+    demuxer = rtp_demuxer_create(replay.config.codec,
+            replay.config.timeout_us, replay.config.reap_us, G_MAXINT64);
+    if (demuxer)
+        rtp_demuxer_set_clock(demuxer, rtp_capture_clock, capture);
+    replay.media = media_create(PREFIX_ANNEXB);
+    replay.streams = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+            NULL, replay_close_stream);
+    if (!demuxer || !replay.media || !replay.streams)
+        goto RETURN;
+
+    if (replay.config.output && g_mkdir_with_parents(replay.config.output,
+                0755) != 0)
+    {
+        fprintf(stderr, "Failed to create [%s]\n", replay.config.output);
+        goto RETURN;
+    }
+
+    start = g_get_monotonic_time();
+    if (!rtp_capture_replay(capture, demuxer, replay.config.paced,
+                replay_ready, &replay))
+        fprintf(stderr, "Some packets were rejected\n");
+    /* Frames still pending at the end of the capture go out incomplete */
+    rtp_demuxer_flush(demuxer, replay_ready, &replay);
+    replay_report(&replay, capture, demuxer, g_get_monotonic_time() - start);
+
+    if (!replay.failed)
+        status = EXIT_SUCCESS;
+
+RETURN:
+
+    if (replay.streams)
+        g_hash_table_destroy(replay.streams);
+    g_clear_pointer(&(replay.media), media_destroy);
+    g_clear_pointer(&demuxer, rtp_demuxer_destroy);
+    g_clear_pointer(&capture, rtp_capture_close);
+
+    return status;
+}
+
+static bool
+replay_parse_options(replay_config_t  *config,
+                     int               argc,
+                     char            **argv)
+{
+    static const struct option options[] =
+    {
+        {"port",       required_argument, NULL, 'p'},
+        {"ssrc",       required_argument, NULL, 's'},
+        {"pt",         required_argument, NULL, 'y'},
+        {"codec",      required_argument, NULL, 'c'},
+        {"output",     required_argument, NULL, 'o'},
+        {"timeout-us", required_argument, NULL, 't'},
+        {"reap-us",    required_argument, NULL, 'a'},
+        {"paced",      no_argument,       NULL, 'P'},
+        {"help",       no_argument,       NULL, 'h'},
+        {NULL,         0,                 NULL, 0},
+    };
+    int option = 0;
+
+    config->filter.port = RTP_CAPTURE_ANY;
+    config->filter.ssrc = RTP_CAPTURE_ANY;
+    config->filter.payload_type = RTP_CAPTURE_ANY;
+    config->codec = CODEC_H264;
+    config->timeout_us = 1000000;
+    config->reap_us = 100000;
+
+    while ((option = getopt_long(argc, argv, "h", options, NULL)) != -1)
+    {
+        switch (option)
+        {
+            case 'p': config->filter.port = strtol(optarg, NULL, 0); break;
+            case 's': config->filter.ssrc = strtoll(optarg, NULL, 0); break;
+            case 'y':
+                config->filter.payload_type = strtol(optarg, NULL, 0);
+                break;
+            case 'c':
+                if (!strcmp(optarg, "h264"))
+                    config->codec = CODEC_H264;
+                else if (!strcmp(optarg, "h265"))
+                    config->codec = CODEC_H265;
+                else if (!strcmp(optarg, "vp8"))
+                    config->codec = CODEC_VP8;
+                else if (!strcmp(optarg, "vp9"))
+                    config->codec = CODEC_VP9;
+                else if (!strcmp(optarg, "opus"))
+                    config->codec = CODEC_OPUS;
+                else
+                    return false;
+                break;
+            case 'o': config->output = optarg; break;
+            case 't': config->timeout_us = strtoll(optarg, NULL, 0); break;
+            case 'a': config->reap_us = strtoll(optarg, NULL, 0); break;
+            case 'P': config->paced = true; break;
+            default: return false;
+        }
+    }
+
+    if (optind != argc - 1)
+        return false;
+    config->input = argv[optind];
+
+    return config->filter.port >= RTP_CAPTURE_ANY &&
+        config->filter.port <= G_MAXUINT16 &&
+        config->filter.ssrc >= RTP_CAPTURE_ANY &&
+        config->filter.ssrc <= G_MAXUINT32 &&
+        config->filter.payload_type >= RTP_CAPTURE_ANY &&
+        config->filter.payload_type <= 127;
+}
+
+static void
+replay_ready(uint32_t            ssrc,
+             rtp_depacketizer_t *depacketizer,
+             gpointer            userdata)
+{
+    replay_t        *replay = NULL;
+    replay_stream_t *stream = NULL;
+    media_t         *media  = NULL;
+
+    replay = (replay_t *)(userdata);
+    media = replay->media;
+    while (depacketizer->completed->len > 0)
+    {
+        media->length = media->capacity;
+        if (!rtp_depacketizer_get_frame(depacketizer, media))
+        {
+            if (media->length > media->capacity &&
+                media_reserve(media, media->length))
+                continue;
+            break;
+        }
+
+        stream = replay_open_stream(replay, ssrc, media->is_audio);
+        if (!stream)
+            continue;
+
+        if (!replay_write_frame(stream, media))
+        {
+            fprintf(stderr, "Failed to write frame of [%08x]\n", ssrc);
+            replay->failed = true;
+        }
+    }
+}
+
+static replay_stream_t *
+replay_open_stream(replay_t *replay,
+                   uint32_t  ssrc,
+                   bool      is_audio)
+{
+    replay_stream_t *stream = NULL;
+    char            *path   = NULL;
+    char             name[32];
+
+    stream = g_hash_table_lookup(replay->streams, GUINT_TO_POINTER(ssrc));
+    if (stream)
+        return stream;
+
+    stream = g_new0(replay_stream_t, 1);
+    stream->ssrc = ssrc;
+    g_hash_table_insert(replay->streams, GUINT_TO_POINTER(ssrc), stream);
+    if (!replay->config.output)
+        return stream;
+
+    if (!is_audio && replay->config.codec == CODEC_VP8)
+        stream->fourcc = "VP80";
+    else if (!is_audio && replay->config.codec == CODEC_VP9)
+        stream->fourcc = "VP90";
+
+    /* Video payload types are not mapped, they all take --codec */
+    snprintf(name, sizeof(name), "%08x.%s", ssrc, is_audio ? "opus" :
+            (replay->config.codec == CODEC_H265) ? "h265" :
+            (replay->config.codec == CODEC_VP8) ? "vp8" :
+            (replay->config.codec == CODEC_VP9) ? "vp9" : "h264");
+    path = g_build_filename(replay->config.output, name, NULL);
+    stream->file = fopen(path, "wb");
+    if (!stream->file ||
+        (stream->fourcc && !replay_write_ivf_header(stream)))
+    {
+        fprintf(stderr, "Failed to open [%s]\n", path);
+        replay->failed = true;
+    }
+    g_free(path);
+
+    return stream;
+}
+
+static void
+replay_close_stream(gpointer data)
+{
+    replay_stream_t *stream = NULL;
+
+    stream = (replay_stream_t *)(data);
+    if (stream->file && stream->fourcc &&
+        (fseek(stream->file, 0, SEEK_SET) != 0 ||
+         !replay_write_ivf_header(stream)))
+        fprintf(stderr, "Failed to finish IVF of [%08x]\n", stream->ssrc);
+    if (stream->file)
+        fclose(stream->file);
+    g_free(stream);
+}
+
+/* NOTE: counts the frame even when there is no file to write it to */
+static bool
+replay_write_frame(replay_stream_t *stream,
+                   const media_t   *media)
+{
+    uint8_t  header[12];
+    uint32_t length = 0;
+    guint64  pts    = 0;
+
+    ++(stream->frames);
+    stream->bytes += media->length;
+    if (!stream->file)
+        return true;
+
+    if (media->is_audio)
+    {
+        length = htonl(media->length);
+        if (fwrite(&length, sizeof(length), 1, stream->file) != 1)
+            return false;
+    }
+    else if (stream->fourcc)
+    {
+        /* The RTP timestamp extended across wraps, from the first frame */
+        if (stream->frames > 1)
+            stream->pts += (uint32_t)(media->rtptime - stream->rtptime);
+        stream->rtptime = media->rtptime;
+        if (!stream->width)
+        {
+            stream->width = (stream->fourcc[2] == '8') ?
+                media->context.vp8.width : media->context.vp9.width;
+            stream->height = (stream->fourcc[2] == '8') ?
+                media->context.vp8.height : media->context.vp9.height;
+        }
+
+        length = GUINT32_TO_LE((uint32_t)(media->length));
+        pts = GUINT64_TO_LE(stream->pts);
+        memcpy(header, &length, sizeof(length));
+        memcpy(header + 4, &pts, sizeof(pts));
+        if (fwrite(header, 1, sizeof(header), stream->file) != sizeof(header))
+            return false;
+    }
+
+    return fwrite(media->buffer, 1, media->length, stream->file) ==
+        media->length;
+}
+
+/* NOTE: the 32-byte IVF file header, all fields little-endian */
+static bool
+replay_write_ivf_header(replay_stream_t *stream)
+{
+    uint8_t  header[REPLAY_IVF_HEADER_SIZE];
+    uint16_t value16 = 0;
+    uint32_t value32 = 0;
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, "DKIF", 4);
+    value16 = GUINT16_TO_LE(REPLAY_IVF_HEADER_SIZE);
+    memcpy(header + 6, &value16, sizeof(value16));
+    memcpy(header + 8, stream->fourcc, 4);
+    value16 = GUINT16_TO_LE(stream->width);
+    memcpy(header + 12, &value16, sizeof(value16));
+    value16 = GUINT16_TO_LE(stream->height);
+    memcpy(header + 14, &value16, sizeof(value16));
+    value32 = GUINT32_TO_LE(REPLAY_IVF_CLOCK_RATE);
+    memcpy(header + 16, &value32, sizeof(value32));
+    value32 = GUINT32_TO_LE(1);
+    memcpy(header + 20, &value32, sizeof(value32));
+    value32 = GUINT32_TO_LE((uint32_t)(MIN(stream->frames, G_MAXUINT32)));
+    memcpy(header + 24, &value32, sizeof(value32));
+
+    return fwrite(header, 1, sizeof(header), stream->file) == sizeof(header);
+}
+
+static void
+replay_report(replay_t      *replay,
+              rtp_capture_t *capture,
+              rtp_demuxer_t *demuxer,
+              gint64         elapsed_us)
+{
+    replay_stream_t *stream = NULL;
+    rtp_stats_t      stats;
+    size_t           idx    = 0;
+
+    printf("records %" G_GUINT64_FORMAT ", rtp packets %" G_GUINT64_FORMAT
+           ", %" G_GINT64_FORMAT " us\n", capture->records, capture->matched,
+           elapsed_us);
+
+    for (idx = 0; idx < demuxer->capacity; idx++)
+    {
+        if (!demuxer->streams[idx].depacketizer)
+            continue;
+
+        rtp_depacketizer_get_stats(demuxer->streams[idx].depacketizer,
+                &stats);
+        stream = g_hash_table_lookup(replay->streams,
+                GUINT_TO_POINTER(demuxer->streams[idx].ssrc));
+        printf("  ssrc %08x: packets %" G_GUINT64_FORMAT ", lost %"
+               G_GINT64_FORMAT ", duplicates %" G_GUINT64_FORMAT
+               ", frames %" G_GUINT64_FORMAT " (%" G_GUINT64_FORMAT
+               " bytes), timed out %" G_GUINT64_FORMAT ", rejected %"
+               G_GUINT64_FORMAT "\n", demuxer->streams[idx].ssrc,
+               stats.packets, stats.lost, stats.duplicates,
+               stream ? stream->frames : 0, stream ? stream->bytes : 0,
+               stats.frames_timed_out, stats.frames_rejected);
+    }
+}
+
+static void
+replay_usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [options] CAPTURE\n"
+            "  --port N                keep UDP packets to or from port N\n"
+            "  --ssrc N                keep RTP packets of SSRC N\n"
+            "  --pt N                  keep RTP packets of payload type N\n"
+            "  --codec NAME            codec of unmapped payload types,\n"
+            "                          h264, h265, vp8, vp9 or opus (h264)\n"
+            "  --output DIR            write frames to DIR/<ssrc>.<codec>\n"
+            "  --timeout-us N          depacketizer drop timeout (1000000)\n"
+            "  --reap-us N             depacketizer reap timeout (100000)\n"
+            "  --paced                 replay at the capture's timestamps\n",
+            name);
+}
@@ -0,0 +1,334 @@
+/*
+ * Author: Pu-Chen Mao
+ * Date:   2026/10/15
+ * File:   vp8.c
+ * Desc:   VP8 RTP (RFC 7741) frame reassembly
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#include "format.h"
+#include "media.h"
+#include "vp8.h"
+
+#define INLINE inline
+
+#define VP8_FRAME_TAG_SIZE    3
+#define VP8_KEY_FRAME_SIZE    10
+
+static INLINE size_t vp8_parse_descriptor(const uint8_t *payload,
+        size_t size, vp8_context_t *context);
+static INLINE void vp8_decode_context(const uint8_t *payload, size_t size,
+        vp8_context_t *context);
+static INLINE bool vp8_decode_frame_header(const uint8_t *frameptr,
+        size_t framelen, vp8_context_t *context);
+
+/* NOTE: the payload descriptor is dropped, what is left of each packet is
+ * VP8 frame data as is. VP8 has no prefixes, prefix is ignored */
+bool
+vp8_reassemble_frame(uint8_t       **index,
+                     size_t         *length,
+                     const uint8_t  *limit,
+                     prefix_t        prefix,
+                     const uint8_t  *payload,
+                     size_t          size,
+                     bool            completed,
+                     void           *data)
+{
+    vp8_context_t *context = NULL;
+    size_t         hdrlen  = 0;
+
+    g_return_val_if_fail(NULL != index, false);
+    g_return_val_if_fail(NULL != *index, false);
+    g_return_val_if_fail(NULL != length, false);
+    g_return_val_if_fail(NULL != limit, false);
+    g_return_val_if_fail(NULL != payload, false);
+    g_return_val_if_fail(NULL != data, false);
+    g_return_val_if_fail(1 <= size, false);
+
+    context = (vp8_context_t *)(data);
+    hdrlen = vp8_parse_descriptor(payload, size, NULL);
+    if (hdrlen == 0)
+        return false;
+
+    vp8_decode_context(payload, size, context);
+    g_return_val_if_fail(*index + (size - hdrlen) <= limit, false);
+    memcpy(*index, payload + hdrlen, size - hdrlen);
+    *index += size - hdrlen;
+    *length += size - hdrlen;
+
+    return true;
+}
+
+/* NOTE: partitions delimit nothing a frame needs to be complete, that is
+ * up to the S bit of its first packet and the marker bit of its last */
+bool
+vp8_is_fragmented(const uint8_t *payload,
+                  size_t         size)
+{
+    g_return_val_if_fail(NULL != payload, false);
+    g_return_val_if_fail(1 <= size, false);
+
+    return false;
+}
+
+/* NOTE: 1 for a key frame, 0 for an interframe, from the frame tag at the
+ * head of the reassembled frame */
+uint8_t
+vp8_get_frame_type(const uint8_t *frameptr,
+                   size_t         framelen)
+{
+    g_return_val_if_fail(NULL != frameptr, 0);
+    g_return_val_if_fail(VP8_FRAME_TAG_SIZE <= framelen, 0);
+
+    return !(frameptr[0] & 0x01);
+}
+
+bool
+vp8_is_first_packet(const uint8_t *payload,
+                    size_t         size)
+{
+    const vp8_descriptor_header_t *header = NULL;
+
+    g_return_val_if_fail(NULL != payload, false);
+    g_return_val_if_fail(1 <= size, false);
+
+    header = (const vp8_descriptor_header_t *)(payload);
+
+    return header->start && header->partition_id == 0;
+}
+
+/* NOTE: the end of a frame is only told by the RTP marker bit, which
+ * frame.c takes into account on its own */
+bool
+vp8_is_last_packet(const uint8_t *payload,
+                   size_t         size)
+{
+    g_return_val_if_fail(NULL != payload, false);
+    g_return_val_if_fail(1 <= size, false);
+
+    return false;
+}
+
+size_t
+vp8_measure_packet(const uint8_t *payload,
+                   size_t         size,
+                   prefix_t       prefix)
+{
+    size_t hdrlen = 0;
+
+    g_return_val_if_fail(NULL != payload, 0);
+    g_return_val_if_fail(1 <= size, 0);
+
+    hdrlen = vp8_parse_descriptor(payload, size, NULL);
+
+    return (hdrlen == 0) ? 0 : size - hdrlen;
+}
+
+/* NOTE: a VP8 frame has nothing to flag it corrupt, decoders find out on
+ * their own from the truncated partitions */
+void
+vp8_conceal_frame(uint8_t *output,
+                  size_t   length,
+                  bool     closing,
+                  void    *data)
+{
+    g_return_if_fail(NULL != output);
+}
+
+bool
+vp8_scatter_frame(media_vector_t *vector,
+                  prefix_t        prefix,
+                  const uint8_t  *payload,
+                  size_t          size,
+                  bool            completed,
+                  void           *data)
+{
+    vp8_context_t *context = NULL;
+    size_t         hdrlen  = 0;
+
+    g_return_val_if_fail(NULL != vector, false);
+    g_return_val_if_fail(NULL != payload, false);
+    g_return_val_if_fail(NULL != data, false);
+    g_return_val_if_fail(1 <= size, false);
+
+    context = (vp8_context_t *)(data);
+    hdrlen = vp8_parse_descriptor(payload, size, NULL);
+    if (hdrlen == 0)
+        return false;
+
+    vp8_decode_context(payload, size, context);
+    if (hdrlen == size)
+        return true;
+
+    return media_vector_append(vector, payload + hdrlen, size - hdrlen);
+}
+
+/* NOTE: the descriptor and frame tag are the frame's, the dimensions only
+ * when it is a key frame, else those of data stand, as a key frame taken
+ * after the frame was created may have changed them */
+void
+vp8_merge_context(void       *data,
+                  const void *frame)
+{
+    vp8_context_t       *context = NULL;
+    const vp8_context_t *decoded = NULL;
+    vp8_context_t        merged;
+
+    g_return_if_fail(NULL != data);
+    g_return_if_fail(NULL != frame);
+
+    context = (vp8_context_t *)(data);
+    decoded = (const vp8_context_t *)(frame);
+
+    merged = *decoded;
+    if (!decoded->key_frame)
+    {
+        merged.width = context->width;
+        merged.horizontal_scale = context->horizontal_scale;
+        merged.height = context->height;
+        merged.vertical_scale = context->vertical_scale;
+    }
+    *context = merged;
+}
+
+/* NOTE: returns the size of the payload descriptor, or 0 when the payload
+ * is too short to hold it. The fields go to context unless it is NULL */
+static INLINE size_t
+vp8_parse_descriptor(const uint8_t *payload,
+                     size_t         size,
+                     vp8_context_t *context)
+{
+    const vp8_descriptor_header_t    *header    = NULL;
+    const vp8_descriptor_extension_t *extension = NULL;
+    vp8_context_t                     decoded;
+    size_t                            hdrlen    = 0;
+
+    g_return_val_if_fail(NULL != payload, 0);
+    g_return_val_if_fail(1 <= size, 0);
+
+    memset(&decoded, 0, sizeof(decoded));
+    header = (const vp8_descriptor_header_t *)(payload);
+    decoded.non_reference = header->non_reference;
+    hdrlen = 1;
+    if (!header->extended)
+        goto RETURN;
+
+    if (size < hdrlen + 1)
+        return 0;
+    extension = (const vp8_descriptor_extension_t *)(payload + hdrlen++);
+    if (extension->picture_id)
+    {
+        if (size < hdrlen + 1)
+            return 0;
+        decoded.has_picture_id = true;
+        decoded.picture_id = payload[hdrlen++] & 0x7F;
+        /* M set, the PictureID is 15 bits */
+        if (payload[hdrlen - 1] & 0x80)
+        {
+            if (size < hdrlen + 1)
+                return 0;
+            decoded.picture_id = (decoded.picture_id << 8) |
+                payload[hdrlen++];
+        }
+    }
+    if (extension->tl0picidx)
+    {
+        if (size < hdrlen + 1)
+            return 0;
+        decoded.has_tl0picidx = true;
+        decoded.tl0picidx = payload[hdrlen++];
+    }
+    if (extension->tid || extension->keyidx)
+    {
+        if (size < hdrlen + 1)
+            return 0;
+        decoded.has_tid = extension->tid;
+        decoded.tid = (payload[hdrlen] >> 6) & 0x03;
+        decoded.layer_sync = (payload[hdrlen] >> 5) & 0x01;
+        decoded.has_keyidx = extension->keyidx;
+        decoded.keyidx = payload[hdrlen++] & 0x1F;
+    }
+
+RETURN:
+
+    if (context)
+    {
+        context->non_reference = decoded.non_reference;
+        context->has_picture_id = decoded.has_picture_id;
+        context->picture_id = decoded.picture_id;
+        context->has_tl0picidx = decoded.has_tl0picidx;
+        context->tl0picidx = decoded.tl0picidx;
+        context->has_tid = decoded.has_tid;
+        context->tid = decoded.tid;
+        context->layer_sync = decoded.layer_sync;
+        context->has_keyidx = decoded.has_keyidx;
+        context->keyidx = decoded.keyidx;
+    }
+
+    return hdrlen;
+}
+
+/* NOTE: only the packet starting the frame carries its payload header, the
+ * context takes the descriptor and frame header of that packet. A frame
+ * header that does not decode leaves the frame fields as they were */
+static INLINE void
+vp8_decode_context(const uint8_t *payload,
+                   size_t         size,
+                   vp8_context_t *context)
+{
+    vp8_context_t decoded;
+    size_t        hdrlen  = 0;
+
+    g_return_if_fail(NULL != payload);
+    g_return_if_fail(NULL != context);
+
+    if (!vp8_is_first_packet(payload, size))
+        return;
+
+    decoded = *context;
+    hdrlen = vp8_parse_descriptor(payload, size, &decoded);
+    if (hdrlen == 0)
+        return;
+    if (vp8_decode_frame_header(payload + hdrlen, size - hdrlen, &decoded))
+        *context = decoded;
+    else
+        vp8_parse_descriptor(payload, size, context);
+}
+
+/* NOTE: the frame tag and, for key frames, the start code and dimensions
+ * of RFC 6386 9.1, which must lie in the first packet of the frame */
+static INLINE bool
+vp8_decode_frame_header(const uint8_t *frameptr,
+                        size_t         framelen,
+                        vp8_context_t *context)
+{
+    static const uint8_t start_code[] = {0x9D, 0x01, 0x2A};
+    uint32_t             tag          = 0;
+
+    g_return_val_if_fail(NULL != frameptr, false);
+    g_return_val_if_fail(NULL != context, false);
+
+    if (framelen < VP8_FRAME_TAG_SIZE)
+        return false;
+
+    tag = frameptr[0] | (frameptr[1] << 8) | (frameptr[2] << 16);
+    context->key_frame = !(tag & 0x01);
+    context->version = (tag >> 1) & 0x07;
+    context->show_frame = (tag >> 4) & 0x01;
+    context->first_part_size = (tag >> 5) & 0x7FFFF;
+    if (!context->key_frame)
+        return true;
+
+    if (framelen < VP8_KEY_FRAME_SIZE ||
+        memcmp(frameptr + VP8_FRAME_TAG_SIZE, start_code, sizeof(start_code)))
+        return false;
+
+    context->width = (frameptr[6] | (frameptr[7] << 8)) & 0x3FFF;
+    context->horizontal_scale = frameptr[7] >> 6;
+    context->height = (frameptr[8] | (frameptr[9] << 8)) & 0x3FFF;
+    context->vertical_scale = frameptr[9] >> 6;
+
+    return context->width > 0 && context->height > 0;
+}
@@ -0,0 +1,98 @@
+/*
+ * Author: Pu-Chen Mao
+ * Date:   2026/10/15
+ * File:   vp8.h
+ * Desc:   VP8 RTP (RFC 7741) frame reassembly
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /* First octet of the payload descriptor, X|R|N|S|R|PID */
+    typedef struct vp8_descriptor_header_t
+    {
+        #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        uint8_t partition_id:  3;
+        uint8_t reserved0:     1;
+        uint8_t start:         1;
+        uint8_t non_reference: 1;
+        uint8_t reserved1:     1;
+        uint8_t extended:      1;
+        #else
+            #error "little-endian only"
+        #endif
+
+    } __attribute__ ((__packed__)) vp8_descriptor_header_t;
+
+    /* Extension octet present when X is set, I|L|T|K|RSV */
+    typedef struct vp8_descriptor_extension_t
+    {
+        #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        uint8_t reserved:   4;
+        uint8_t keyidx:     1;
+        uint8_t tid:        1;
+        uint8_t tl0picidx:  1;
+        uint8_t picture_id: 1;
+        #else
+            #error "little-endian only"
+        #endif
+
+    } __attribute__ ((__packed__)) vp8_descriptor_extension_t;
+
+    typedef struct vp8_context_t
+    {
+        /* VP8 Payload Descriptor, of the packet that starts the frame */
+        bool     non_reference;
+        bool     has_picture_id;
+        uint16_t picture_id;        // 7 or 15 bits
+        bool     has_tl0picidx;
+        uint8_t  tl0picidx;
+        bool     has_tid;
+        uint8_t  tid;
+        bool     layer_sync;
+        bool     has_keyidx;
+        uint8_t  keyidx;
+
+        /* VP8 Frame Tag (RFC 6386 9.1) */
+        bool     key_frame;
+        uint8_t  version;
+        bool     show_frame;
+        uint32_t first_part_size;
+
+        /* VP8 Key Frame Header, kept across interframes */
+        uint16_t width;
+        uint8_t  horizontal_scale;
+        uint16_t height;
+        uint8_t  vertical_scale;
+
+    } vp8_context_t;
+
+    typedef enum prefix_t prefix_t;
+    typedef struct media_vector_t media_vector_t;
+
+    bool vp8_reassemble_frame(uint8_t **index, size_t *length,
+            const uint8_t *limit, prefix_t prefix, const uint8_t *payload,
+            size_t size, bool completed, void *data);
+    bool vp8_is_fragmented(const uint8_t *payload, size_t size);
+    uint8_t vp8_get_frame_type(const uint8_t *frameptr, size_t framelen);
+    bool vp8_is_first_packet(const uint8_t *payload, size_t size);
+    bool vp8_is_last_packet(const uint8_t *payload, size_t size);
+    size_t vp8_measure_packet(const uint8_t *payload, size_t size,
+            prefix_t prefix);
+    void vp8_conceal_frame(uint8_t *output, size_t length, bool closing,
+            void *data);
+    bool vp8_scatter_frame(media_vector_t *vector, prefix_t prefix,
+            const uint8_t *payload, size_t size, bool completed,
+            void *data);
+    void vp8_merge_context(void *data, const void *frame);
+
+#ifdef __cplusplus
+}
+#endif
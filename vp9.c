@@ -0,0 +1,447 @@
+/*
+ * Author: Pu-Chen Mao
+ * Date:   2026/10/15
+ * File:   vp9.c
+ * Desc:   VP9 RTP (RFC 9628) frame reassembly
+ */
+
+#include <glib.h>
+#include <string.h>
+
+#include "format.h"
+#include "media.h"
+#include "vp9.h"
+
+#define INLINE inline
+
+#define VP9_MAX_P_DIFF 3
+
+static INLINE size_t vp9_parse_descriptor(const uint8_t *payload,
+        size_t size, vp9_context_t *context);
+static INLINE size_t vp9_parse_scalability_structure(const uint8_t *ssptr,
+        size_t sslen, vp9_context_t *context);
+static INLINE bool vp9_decode_context(const uint8_t *payload, size_t size,
+        vp9_context_t *context);
+
+/* NOTE: the payload descriptor is dropped and the layer frames of the
+ * picture are appended in order, without a superframe index. With every
+ * spatial layer but one filtered out that is a plain VP9 frame. VP9 has
+ * no prefixes, prefix is ignored */
+bool
+vp9_reassemble_frame(uint8_t       **index,
+                     size_t         *length,
+                     const uint8_t  *limit,
+                     prefix_t        prefix,
+                     const uint8_t  *payload,
+                     size_t          size,
+                     bool            completed,
+                     void           *data)
+{
+    vp9_context_t *context = NULL;
+    size_t         hdrlen  = 0;
+
+    g_return_val_if_fail(NULL != index, false);
+    g_return_val_if_fail(NULL != *index, false);
+    g_return_val_if_fail(NULL != length, false);
+    g_return_val_if_fail(NULL != limit, false);
+    g_return_val_if_fail(NULL != payload, false);
+    g_return_val_if_fail(NULL != data, false);
+    g_return_val_if_fail(1 <= size, false);
+
+    context = (vp9_context_t *)(data);
+    hdrlen = vp9_parse_descriptor(payload, size, NULL);
+    if (hdrlen == 0 || !vp9_decode_context(payload, size, context))
+        return false;
+
+    g_return_val_if_fail(*index + (size - hdrlen) <= limit, false);
+    memcpy(*index, payload + hdrlen, size - hdrlen);
+    *index += size - hdrlen;
+    *length += size - hdrlen;
+
+    return true;
+}
+
+bool
+vp9_is_fragmented(const uint8_t *payload,
+                  size_t         size)
+{
+    const vp9_descriptor_header_t *header = NULL;
+
+    g_return_val_if_fail(NULL != payload, false);
+    g_return_val_if_fail(1 <= size, false);
+
+    header = (const vp9_descriptor_header_t *)(payload);
+
+    return !header->begin || !header->end;
+}
+
+/* NOTE: 1 for a key frame, 0 otherwise, from the uncompressed header of
+ * the first layer frame at the head of the reassembled picture */
+uint8_t
+vp9_get_frame_type(const uint8_t *frameptr,
+                   size_t         framelen)
+{
+    uint8_t header  = 0;
+    uint8_t profile = 0;
+    uint8_t shift   = 0;
+
+    g_return_val_if_fail(NULL != frameptr, 0);
+    g_return_val_if_fail(1 <= framelen, 0);
+
+    /* frame_marker, profile_low_bit, profile_high_bit, reserved_zero for
+     * profile 3, show_existing_frame and frame_type, all in one octet */
+    header = frameptr[0];
+    if ((header >> 6) != 0x02)
+        return 0;
+    profile = ((header >> 5) & 0x01) | (((header >> 4) & 0x01) << 1);
+    shift = (profile == 3) ? 2 : 3;
+    if ((header >> shift) & 0x01)
+        return 0;
+
+    return !((header >> (shift - 1)) & 0x01);
+}
+
+/* NOTE: a picture starts with the first packet of its lowest spatial
+ * layer, which is never filtered out */
+bool
+vp9_is_first_packet(const uint8_t *payload,
+                    size_t         size)
+{
+    const vp9_descriptor_header_t *header = NULL;
+    uint8_t                        sid    = 0;
+    uint8_t                        tid    = 0;
+    bool                           end    = false;
+
+    g_return_val_if_fail(NULL != payload, false);
+    g_return_val_if_fail(1 <= size, false);
+
+    header = (const vp9_descriptor_header_t *)(payload);
+    if (!header->begin || !vp9_get_layer_ids(payload, size, &sid, &tid, &end))
+        return false;
+
+    return sid == 0;
+}
+
+/* NOTE: E only ends the picture when it has a single spatial layer, past
+ * that it is up to the RTP marker bit, or to the depacketizer once upper
+ * spatial layers are filtered out */
+bool
+vp9_is_last_packet(const uint8_t *payload,
+                   size_t         size)
+{
+    const vp9_descriptor_header_t *header = NULL;
+
+    g_return_val_if_fail(NULL != payload, false);
+    g_return_val_if_fail(1 <= size, false);
+
+    header = (const vp9_descriptor_header_t *)(payload);
+
+    return header->end && !header->layer_indices;
+}
+
+size_t
+vp9_measure_packet(const uint8_t *payload,
+                   size_t         size,
+                   prefix_t       prefix)
+{
+    size_t hdrlen = 0;
+
+    g_return_val_if_fail(NULL != payload, 0);
+    g_return_val_if_fail(1 <= size, 0);
+
+    hdrlen = vp9_parse_descriptor(payload, size, NULL);
+
+    return (hdrlen == 0) ? 0 : size - hdrlen;
+}
+
+/* NOTE: as for VP8, nothing in a VP9 frame can flag it corrupt */
+void
+vp9_conceal_frame(uint8_t *output,
+                  size_t   length,
+                  bool     closing,
+                  void    *data)
+{
+    g_return_if_fail(NULL != output);
+}
+
+bool
+vp9_scatter_frame(media_vector_t *vector,
+                  prefix_t        prefix,
+                  const uint8_t  *payload,
+                  size_t          size,
+                  bool            completed,
+                  void           *data)
+{
+    vp9_context_t *context = NULL;
+    size_t         hdrlen  = 0;
+
+    g_return_val_if_fail(NULL != vector, false);
+    g_return_val_if_fail(NULL != payload, false);
+    g_return_val_if_fail(NULL != data, false);
+    g_return_val_if_fail(1 <= size, false);
+
+    context = (vp9_context_t *)(data);
+    hdrlen = vp9_parse_descriptor(payload, size, NULL);
+    if (hdrlen == 0 || !vp9_decode_context(payload, size, context))
+        return false;
+
+    if (hdrlen == size)
+        return true;
+
+    return media_vector_append(vector, payload + hdrlen, size - hdrlen);
+}
+
+/* NOTE: the descriptor is the frame's, the scalability structure only when
+ * the picture carried one, else that of data stands, as a picture taken
+ * after the frame was created may have replaced it */
+void
+vp9_merge_context(void       *data,
+                  const void *frame)
+{
+    vp9_context_t       *context = NULL;
+    const vp9_context_t *decoded = NULL;
+    vp9_context_t        merged;
+
+    g_return_if_fail(NULL != data);
+    g_return_if_fail(NULL != frame);
+
+    context = (vp9_context_t *)(data);
+    decoded = (const vp9_context_t *)(frame);
+
+    merged = *decoded;
+    if (!decoded->picture_has_structure)
+    {
+        merged.has_scalability_structure = context->has_scalability_structure;
+        merged.num_spatial_layers = context->num_spatial_layers;
+        merged.has_resolutions = context->has_resolutions;
+        memcpy(merged.layer_width, context->layer_width,
+                sizeof(merged.layer_width));
+        memcpy(merged.layer_height, context->layer_height,
+                sizeof(merged.layer_height));
+        merged.num_pictures_in_group = context->num_pictures_in_group;
+        merged.width = context->width;
+        merged.height = context->height;
+        if (merged.has_resolutions &&
+            merged.spatial_id < merged.num_spatial_layers)
+        {
+            merged.width = merged.layer_width[merged.spatial_id];
+            merged.height = merged.layer_height[merged.spatial_id];
+        }
+    }
+    *context = merged;
+}
+
+/* NOTE: reads the layer indices alone, for filtering packets before they
+ * reach a frame. A descriptor without them is layer 0 of both, *end is
+ * the E bit */
+bool
+vp9_get_layer_ids(const uint8_t *payload,
+                  size_t         size,
+                  uint8_t       *spatial_id,
+                  uint8_t       *temporal_id,
+                  bool          *end)
+{
+    const vp9_descriptor_header_t *header = NULL;
+    size_t                         offset = 1;
+
+    g_return_val_if_fail(NULL != payload, false);
+    g_return_val_if_fail(NULL != spatial_id, false);
+    g_return_val_if_fail(NULL != temporal_id, false);
+    g_return_val_if_fail(NULL != end, false);
+    g_return_val_if_fail(1 <= size, false);
+
+    header = (const vp9_descriptor_header_t *)(payload);
+    *spatial_id = 0;
+    *temporal_id = 0;
+    *end = header->end;
+    if (!header->layer_indices)
+        return true;
+
+    if (header->picture_id)
+    {
+        if (size < offset + 1)
+            return false;
+        offset += (payload[offset] & 0x80) ? 2 : 1;
+    }
+    if (size < offset + 1)
+        return false;
+    *temporal_id = payload[offset] >> 5;
+    *spatial_id = (payload[offset] >> 1) & 0x07;
+
+    return true;
+}
+
+/* NOTE: returns the size of the payload descriptor, or 0 when the payload
+ * is too short to hold it. The fields go to context unless it is NULL, in
+ * which case the scalability structure is only stepped over */
+static INLINE size_t
+vp9_parse_descriptor(const uint8_t *payload,
+                     size_t         size,
+                     vp9_context_t *context)
+{
+    const vp9_descriptor_header_t *header = NULL;
+    vp9_context_t                  decoded;
+    size_t                         hdrlen = 0;
+    size_t                         sslen  = 0;
+
+    g_return_val_if_fail(NULL != payload, 0);
+    g_return_val_if_fail(1 <= size, 0);
+
+    if (context)
+        decoded = *context;
+    else
+        memset(&decoded, 0, sizeof(decoded));
+    header = (const vp9_descriptor_header_t *)(payload);
+    decoded.inter_picture_predicted = header->inter_picture_predicted;
+    decoded.flexible = header->flexible;
+    decoded.has_picture_id = header->picture_id;
+    decoded.has_layer_indices = header->layer_indices;
+    decoded.temporal_id = 0;
+    decoded.switching_up = false;
+    decoded.spatial_id = 0;
+    decoded.inter_layer_dependency = false;
+    decoded.num_ref_pics = 0;
+    hdrlen = 1;
+
+    if (header->picture_id)
+    {
+        if (size < hdrlen + 1)
+            return 0;
+        decoded.picture_id = payload[hdrlen++] & 0x7F;
+        /* M set, the PictureID is 15 bits */
+        if (payload[hdrlen - 1] & 0x80)
+        {
+            if (size < hdrlen + 1)
+                return 0;
+            decoded.picture_id = (decoded.picture_id << 8) |
+                payload[hdrlen++];
+        }
+    }
+    if (header->layer_indices)
+    {
+        if (size < hdrlen + (header->flexible ? 1 : 2))
+            return 0;
+        decoded.temporal_id = payload[hdrlen] >> 5;
+        decoded.switching_up = (payload[hdrlen] >> 4) & 0x01;
+        decoded.spatial_id = (payload[hdrlen] >> 1) & 0x07;
+        decoded.inter_layer_dependency = payload[hdrlen++] & 0x01;
+        if (!header->flexible)
+            decoded.tl0picidx = payload[hdrlen++];
+    }
+    /* P_DIFF octets follow as long as N is set, three at most */
+    if (header->flexible && header->inter_picture_predicted)
+    {
+        do
+        {
+            if (size < hdrlen + 1 || decoded.num_ref_pics == VP9_MAX_P_DIFF)
+                return 0;
+            decoded.p_diff[decoded.num_ref_pics++] = payload[hdrlen] >> 1;
+        } while (payload[hdrlen++] & 0x01);
+    }
+    if (header->scalability_structure)
+    {
+        sslen = vp9_parse_scalability_structure(payload + hdrlen,
+                size - hdrlen, &decoded);
+        if (sslen == 0)
+            return 0;
+        hdrlen += sslen;
+    }
+
+    if (context)
+        *context = decoded;
+
+    return hdrlen;
+}
+
+/* NOTE: N_S|Y|G, then a resolution per spatial layer when Y is set and
+ * the picture group description when G is set, of which only the size is
+ * taken. Returns the size of the structure, 0 if it is truncated */
+static INLINE size_t
+vp9_parse_scalability_structure(const uint8_t *ssptr,
+                                size_t         sslen,
+                                vp9_context_t *context)
+{
+    size_t  offset = 0;
+    uint8_t layer  = 0;
+    uint8_t count  = 0;
+    uint8_t group  = 0;
+
+    g_return_val_if_fail(NULL != ssptr, 0);
+    g_return_val_if_fail(NULL != context, 0);
+
+    if (sslen < 1)
+        return 0;
+    context->has_scalability_structure = true;
+    context->num_spatial_layers = (ssptr[0] >> 5) + 1;
+    context->has_resolutions = (ssptr[0] >> 4) & 0x01;
+    context->num_pictures_in_group = 0;
+    group = (ssptr[0] >> 3) & 0x01;
+    offset = 1;
+
+    if (context->has_resolutions)
+    {
+        if (sslen < offset + 4 * context->num_spatial_layers)
+            return 0;
+        for (layer = 0; layer < context->num_spatial_layers; layer++)
+        {
+            context->layer_width[layer] = (ssptr[offset] << 8) |
+                ssptr[offset + 1];
+            context->layer_height[layer] = (ssptr[offset + 2] << 8) |
+                ssptr[offset + 3];
+            offset += 4;
+        }
+    }
+    if (group)
+    {
+        if (sslen < offset + 1)
+            return 0;
+        context->num_pictures_in_group = ssptr[offset++];
+        for (count = 0; count < context->num_pictures_in_group; count++)
+        {
+            /* TID|U|R|RSV, then R P_DIFF octets */
+            if (sslen < offset + 1)
+                return 0;
+            offset += 1 + ((ssptr[offset] >> 2) & 0x03);
+            if (sslen < offset)
+                return 0;
+        }
+    }
+
+    return offset;
+}
+
+/* NOTE: only packets beginning a layer frame update the context, so it
+ * ends up describing the highest spatial layer of the picture. A packet
+ * whose descriptor does not parse leaves it as it was */
+static INLINE bool
+vp9_decode_context(const uint8_t *payload,
+                   size_t         size,
+                   vp9_context_t *context)
+{
+    const vp9_descriptor_header_t *header = NULL;
+    vp9_context_t                  decoded;
+
+    g_return_val_if_fail(NULL != payload, false);
+    g_return_val_if_fail(NULL != context, false);
+
+    header = (const vp9_descriptor_header_t *)(payload);
+    if (!header->begin)
+        return true;
+
+    decoded = *context;
+    if (vp9_parse_descriptor(payload, size, &decoded) == 0)
+        return false;
+    if (decoded.spatial_id == 0)
+        decoded.picture_has_structure = header->scalability_structure;
+    else if (header->scalability_structure)
+        decoded.picture_has_structure = true;
+    if (decoded.has_resolutions &&
+        decoded.spatial_id < decoded.num_spatial_layers)
+    {
+        decoded.width = decoded.layer_width[decoded.spatial_id];
+        decoded.height = decoded.layer_height[decoded.spatial_id];
+    }
+    *context = decoded;
+
+    return true;
+}
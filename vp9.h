@@ -0,0 +1,94 @@
+/*
+ * Author: Pu-Chen Mao
+ * Date:   2026/10/15
+ * File:   vp9.h
+ * Desc:   VP9 RTP (RFC 9628) frame reassembly
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    #define VP9_MAX_SPATIAL_LAYERS 8
+
+    /* First octet of the payload descriptor, I|P|L|F|B|E|V|Z */
+    typedef struct vp9_descriptor_header_t
+    {
+        #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        uint8_t not_switching_up:        1;
+        uint8_t scalability_structure:   1;
+        uint8_t end:                     1;
+        uint8_t begin:                   1;
+        uint8_t flexible:                1;
+        uint8_t layer_indices:           1;
+        uint8_t inter_picture_predicted: 1;
+        uint8_t picture_id:              1;
+        #else
+            #error "little-endian only"
+        #endif
+
+    } __attribute__ ((__packed__)) vp9_descriptor_header_t;
+
+    typedef struct vp9_context_t
+    {
+        /* VP9 Payload Descriptor, of the last packet beginning a layer
+         * frame of the picture */
+        bool     inter_picture_predicted;
+        bool     flexible;
+        bool     has_picture_id;
+        uint16_t picture_id;        // 7 or 15 bits
+        bool     has_layer_indices;
+        uint8_t  temporal_id;
+        bool     switching_up;
+        uint8_t  spatial_id;        // highest spatial layer reassembled
+        bool     inter_layer_dependency;
+        uint8_t  tl0picidx;         // non-flexible mode only
+        uint8_t  num_ref_pics;      // flexible mode only
+        uint8_t  p_diff[3];
+
+        /* VP9 Scalability Structure, kept until the next one */
+        bool     has_scalability_structure;
+        uint8_t  num_spatial_layers;
+        bool     has_resolutions;
+        uint16_t layer_width[VP9_MAX_SPATIAL_LAYERS];
+        uint16_t layer_height[VP9_MAX_SPATIAL_LAYERS];
+        uint8_t  num_pictures_in_group;
+        bool     picture_has_structure; // one came with this picture
+
+        /* Resolution of the highest spatial layer reassembled, when the
+         * scalability structure carries resolutions */
+        uint16_t width;
+        uint16_t height;
+
+    } vp9_context_t;
+
+    typedef enum prefix_t prefix_t;
+    typedef struct media_vector_t media_vector_t;
+
+    bool vp9_reassemble_frame(uint8_t **index, size_t *length,
+            const uint8_t *limit, prefix_t prefix, const uint8_t *payload,
+            size_t size, bool completed, void *data);
+    bool vp9_is_fragmented(const uint8_t *payload, size_t size);
+    uint8_t vp9_get_frame_type(const uint8_t *frameptr, size_t framelen);
+    bool vp9_is_first_packet(const uint8_t *payload, size_t size);
+    bool vp9_is_last_packet(const uint8_t *payload, size_t size);
+    size_t vp9_measure_packet(const uint8_t *payload, size_t size,
+            prefix_t prefix);
+    void vp9_conceal_frame(uint8_t *output, size_t length, bool closing,
+            void *data);
+    bool vp9_scatter_frame(media_vector_t *vector, prefix_t prefix,
+            const uint8_t *payload, size_t size, bool completed,
+            void *data);
+    void vp9_merge_context(void *data, const void *frame);
+    bool vp9_get_layer_ids(const uint8_t *payload, size_t size,
+            uint8_t *spatial_id, uint8_t *temporal_id, bool *end);
+
+#ifdef __cplusplus
+}
+#endif